@@ -0,0 +1,1798 @@
+/**
+ * Benchmark of the search engines.
+ *
+ * Times find_positives_vs_negatives, check_metric and whole searches over a
+ * grid of sample sizes, decimal places and target sets, and reports
+ * candidates and matches per second. Build it with make bench.
+ *
+ * With --verify it instead runs boundary, range and random queries through
+ * every engine, checks each against a brute force search of the same query,
+ * and reports the time each engine took. It exits with 1 if an exact engine
+ * disagreed. Builds without GPU=1 run the GPU engine with its blocks checked
+ * on the host. Random sequences of changing queries are answered by a
+ * search_session and compared with fresh searches. The multiclass search is
+ * checked the same way, at several thread counts, against every K x K matrix
+ * of small problems.
+ */
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <map>
+#include "reverse_engineer.hpp"
+
+/**
+ * bench_targets - a set of targets, taken from one reference matrix.
+ */
+struct bench_targets
+{
+	const char * name;
+	unsigned mask;
+	double accuracy;
+	double sensitivity;
+	double specificity;
+	double f1;
+	double precision;
+};
+
+// Most target ranges a query of --verify sets beyond its single targets.
+const int VERIFY_QUERY_RANGES = 3;
+
+/**
+ * verify_range - a range of values one metric of a query may round into,
+ * named by its --range name. A NULL metric ends the ranges of a query.
+ */
+struct verify_range
+{
+	const char * metric;
+	double low;
+	double high;
+};
+
+/**
+ * verify_query - a query searched by every engine with --verify.
+ *
+ * The single targets are rounded half up. A query with a rounding mask
+ * searches them under those rounding modes instead, and its ranges replace
+ * the single targets of the same metrics or add registry metrics.
+ */
+struct verify_query
+{
+	const char * kind;
+	count_int class_a_count;
+	count_int class_b_count;
+	int decimal_places;
+	double accuracy;
+	double sensitivity;
+	double specificity;
+	double f1;
+	double precision;
+	unsigned rounding;
+	verify_range ranges[VERIFY_QUERY_RANGES];
+};
+
+/**
+ * oracle_value - a metric of one matrix, numerator / denominator, or
+ * numerator / sqrt(denominator) for root.
+ */
+struct oracle_value
+{
+	wide_int numerator;
+	wide_int denominator;
+	bool root;
+};
+
+/**
+ * verify_multiclass_query - a multiclass problem searched with --verify.
+ */
+struct verify_multiclass_query
+{
+	const char * kind;
+	multiclass_problem problem;
+};
+
+/**
+ * verify_result - the totals of one engine over the queries of --verify.
+ */
+struct verify_result
+{
+	uint64_t matches;
+	double seconds;
+	int mismatches;
+};
+
+// Queries that sit on the edges of the search: the smallest classes, a class
+// with no errors, ratios that tie halfway between two rounded values, and
+// accuracies that no split can reach.
+const verify_query VERIFY_BOUNDARY_QUERIES[] = {
+	{"smallest", 1, 1, 0, 1, -1, -1, -1, -1, 0, {}},
+	{"smallest", 1, 1, 0, 0, -1, -1, -1, -1, 0, {}},
+	{"smallest", 1, 1, 1, 0.5, 1, 0, -1, -1, 0, {}},
+	{"smallest", 1, 1, 2, 0.5, 0, 1, 0, 0, 0, {}},
+	{"smallest", 1, 1000, 2, 1, 1, 1, 1, 1, 0, {}},
+	{"smallest", 1000, 1, 3, 0.999, 1, -1, -1, -1, 0, {}},
+	{"no errors", 500, 500, 2, 1, 1, 1, 1, 1, 0, {}},
+	{"no errors", 50, 70, 2, 0.92, 1, -1, -1, -1, 0, {}},
+	{"no errors", 50, 70, 2, 0.92, -1, 1, -1, 1, 0, {}},
+	{"no errors", 300, 700, 0, 1, 1, 1, -1, -1, 0, {}},
+	{"tie", 4, 4, 1, 0.3, 0.3, -1, -1, -1, 0, {}},
+	{"tie", 4, 4, 1, 0.8, 0.8, 0.8, 0.8, 0.8, 0, {}},
+	{"tie", 8, 8, 2, 0.13, 0.13, -1, -1, -1, 0, {}},
+	{"tie", 8, 8, 2, 0.88, 0.88, 0.88, 0.88, 0.88, 0, {}},
+	{"tie", 20, 20, 1, 0.5, -1, -1, -1, -1, 0, {}},
+	{"tie", 40, 40, 1, 0.5, 0.5, 0.5, 0.5, 0.5, 0, {}},
+	{"tie", 400, 400, 3, 0.125, -1, -1, -1, -1, 0, {}},
+	{"tie", 2, 2, 0, 1, 1, 1, 1, 1, 0, {}},
+	{"dp", 7, 9, 6, 0.5625, -1, -1, -1, -1, 0, {}},
+	{"dp", 981, 981, 2, 0.75, 0.86, 0.64, 0.77, 0.71, 0, {}},
+	{"infeasible", 10, 10, 2, 0.33, -1, -1, -1, -1, 0, {}},
+	{"infeasible", 3, 4, 3, 0.5, -1, -1, -1, -1, 0, {}}
+};
+
+// Queries of ranges under each rounding mode, of the registry metrics, and
+// of the negative values of Youden's J and MCC.
+const verify_query VERIFY_RANGE_QUERIES[] = {
+	{"range", 40, 60, 2, -1, -1, -1, -1, -1, ROUND_ALL,
+		{{"accuracy", 0.5, 0.6}, {"npv", 0.5, 0.7}}},
+	{"range", 20, 20, 1, -1, -1, -1, -1, -1, ROUND_HALF_EVEN,
+		{{"accuracy", 0.5, 0.5}, {"jaccard", 0.3, 0.5}}},
+	{"range", 4, 4, 1, -1, -1, -1, -1, -1, ROUND_HALF_DOWN,
+		{{"accuracy", 0.5, 0.5}, {"sensitivity", 0.5, 0.8}}},
+	{"range", 8, 8, 2, -1, 0.5, -1, -1, -1, ROUND_DOWN | ROUND_UP,
+		{{"accuracy", 0.25, 0.75}, {"youden", -0.5, 0}}},
+	{"range", 1, 1, 0, -1, -1, -1, -1, -1, ROUND_UP,
+		{{"accuracy", 1, 1}, {"specificity", 0, 1}}},
+	{"range", 16, 20, 2, 0.72, -1, -1, -1, -1, ROUND_HALF_UP,
+		{{"mcc", 0.2, 0.45}}},
+	{"range", 40, 80, 1, -1, -1, -1, -1, -1, ROUND_ALL,
+		{{"accuracy", 0.2, 0.4}, {"mcc", -0.5, -0.1}}},
+	{"range", 200, 800, 3, -1, -1, -1, -1, -1, ROUND_HALF_EVEN | ROUND_HALF_DOWN,
+		{{"accuracy", 0.8, 0.85}, {"balanced-accuracy", 0.7, 0.75},
+		{"f1", 0.6, 0.7}}},
+	{"range", 981, 981, 2, 0.75, 0.86, 0.64, -1, -1, ROUND_DOWN,
+		{{"precision", 0.7, 0.72}, {"npv", 0.8, 0.82}, {"mcc", 0.5, 0.53}}},
+	{"range", 30, 70, 2, -1, -1, -1, -1, -1, ROUND_HALF_UP | ROUND_UP,
+		{{"accuracy", 0, 0.1}, {"youden", -1, -0.8}}}
+};
+
+// Names of the single target metrics, as accepted by --range.
+const char * const VERIFY_METRIC_NAMES[5] = {"accuracy", "sensitivity",
+	"specificity", "f1", "precision"};
+
+// Registry metrics oracle_metric computes, after the single target metrics.
+const char * const ORACLE_EXTRA_NAMES[5] = {"npv", "balanced-accuracy",
+	"jaccard", "youden", "mcc"};
+
+// Class sizes of the random queries that make their ratios tie often.
+const count_int VERIFY_TIE_SIZES[] = {2, 4, 8, 16, 20, 40, 80, 200, 400, 800};
+
+// Largest class size of a random query, which keeps the brute force quick.
+const count_int VERIFY_MAX_CLASS = 1500;
+
+// Queries in each sequence of a search_session of --verify.
+const int VERIFY_SESSION_QUERIES = 12;
+
+// Most classes of a multiclass query of --verify.
+const int VERIFY_MULTICLASS_MAX_CLASSES = 5;
+
+// Class sizes of the multiclass queries of --verify, each ended by a 0. They
+// stay small enough for the brute force to enumerate every matrix.
+const count_int VERIFY_MULTICLASS_SIZES[][VERIFY_MULTICLASS_MAX_CLASSES + 1] = {
+	{2, 2, 0}, {5, 1, 0}, {7, 5, 0}, {1, 1, 1, 0}, {3, 3, 3, 0}, {4, 3, 3, 0},
+	{5, 3, 2, 0}, {6, 4, 3, 0}, {8, 6, 4, 0}, {3, 3, 2, 2, 0},
+	{2, 2, 1, 1, 1, 0}
+};
+
+// Thread counts every multiclass query of --verify is searched with.
+const int VERIFY_MULTICLASS_THREADS[] = {1, 2, 3, 8};
+
+// Cells in each block of the host checked GPU engine of --verify, small so
+// that most diagonals are split across blocks.
+const uint32_t VERIFY_GPU_BLOCK_CELLS = 61;
+
+// Every search runs for at least this long, repeating if it is quicker.
+const double BENCH_MIN_SECONDS = 0.05;
+
+// Searches with more candidates than this are skipped by default.
+const double BENCH_CANDIDATE_BUDGET = 1e8;
+
+// Results the compiler must not optimise away are added to this.
+volatile long long bench_sink;
+
+double seconds_since(std::chrono::steady_clock::time_point);
+double rounded_target(long long, long long, int);
+bench_targets make_bench_targets(const char *, unsigned, count_int, count_int,
+		int);
+double count_candidates(const search_context &, count_int, double);
+void bench_accuracy_band(long long);
+void bench_check_metric();
+void bench_searches(long long, int, double);
+std::vector<verify_query> make_verify_queries(unsigned, int);
+verify_query make_random_range_query(std::mt19937 &, bool,
+		confusion_matrix &);
+bool make_metric_range(int, const confusion_matrix &, int, std::mt19937 &,
+		verify_range &);
+double verify_range_minimum(int);
+target_ranges verify_targets(const verify_query &);
+void print_verify_query(const verify_query &);
+void oracle_search(const verify_query &, std::vector<confusion_matrix> &);
+oracle_value oracle_metric(int, count_int, count_int, count_int, count_int);
+int oracle_compare(const oracle_value &, long long, wide_int);
+long long oracle_round(const oracle_value &, long long, int);
+bool oracle_in_range(const oracle_value &, const target_range &, int,
+		unsigned);
+size_t first_difference(const std::vector<confusion_matrix> &,
+		const std::vector<confusion_matrix> &);
+void verify_gpu_host(const verify_query &, result_sink &);
+void change_session_query(verify_query &, const confusion_matrix &,
+		std::mt19937 &);
+int verify_metric_index(const char *);
+int verify_session(int, unsigned, int);
+std::vector<verify_multiclass_query> make_multiclass_queries(unsigned, int);
+void print_multiclass_problem(const multiclass_problem &);
+void multiclass_oracle(const multiclass_problem &,
+		std::vector<multiclass_solution> &);
+void multiclass_oracle_rows(const multiclass_problem &, int, int, count_int,
+		multiclass_solution &,
+		std::map<std::vector<count_int>, multiclass_solution> &);
+bool multiclass_oracle_matches(const multiclass_problem &,
+		const multiclass_solution &);
+oracle_value oracle_mean(const count_int *, const count_int *, int);
+bool oracle_meets(const oracle_value &, double, int);
+bool same_solutions(const std::vector<multiclass_solution> &,
+		const std::vector<multiclass_solution> &);
+int verify_multiclass(unsigned, int);
+int bench_verify(int, unsigned, int);
+
+/**
+ * Main method
+ *
+ * Options
+ *   --max-n N - the largest total sample size to search, up to 1e12
+ *               (default 1e9)
+ *   --threads N - number of worker threads for the searches (default 1)
+ *   --budget N - skip searches with more candidates than this, 0 for none
+ *   --verify - check the engines against each other instead of timing them
+ *   --queries N - the number of random queries of --verify (default 200)
+ *   --seed N - the seed of the random queries of --verify (default 1)
+ */
+int main(int argc, char ** argv){
+	long long max_n = 1000000000;
+	int threads = 1;
+	double budget = BENCH_CANDIDATE_BUDGET;
+	bool verify = false;
+	int query_count = 200;
+	unsigned seed = 1;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--max-n") == 0 && i + 1 < argc)
+			max_n = (long long)atof(argv[++i]);
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc)
+			budget = atof(argv[++i]);
+		else if (strcmp(argv[i], "--verify") == 0)
+			verify = true;
+		else if (strcmp(argv[i], "--queries") == 0 && i + 1 < argc)
+			query_count = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+			seed = (unsigned)strtoul(argv[++i], NULL, 10);
+		else
+		{
+			std::cerr << "Unknown option: " << argv[i] << std::endl;
+			return(1);
+		}
+	}
+	if (threads < 1 || query_count < 0 || max_n < 100 ||
+			max_n > 1000000000000LL)
+	{
+		std::cerr << "Invalid options." << std::endl;
+		return(1);
+	}
+	if (verify)
+		return(bench_verify(threads, seed, query_count));
+
+	bench_accuracy_band(max_n);
+	bench_check_metric();
+	bench_searches(max_n, threads, budget);
+	return(0);
+}
+
+/**
+ * seconds_since - the time elapsed since a starting point.
+ *
+ * Parameters
+ *   time_point - the starting point
+ *
+ * Returns
+ *   double - the elapsed seconds
+ */
+double seconds_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * rounded_target - a ratio rounded half up to some decimal places, as a
+ * target that make_metric_band accepts.
+ *
+ * Parameters
+ *   long long - the numerator
+ *   long long - the denominator
+ *   int - the number of decimal places
+ *
+ * Returns
+ *   double - the rounded ratio
+ */
+double rounded_target(long long numerator, long long denominator,
+		int decimal_places)
+{
+	long long scale = 1;
+	for (int d = 0; d < decimal_places; d++)
+		scale *= 10;
+	long long rounded = (long long)(((wide_int)2 * numerator * scale +
+				denominator) / (2 * (wide_int)denominator));
+	return (double)rounded / (double)scale;
+}
+
+/**
+ * make_bench_targets - the targets of the matrix with sensitivity 0.86 and
+ * specificity 0.64, keeping only the metrics in a mask.
+ *
+ * Parameters
+ *   const char * - the name of the set
+ *   unsigned - the metric_flag of every metric to keep
+ *   count_int - count of items in class A
+ *   count_int - count of items in class B
+ *   int - the number of decimal places
+ *
+ * Returns
+ *   bench_targets - the targets, -1 for every metric left out
+ */
+bench_targets make_bench_targets(const char * name, unsigned mask,
+		count_int class_a_count, count_int class_b_count, int decimal_places)
+{
+	long long TP = (long long)(0.86 * class_a_count);
+	long long TN = (long long)(0.64 * class_b_count);
+	long long FN = class_a_count - TP;
+	long long FP = class_b_count - TN;
+
+	bench_targets targets = {name, mask,
+		rounded_target(TP + TN, class_a_count + class_b_count, decimal_places),
+		-1, -1, -1, -1};
+	if (mask & METRIC_SENSITIVITY)
+		targets.sensitivity = rounded_target(TP, class_a_count, decimal_places);
+	if (mask & METRIC_SPECIFICITY)
+		targets.specificity = rounded_target(TN, class_b_count, decimal_places);
+	if (mask & METRIC_F1)
+		targets.f1 = rounded_target(2 * TP, 2 * TP + FP + FN, decimal_places);
+	if (mask & METRIC_PRECISION)
+		targets.precision = rounded_target(TP, TP + FP, decimal_places);
+	return targets;
+}
+
+/**
+ * count_candidates - the number of cells a search checks.
+ *
+ * Counting stops once it passes a budget, as the diagonals of the largest
+ * samples are too many to walk just to skip the search.
+ *
+ * Parameters
+ *   search_context - the class counts and bands of the search
+ *   count_int - the number of diagonals
+ *   double - the count to stop at, 0 for no limit
+ *
+ * Returns
+ *   double - the number of cells on the searched diagonals
+ */
+double count_candidates(const search_context & context,
+		count_int combinations, double budget)
+{
+	double candidates = 0;
+	for (count_int i = 0; i < combinations; i++)
+	{
+		count_int correct = context.max_correct - i;
+		count_int max_tp = std::min(std::min(context.class_a_count, correct),
+				std::min(context.tp_band.max_count,
+					correct - context.tn_band.min_count));
+		count_int min_tp = std::max(std::max(0LL, correct - context.class_b_count),
+				std::max(context.tp_band.min_count,
+					correct - context.tn_band.max_count));
+		if (max_tp >= min_tp)
+			candidates += (double)(max_tp - min_tp + 1);
+		if (budget > 0 && candidates > budget)
+			break;
+	}
+	return candidates;
+}
+
+/**
+ * bench_accuracy_band - time find_positives_vs_negatives for every sample
+ * size and decimal place count of the grid.
+ *
+ * Parameters
+ *   long long - the largest total sample size
+ */
+void bench_accuracy_band(long long max_n)
+{
+	printf("find_positives_vs_negatives\n");
+	printf("%12s %3s %12s\n", "N", "DP", "ns/call");
+	for (long long n = 100; n <= max_n; n *= 10)
+	{
+		for (int dp = 0; dp <= 6; dp++)
+		{
+			const int CALLS = 100000;
+			std::chrono::steady_clock::time_point start =
+				std::chrono::steady_clock::now();
+			for (int call = 0; call < CALLS; call++)
+			{
+				accuracy_band band = find_positives_vs_negatives(n,
+						0.75 + (call & 1) * 0.01, dp);
+				bench_sink += band.min_correct;
+			}
+			double elapsed = seconds_since(start);
+			printf("%12lld %3d %12.1f\n", n, dp, elapsed * 1e9 / CALLS);
+		}
+	}
+	printf("\n");
+}
+
+/**
+ * bench_check_metric - time check_metric on random matrices for every
+ * metric mask.
+ */
+void bench_check_metric()
+{
+	const int CLASS_COUNT = 10000;
+	const int CANDIDATES = 1 << 16;
+	const int ROUNDS = 64;
+	std::mt19937 random(1);
+	std::vector<int> tp(CANDIDATES), tn(CANDIDATES);
+	for (int c = 0; c < CANDIDATES; c++)
+	{
+		tp[c] = (int)(random() % (CLASS_COUNT + 1));
+		tn[c] = (int)(random() % (CLASS_COUNT + 1));
+	}
+
+	printf("check_metric\n");
+	printf("%4s %3s %14s %10s\n", "mask", "DP", "candidates/s", "matches");
+	for (unsigned mask = 0; mask <= METRIC_ALL; mask++)
+	{
+		for (int dp = 0; dp <= 6; dp += 2)
+		{
+			bench_targets targets = make_bench_targets("", mask, CLASS_COUNT,
+					CLASS_COUNT, dp);
+			metric_targets bands = make_metric_targets(targets.sensitivity,
+					targets.specificity, targets.f1, targets.precision, dp);
+
+			long long matches = 0;
+			std::chrono::steady_clock::time_point start =
+				std::chrono::steady_clock::now();
+			for (int round = 0; round < ROUNDS; round++)
+				for (int c = 0; c < CANDIDATES; c++)
+					matches += check_metric(tp[c], CLASS_COUNT - tp[c],
+							CLASS_COUNT - tn[c], tn[c], bands);
+			double elapsed = seconds_since(start);
+			printf("%4u %3d %14.3e %10lld\n", mask, dp,
+					(double)CANDIDATES * ROUNDS / elapsed, matches / ROUNDS);
+		}
+	}
+	printf("\n");
+}
+
+/**
+ * bench_searches - time whole searches for every engine, sample size,
+ * decimal place count and target set of the grid.
+ *
+ * Parameters
+ *   long long - the largest total sample size
+ *   int - the number of worker threads
+ *   double - the largest candidate count to search, 0 for no limit
+ */
+void bench_searches(long long max_n, int threads, double budget)
+{
+	const search_engine ENGINES[5] = {ENGINE_ROUNDED, ENGINE_SCALAR,
+		ENGINE_PRUNED, ENGINE_SIMD, ENGINE_GPU};
+	const char * ENGINE_NAMES[5] = {"rounded", "scalar", "pruned", "simd",
+		"gpu"};
+	int engine_count = gpu_available() ? 5 : 4;
+	const unsigned MASKS[4] = {0, METRIC_SENSITIVITY | METRIC_SPECIFICITY,
+		METRIC_F1 | METRIC_PRECISION, METRIC_ALL};
+	const char * MASK_NAMES[4] = {"accuracy", "sens+spec", "f1+prec", "all"};
+
+	printf("search_matrices, %d thread%s\n", threads, threads == 1 ? "" : "s");
+	printf("%-8s %12s %3s %-10s %12s %12s %10s %14s %14s\n", "engine", "N",
+			"DP", "targets", "candidates", "matches", "seconds", "candidates/s",
+			"matches/s");
+	for (long long n = 100; n <= max_n; n *= 10)
+	{
+		count_int class_a_count = n / 2;
+		count_int class_b_count = n - n / 2;
+		for (int dp = 0; dp <= 6; dp++)
+		{
+			for (int m = 0; m < 4; m++)
+			{
+				bench_targets targets = make_bench_targets(MASK_NAMES[m], MASKS[m],
+						class_a_count, class_b_count, dp);
+				accuracy_band band = find_positives_vs_negatives(n,
+						targets.accuracy, dp);
+				if (!band.feasible)
+					continue;
+
+				for (int e = 0; e < engine_count; e++)
+				{
+					search_context context;
+					count_int combinations = make_search_context(class_a_count,
+							class_b_count, band, targets.accuracy,
+							targets.sensitivity, targets.specificity, targets.f1,
+							targets.precision, dp, ENGINES[e], context);
+					double candidates = count_candidates(context, combinations,
+							budget);
+					if (budget > 0 && candidates > budget)
+					{
+						printf("%-8s %12lld %3d %-10s %12.3e %12s\n",
+								ENGINE_NAMES[e], n, dp, targets.name, candidates,
+								"skipped");
+						continue;
+					}
+
+					int runs = 0;
+					uint64_t matches = 0;
+					double elapsed = 0;
+					std::chrono::steady_clock::time_point start =
+						std::chrono::steady_clock::now();
+					do
+					{
+						counter_sink counter;
+						search_matrices(class_a_count, class_b_count, dp,
+								targets.accuracy, targets.sensitivity,
+								targets.specificity, targets.f1, targets.precision,
+								ENGINES[e], threads, counter);
+						matches = counter.count();
+						runs++;
+						elapsed = seconds_since(start);
+					} while (elapsed < BENCH_MIN_SECONDS);
+
+					double per_run = elapsed / runs;
+					printf("%-8s %12lld %3d %-10s %12.3e %12llu %10.6f %14.3e %14.3e\n",
+							ENGINE_NAMES[e], n, dp, targets.name, candidates,
+							(unsigned long long)matches, per_run, candidates / per_run,
+							(double)matches / per_run);
+					fflush(stdout);
+				}
+			}
+		}
+	}
+}
+
+/**
+ * make_verify_queries - the boundary queries followed by random ones.
+ *
+ * Each random query takes its targets from a random matrix, rounded half up,
+ * so it has at least that match, and keeps a random subset of the metrics.
+ * Half of them use class sizes that make ties common. They are followed by
+ * the range queries and half as many random ones.
+ *
+ * Parameters
+ *   unsigned - the seed of the random queries
+ *   int - the number of random queries
+ *
+ * Returns
+ *   std::vector - the queries
+ */
+std::vector<verify_query> make_verify_queries(unsigned seed, int query_count)
+{
+	std::vector<verify_query> queries(VERIFY_BOUNDARY_QUERIES,
+			VERIFY_BOUNDARY_QUERIES + sizeof(VERIFY_BOUNDARY_QUERIES) /
+			sizeof(VERIFY_BOUNDARY_QUERIES[0]));
+	const size_t TIE_SIZE_COUNT = sizeof(VERIFY_TIE_SIZES) /
+		sizeof(VERIFY_TIE_SIZES[0]);
+	std::mt19937 random(seed);
+	for (int q = 0; q < query_count; q++)
+	{
+		verify_query query;
+		bool ties = random() % 2 == 0;
+		query.kind = ties ? "random tie" : "random";
+		if (ties)
+		{
+			query.class_a_count = VERIFY_TIE_SIZES[random() % TIE_SIZE_COUNT];
+			query.class_b_count = VERIFY_TIE_SIZES[random() % TIE_SIZE_COUNT];
+		}
+		else
+		{
+			query.class_a_count = 1 + (count_int)(random() % VERIFY_MAX_CLASS);
+			query.class_b_count = 1 + (count_int)(random() % VERIFY_MAX_CLASS);
+		}
+		query.decimal_places = (int)(random() % 5);
+
+		long long TP = (long long)(random() % (query.class_a_count + 1));
+		long long TN = (long long)(random() % (query.class_b_count + 1));
+		long long FN = query.class_a_count - TP;
+		long long FP = query.class_b_count - TN;
+		unsigned mask = (unsigned)(random() % (METRIC_ALL + 1));
+		int dp = query.decimal_places;
+		query.accuracy = rounded_target(TP + TN,
+				query.class_a_count + query.class_b_count, dp);
+		query.sensitivity = (mask & METRIC_SENSITIVITY) ?
+			rounded_target(TP, query.class_a_count, dp) : -1;
+		query.specificity = (mask & METRIC_SPECIFICITY) ?
+			rounded_target(TN, query.class_b_count, dp) : -1;
+		query.f1 = (mask & METRIC_F1) ?
+			rounded_target(2 * TP, 2 * TP + FP + FN, dp) : -1;
+		query.precision = (mask & METRIC_PRECISION) && TP + FP != 0 ?
+			rounded_target(TP, TP + FP, dp) : -1;
+		query.rounding = 0;
+		query.ranges[0].metric = NULL;
+		queries.push_back(query);
+	}
+
+	queries.insert(queries.end(), VERIFY_RANGE_QUERIES, VERIFY_RANGE_QUERIES +
+			sizeof(VERIFY_RANGE_QUERIES) / sizeof(VERIFY_RANGE_QUERIES[0]));
+	confusion_matrix matrix;
+	for (int q = 0; q < query_count / 2; q++)
+		queries.push_back(make_random_range_query(random, false, matrix));
+	return queries;
+}
+
+/**
+ * make_random_range_query - a query of ranges around the metrics of a random
+ * matrix, under random rounding modes.
+ *
+ * The accuracy and up to two other metrics, single target or registry ones,
+ * get a range from make_metric_range. Class A, and with ties class B too,
+ * take sizes that make ties common.
+ *
+ * Parameters
+ *   std::mt19937 - the random numbers
+ *   bool - ties
+ *   confusion_matrix - set to the random matrix
+ *
+ * Returns
+ *   verify_query - the query
+ */
+verify_query make_random_range_query(std::mt19937 & random, bool ties,
+		confusion_matrix & matrix)
+{
+	verify_query query = {"random range", 0, 0, 0, -1, -1, -1, -1, -1, 0, {}};
+	const size_t TIE_SIZE_COUNT = sizeof(VERIFY_TIE_SIZES) /
+		sizeof(VERIFY_TIE_SIZES[0]);
+	query.class_a_count = VERIFY_TIE_SIZES[random() % TIE_SIZE_COUNT];
+	query.class_b_count = ties ? VERIFY_TIE_SIZES[random() % TIE_SIZE_COUNT] :
+		1 + (count_int)(random() % VERIFY_MAX_CLASS);
+	query.decimal_places = (int)(random() % 4);
+	query.rounding = 1 + (unsigned)(random() % ROUND_ALL);
+
+	matrix.tp = (count_int)(random() % (query.class_a_count + 1));
+	matrix.tn = (count_int)(random() % (query.class_b_count + 1));
+	matrix.fn = query.class_a_count - matrix.tp;
+	matrix.fp = query.class_b_count - matrix.tn;
+
+	int metric = 0;
+	for (int r = 0; r < VERIFY_QUERY_RANGES; r++)
+	{
+		// An undefined metric, such as the precision of a matrix with nothing
+		// predicted positive, is left out.
+		make_metric_range(metric, matrix, query.decimal_places, random,
+				query.ranges[r]);
+		metric = 1 + (int)(random() % 9);
+		if (r + 1 < VERIFY_QUERY_RANGES)
+			query.ranges[r + 1].metric = NULL;
+	}
+	return query;
+}
+
+/**
+ * make_metric_range - a range of up to two steps either side of the value
+ * half up rounding gives one metric of a matrix.
+ *
+ * Parameters
+ *   int - the metric, numbered as by oracle_metric
+ *   confusion_matrix - the matrix
+ *   int - the number of decimal places
+ *   std::mt19937 - the random numbers
+ *   verify_range - set to the range, if the metric is defined
+ *
+ * Returns
+ *   bool - false if the metric of the matrix is undefined
+ */
+bool make_metric_range(int metric, const confusion_matrix & matrix,
+		int decimal_places, std::mt19937 & random, verify_range & range)
+{
+	oracle_value value = oracle_metric(metric, matrix.tp, matrix.fn, matrix.fp,
+			matrix.tn);
+	if (value.denominator == 0)
+		return false;
+	long long scale = 1;
+	for (int d = 0; d < decimal_places; d++)
+		scale *= 10;
+	long long rounded = oracle_round(value, scale, ROUND_HALF_UP);
+	long long low = std::max(rounded - (long long)(random() % 3),
+			(long long)verify_range_minimum(metric) * scale);
+	long long high = std::min(rounded + (long long)(random() % 3), scale);
+	range.metric = metric < 5 ? VERIFY_METRIC_NAMES[metric] :
+		ORACLE_EXTRA_NAMES[metric - 5];
+	range.low = (double)low / (double)scale;
+	range.high = (double)high / (double)scale;
+	return true;
+}
+
+/**
+ * verify_range_minimum - the smallest value of a metric.
+ *
+ * Parameters
+ *   int - the metric, numbered as by oracle_metric
+ *
+ * Returns
+ *   double - 0, or the minimum of a registry metric
+ */
+double verify_range_minimum(int metric)
+{
+	return metric < 5 ? 0 : EXTRA_METRICS[find_extra_metric(
+			ORACLE_EXTRA_NAMES[metric - 5])].minimum;
+}
+
+/**
+ * verify_targets - the target ranges of a query.
+ *
+ * Parameters
+ *   verify_query - the query
+ *
+ * Returns
+ *   target_ranges - the single targets, replaced or added to by the ranges
+ *                   of the query, under its rounding modes
+ */
+target_ranges verify_targets(const verify_query & query)
+{
+	target_ranges ranges = exact_targets(query.accuracy, query.sensitivity,
+			query.specificity, query.f1, query.precision);
+	if (query.rounding != 0)
+		ranges.rounding = query.rounding;
+	target_range * targets[5] = {&ranges.accuracy, &ranges.sensitivity,
+		&ranges.specificity, &ranges.f1, &ranges.precision};
+	for (int r = 0; r < VERIFY_QUERY_RANGES && query.ranges[r].metric != NULL;
+			r++)
+	{
+		const verify_range & range = query.ranges[r];
+		target_range target = {range.low, range.high};
+		int metric = 0;
+		while (metric < 5 && strcmp(range.metric, VERIFY_METRIC_NAMES[metric]) != 0)
+			metric++;
+		if (metric < 5)
+			*targets[metric] = target;
+		else
+		{
+			int extra = find_extra_metric(range.metric);
+			ranges.extra[extra] = target;
+			ranges.extra_mask |= 1u << extra;
+		}
+	}
+	return ranges;
+}
+
+/**
+ * print_verify_query - print the class counts, decimal places and targets
+ * of a query, without a newline.
+ *
+ * Parameters
+ *   verify_query - the query
+ */
+void print_verify_query(const verify_query & query)
+{
+	printf("%lld %lld %d %g %g %g %g %g", query.class_a_count,
+			query.class_b_count, query.decimal_places, query.accuracy,
+			query.sensitivity, query.specificity, query.f1, query.precision);
+	if (query.rounding != 0)
+		printf(" rounding %u", query.rounding);
+	for (int r = 0; r < VERIFY_QUERY_RANGES && query.ranges[r].metric != NULL;
+			r++)
+		printf(" %s=%g:%g", query.ranges[r].metric, query.ranges[r].low,
+				query.ranges[r].high);
+}
+
+/**
+ * oracle_search - find the matches of a query by rounding every metric of
+ * every matrix under each of its rounding modes, sharing no code with the
+ * engines but the parsing of its ranges.
+ *
+ * Parameters
+ *   verify_query - the query
+ *   std::vector - set to the matches, in search order
+ */
+void oracle_search(const verify_query & query,
+		std::vector<confusion_matrix> & found)
+{
+	found.clear();
+	count_int A = query.class_a_count, B = query.class_b_count;
+	int dp = query.decimal_places;
+	target_ranges ranges = verify_targets(query);
+
+	// The metrics to check on every matrix, and the range of each.
+	const target_range * single[5] = {&ranges.accuracy, &ranges.sensitivity,
+		&ranges.specificity, &ranges.f1, &ranges.precision};
+	std::vector<int> metrics;
+	std::vector<target_range> targets;
+	for (int metric = 1; metric < 5; metric++)
+		if (single[metric]->low != -1)
+		{
+			metrics.push_back(metric);
+			targets.push_back(*single[metric]);
+		}
+	for (int k = 0; k < EXTRA_METRIC_COUNT; k++)
+		for (int j = 0; j < 5; j++)
+			if (((ranges.extra_mask >> k) & 1) &&
+					strcmp(EXTRA_METRICS[k].name, ORACLE_EXTRA_NAMES[j]) == 0)
+			{
+				metrics.push_back(5 + j);
+				targets.push_back(ranges.extra[k]);
+			}
+
+	// As in the original scan, at least one prediction must be correct.
+	for (count_int correct = A + B; correct >= 1; correct--)
+	{
+		oracle_value accuracy = {correct, A + B, false};
+		if (ranges.accuracy.low != -1 && !oracle_in_range(accuracy,
+					ranges.accuracy, dp, ranges.rounding))
+			continue;
+		for (count_int TP = std::min(A, correct);
+				TP >= std::max(0LL, correct - B); TP--)
+		{
+			count_int TN = correct - TP;
+			count_int FN = A - TP;
+			count_int FP = B - TN;
+			bool matches = true;
+			for (size_t m = 0; matches && m < metrics.size(); m++)
+				matches = oracle_in_range(oracle_metric(metrics[m], TP, FN, FP,
+							TN), targets[m], dp, ranges.rounding);
+			if (matches)
+			{
+				confusion_matrix matrix = {TP, FN, FP, TN};
+				found.push_back(matrix);
+			}
+		}
+	}
+}
+
+/**
+ * oracle_metric - one metric of a matrix, straight from its definition.
+ *
+ * Parameters
+ *   int - the metric: accuracy, sensitivity, specificity, f1 or precision,
+ *         or 5 plus the index of a registry metric in ORACLE_EXTRA_NAMES
+ *   count_int - TP
+ *   count_int - FN
+ *   count_int - FP
+ *   count_int - TN
+ *
+ * Returns
+ *   oracle_value - the metric, with a zero denominator if it is undefined
+ */
+oracle_value oracle_metric(int metric, count_int TP, count_int FN,
+		count_int FP, count_int TN)
+{
+	wide_int A = TP + FN, B = TN + FP;
+	oracle_value value = {0, 0, false};
+	switch (metric)
+	{
+	case 0:
+		value.numerator = TP + TN;
+		value.denominator = A + B;
+		break;
+	case 1:
+		value.numerator = TP;
+		value.denominator = A;
+		break;
+	case 2:
+		value.numerator = TN;
+		value.denominator = B;
+		break;
+	case 3:
+		value.numerator = 2 * TP;
+		value.denominator = 2 * TP + FP + FN;
+		break;
+	case 4:
+		value.numerator = TP;
+		value.denominator = TP + FP;
+		break;
+	case 5:
+		value.numerator = TN;
+		value.denominator = TN + FN;
+		break;
+	case 6:
+		value.numerator = TP * B + TN * A;
+		value.denominator = 2 * A * B;
+		break;
+	case 7:
+		value.numerator = TP;
+		value.denominator = TP + FP + FN;
+		break;
+	case 8:
+		value.numerator = TP * B + TN * A - A * B;
+		value.denominator = A * B;
+		break;
+	default:
+		value.numerator = (wide_int)TP * TN - (wide_int)FP * FN;
+		value.denominator = (wide_int)(TP + FP) * (TP + FN) * (TN + FP) *
+			(TN + FN);
+		value.root = true;
+		break;
+	}
+	return value;
+}
+
+/**
+ * oracle_compare - compare a scaled metric with a number of half steps.
+ *
+ * Parameters
+ *   oracle_value - the metric, with a positive denominator
+ *   long long - the decimal scale, 10^dp
+ *   wide_int - the half steps
+ *
+ * Returns
+ *   int - the sign of value * scale - half_steps / 2
+ */
+int oracle_compare(const oracle_value & value, long long scale,
+		wide_int half_steps)
+{
+	wide_int left = 2 * value.numerator * scale;
+	if (!value.root)
+	{
+		wide_int right = half_steps * value.denominator;
+		return left < right ? -1 : left > right ? 1 : 0;
+	}
+
+	// left - half_steps * sqrt(denominator), by the signs and then squares.
+	if (left >= 0 && half_steps <= 0)
+		return left == 0 && half_steps == 0 ? 0 : 1;
+	if (left <= 0 && half_steps >= 0)
+		return -1;
+	wide_int left_square = left * left;
+	wide_int right_square = half_steps * half_steps * value.denominator;
+	int side = left_square < right_square ? -1 :
+		left_square > right_square ? 1 : 0;
+	return left > 0 ? side : -side;
+}
+
+/**
+ * oracle_round - a metric rounded to some decimal places by one rounding
+ * mode, in units of the last decimal place.
+ *
+ * Parameters
+ *   oracle_value - the metric, with a positive denominator
+ *   long long - the decimal scale, 10^dp
+ *   int - the rounding_mode
+ *
+ * Returns
+ *   long long - the rounded metric times the scale
+ */
+long long oracle_round(const oracle_value & value, long long scale,
+		int mode)
+{
+	long double estimate = value.root ?
+		(long double)value.numerator / sqrtl((long double)value.denominator) :
+		(long double)value.numerator / (long double)value.denominator;
+	long long floor = (long long)floorl(estimate * scale);
+	while (oracle_compare(value, scale, 2 * (wide_int)floor) < 0)
+		floor--;
+	while (oracle_compare(value, scale, 2 * (wide_int)floor + 2) >= 0)
+		floor++;
+
+	int exact = oracle_compare(value, scale, 2 * (wide_int)floor);
+	int half = oracle_compare(value, scale, 2 * (wide_int)floor + 1);
+	switch (mode)
+	{
+	case ROUND_HALF_UP:
+		return floor + (half >= 0);
+	case ROUND_HALF_EVEN:
+		return floor + (half > 0 || (half == 0 && floor % 2 != 0));
+	case ROUND_HALF_DOWN:
+		return floor + (half > 0);
+	case ROUND_DOWN:
+		return floor;
+	default:
+		return floor + (exact != 0);
+	}
+}
+
+/**
+ * oracle_in_range - whether any of a set of rounding modes rounds a metric
+ * into a range.
+ *
+ * Parameters
+ *   oracle_value - the metric
+ *   target_range - the range of rounded values
+ *   int - the number of decimal places
+ *   unsigned - the rounding_mode mask
+ *
+ * Returns
+ *   bool - if the metric is defined and some mode rounds it into the range
+ */
+bool oracle_in_range(const oracle_value & value, const target_range & range,
+		int decimal_places, unsigned rounding)
+{
+	if (value.denominator == 0)
+		return false;
+	long long scale = 1;
+	for (int d = 0; d < decimal_places; d++)
+		scale *= 10;
+	long long low = llroundl((long double)range.low * scale);
+	long long high = llroundl((long double)range.high * scale);
+	for (int mode = ROUND_HALF_UP; mode <= ROUND_UP; mode <<= 1)
+		if (rounding & mode)
+		{
+			long long rounded = oracle_round(value, scale, mode);
+			if (rounded >= low && rounded <= high)
+				return true;
+		}
+	return false;
+}
+
+/**
+ * first_difference - the index of the first match two searches disagree on.
+ *
+ * Parameters
+ *   std::vector - the matches of one search
+ *   std::vector - the matches of the other
+ *
+ * Returns
+ *   size_t - the index, or the size of both if they are identical
+ */
+size_t first_difference(const std::vector<confusion_matrix> & expected,
+		const std::vector<confusion_matrix> & found)
+{
+	size_t m = 0;
+	for (; m < expected.size() && m < found.size(); m++)
+		if (expected[m].tp != found[m].tp || expected[m].fn != found[m].fn ||
+				expected[m].fp != found[m].fp || expected[m].tn != found[m].tn)
+			return m;
+	return expected.size() == found.size() ? expected.size() : m;
+}
+
+/**
+ * verify_gpu_host - search a query with search_diagonals_gpu on a build
+ * without GPU=1, where gpu_check_block checks each block on the host.
+ *
+ * make_search_context runs ENGINE_GPU as ENGINE_SIMD without a device, and
+ * both prune the same way, so setting the engine back afterwards gives the
+ * GPU engine's search. The blocks are kept small so that the runs split
+ * across blocks are checked too.
+ *
+ * Parameters
+ *   verify_query - the query
+ *   result_sink - the sink matches are written to
+ */
+void verify_gpu_host(const verify_query & query, result_sink & sink)
+{
+	target_ranges ranges = verify_targets(query);
+	count_int total = query.class_a_count + query.class_b_count;
+	accuracy_band band = find_accuracy_band(total, ranges.accuracy,
+			query.decimal_places, ranges.rounding);
+	if (!band.feasible)
+		return;
+
+	search_context context;
+	count_int combinations = make_search_context(query.class_a_count,
+			query.class_b_count, band, ranges, query.decimal_places, ENGINE_SIMD,
+			context);
+	context.engine = ENGINE_GPU;
+	context.gpu_block_cells = VERIFY_GPU_BLOCK_CELLS;
+	search_context_into(context, combinations, 1, sink);
+}
+
+/**
+ * change_session_query - change a query of a session the way a user would
+ * change it between queries.
+ *
+ * One of:
+ *   - move one end of one range a step in or out
+ *   - change the decimal places by one, rounding the ends outwards to fewer
+ *   - add or remove a range of a single target metric
+ *   - add or remove a range of a registry metric
+ *   - add or remove one rounding mode
+ * The accuracy range is never removed, and an added range is around the
+ * metric of the matrix the session started from.
+ *
+ * Parameters
+ *   verify_query - the query, changed in place
+ *   confusion_matrix - the matrix of the first query
+ *   std::mt19937 - the random numbers
+ */
+void change_session_query(verify_query & query,
+		const confusion_matrix & matrix, std::mt19937 & random)
+{
+	int range_count = 0;
+	while (range_count < VERIFY_QUERY_RANGES &&
+			query.ranges[range_count].metric != NULL)
+		range_count++;
+	long long scale = 1;
+	for (int d = 0; d < query.decimal_places; d++)
+		scale *= 10;
+
+	int change = (int)(random() % 5);
+	if (change == 4)
+	{
+		unsigned rounding = query.rounding ^ (1u << (random() % 5));
+		if (rounding != 0)
+			query.rounding = rounding;
+	}
+	else if (change == 0)
+	{
+		verify_range & range = query.ranges[random() % range_count];
+		long long low = llround(range.low * (double)scale);
+		long long high = llround(range.high * (double)scale);
+		long long step = random() % 2 == 0 ? 1 : -1;
+		if (random() % 2 == 0)
+			low += step;
+		else
+			high += step;
+		long long minimum = (long long)verify_range_minimum(
+				verify_metric_index(range.metric)) * scale;
+		if (low < minimum || high > scale || low > high)
+			return;
+		range.low = (double)low / (double)scale;
+		range.high = (double)high / (double)scale;
+	}
+	else if (change == 1)
+	{
+		bool fewer = query.decimal_places == 4 ||
+			(query.decimal_places > 0 && random() % 2 == 0);
+		query.decimal_places += fewer ? -1 : 1;
+		if (!fewer)
+			return;
+		for (int r = 0; r < range_count; r++)
+		{
+			long long low = llround(query.ranges[r].low * (double)scale);
+			long long high = llround(query.ranges[r].high * (double)scale);
+			low = low >= 0 ? low / 10 : -((-low + 9) / 10);
+			high = high >= 0 ? (high + 9) / 10 : -(-high / 10);
+			query.ranges[r].low = (double)low / (double)(scale / 10);
+			query.ranges[r].high = (double)high / (double)(scale / 10);
+		}
+	}
+	else
+	{
+		// Registry metrics are numbered from 5, single targets from 1.
+		bool registry = change == 3;
+		int kind_count = 0, kind[VERIFY_QUERY_RANGES];
+		for (int r = 1; r < range_count; r++)
+			if ((verify_metric_index(query.ranges[r].metric) >= 5) == registry)
+				kind[kind_count++] = r;
+		if (kind_count > 0 && (range_count == VERIFY_QUERY_RANGES ||
+					random() % 2 == 0))
+		{
+			for (int r = kind[random() % kind_count]; r + 1 < range_count; r++)
+				query.ranges[r] = query.ranges[r + 1];
+			query.ranges[range_count - 1].metric = NULL;
+			return;
+		}
+		if (range_count == VERIFY_QUERY_RANGES)
+			return;
+		int metric = registry ? 5 + (int)(random() % 5) :
+			1 + (int)(random() % 4);
+		for (int r = 0; r < range_count; r++)
+			if (verify_metric_index(query.ranges[r].metric) == metric)
+				return;
+		if (make_metric_range(metric, matrix, query.decimal_places, random,
+				query.ranges[range_count]) &&
+				range_count + 1 < VERIFY_QUERY_RANGES)
+			query.ranges[range_count + 1].metric = NULL;
+	}
+}
+
+/**
+ * verify_metric_index - the number oracle_metric gives a metric.
+ *
+ * Parameters
+ *   const char * - the --range name of the metric
+ *
+ * Returns
+ *   int - the number of the metric
+ */
+int verify_metric_index(const char * name)
+{
+	for (int metric = 0; metric < 5; metric++)
+		if (strcmp(name, VERIFY_METRIC_NAMES[metric]) == 0)
+			return metric;
+	int extra = 0;
+	while (strcmp(name, ORACLE_EXTRA_NAMES[extra]) != 0)
+		extra++;
+	return 5 + extra;
+}
+
+/**
+ * verify_session - run random sequences of changing queries through a
+ * search_session and compare each answer, in order, with a fresh search.
+ *
+ * Each sequence starts from a random range query, half of them on class
+ * sizes that make ties common, and changes it with change_session_query, so
+ * that search_session filters, extends and searches in turn.
+ *
+ * Parameters
+ *   int - the number of worker threads
+ *   unsigned - the seed of the sequences
+ *   int - the number of sequences
+ *
+ * Returns
+ *   int - the number of mismatches
+ */
+int verify_session(int threads, unsigned seed, int sequence_count)
+{
+	const char * const STEP_NAMES[3] = {"searched", "filtered", "extended"};
+	verify_result results[3] = {};
+	uint64_t queries[3] = {};
+	std::mt19937 random(seed);
+
+	printf("verify session, %d sequences of %d queries\n", sequence_count,
+			VERIFY_SESSION_QUERIES);
+	for (int s = 0; s < sequence_count; s++)
+	{
+		confusion_matrix matrix;
+		verify_query query = make_random_range_query(random, s % 2 == 0,
+				matrix);
+		query.kind = "session";
+		search_session session(query.class_a_count, query.class_b_count,
+				ENGINE_SIMD, threads);
+		for (int q = 0; q < VERIFY_SESSION_QUERIES; q++)
+		{
+			if (q > 0)
+				change_session_query(query, matrix, random);
+			target_ranges ranges = verify_targets(query);
+			std::chrono::steady_clock::time_point start =
+				std::chrono::steady_clock::now();
+			bool feasible = session.query(query.decimal_places, ranges);
+			int step = (int)session.last_step();
+			results[step].seconds += seconds_since(start);
+			results[step].matches += session.results().size();
+			queries[step]++;
+
+			vector_sink sink;
+			bool expected_feasible = search_matrices(query.class_a_count,
+					query.class_b_count, query.decimal_places, ranges,
+					ENGINE_SIMD, threads, sink);
+			const std::vector<confusion_matrix> & expected = sink.results();
+			size_t m = first_difference(expected, session.results());
+			if (feasible == expected_feasible && m == expected.size() &&
+					m == session.results().size())
+				continue;
+			results[step].mismatches++;
+			printf("MISMATCH session %s %s, query %d of sequence %d: ",
+					STEP_NAMES[step], query.kind, q + 1, s + 1);
+			print_verify_query(query);
+			printf(": expected %zu matches, found %zu, first difference at %zu\n",
+					expected.size(), session.results().size(), m);
+		}
+	}
+
+	printf("%-10s %8s %12s %10s %10s\n", "step", "queries", "matches",
+			"seconds", "mismatches");
+	int failed = 0;
+	for (int step = 0; step < 3; step++)
+	{
+		printf("%-10s %8llu %12llu %10.4f %10d\n", STEP_NAMES[step],
+				(unsigned long long)queries[step],
+				(unsigned long long)results[step].matches, results[step].seconds,
+				results[step].mismatches);
+		failed += results[step].mismatches;
+	}
+	return failed;
+}
+
+/**
+ * make_multiclass_queries - a query of every solution of each set of class
+ * sizes, followed by random ones.
+ *
+ * Each random query takes its targets from a random matrix, rounded half up,
+ * so it has at least that solution. It keeps a random subset of the
+ * accuracy, the macro averages and the per-class target vectors, and each
+ * per-class vector a random subset of its classes.
+ *
+ * Parameters
+ *   unsigned - the seed of the random queries
+ *   int - the number of random queries
+ *
+ * Returns
+ *   std::vector - the queries
+ */
+std::vector<verify_multiclass_query> make_multiclass_queries(unsigned seed,
+		int query_count)
+{
+	const int SIZE_COUNT = (int)(sizeof(VERIFY_MULTICLASS_SIZES) /
+		sizeof(VERIFY_MULTICLASS_SIZES[0]));
+	std::vector<verify_multiclass_query> queries;
+	std::mt19937 random(seed);
+	for (int q = 0; q < SIZE_COUNT + query_count; q++)
+	{
+		verify_multiclass_query query;
+		multiclass_problem & problem = query.problem;
+		const count_int * sizes = VERIFY_MULTICLASS_SIZES[q % SIZE_COUNT];
+		for (int k = 0; sizes[k] != 0; k++)
+			problem.class_counts.push_back(sizes[k]);
+		int classes = (int)problem.class_counts.size();
+		problem.decimal_places = (int)(random() % 3);
+		problem.target_accuracy = -1;
+		problem.target_macro_precision = -1;
+		problem.target_macro_recall = -1;
+		problem.target_macro_f1 = -1;
+		if (q < SIZE_COUNT)
+		{
+			query.kind = "all";
+			queries.push_back(query);
+			continue;
+		}
+		query.kind = "random";
+
+		// A random matrix, one random prediction per sample.
+		multiclass_solution matrix;
+		matrix.tp.assign(classes, 0);
+		matrix.predicted.assign(classes, 0);
+		count_int total = 0;
+		for (int k = 0; k < classes; k++)
+		{
+			total += problem.class_counts[k];
+			for (count_int n = 0; n < problem.class_counts[k]; n++)
+			{
+				int predicted = (int)(random() % classes);
+				matrix.predicted[predicted]++;
+				if (predicted == k)
+					matrix.tp[k]++;
+			}
+		}
+
+		std::vector<count_int> twice_tp(classes), f1_denominators(classes);
+		count_int correct = 0;
+		for (int k = 0; k < classes; k++)
+		{
+			correct += matrix.tp[k];
+			twice_tp[k] = 2 * matrix.tp[k];
+			f1_denominators[k] = problem.class_counts[k] + matrix.predicted[k];
+		}
+		long long scale = 1;
+		for (int d = 0; d < problem.decimal_places; d++)
+			scale *= 10;
+		const oracle_value macro[3] = {
+			oracle_mean(&matrix.tp[0], &matrix.predicted[0], classes),
+			oracle_mean(&matrix.tp[0], &problem.class_counts[0], classes),
+			oracle_mean(&twice_tp[0], &f1_denominators[0], classes)};
+		double * macro_targets[3] = {&problem.target_macro_precision,
+			&problem.target_macro_recall, &problem.target_macro_f1};
+		unsigned mask = (unsigned)(random() % 128);
+		if (mask & 1)
+			problem.target_accuracy = rounded_target(correct, total,
+					problem.decimal_places);
+		for (int m = 0; m < 3; m++)
+			if (mask & (2u << m))
+				*macro_targets[m] = (double)oracle_round(macro[m], scale,
+						ROUND_HALF_UP) / (double)scale;
+
+		std::vector<double> * per_class[3] = {&problem.target_precision,
+			&problem.target_recall, &problem.target_f1};
+		for (int m = 0; m < 3; m++)
+		{
+			if (!(mask & (16u << m)))
+				continue;
+			per_class[m]->assign(classes, -1);
+			for (int k = 0; k < classes; k++)
+			{
+				// A class that is never predicted has no precision target.
+				if (random() % 2 == 0 || (m == 0 && matrix.predicted[k] == 0))
+					continue;
+				const count_int numerators[3] = {matrix.tp[k], matrix.tp[k],
+					twice_tp[k]};
+				const count_int denominators[3] = {matrix.predicted[k],
+					problem.class_counts[k], f1_denominators[k]};
+				(*per_class[m])[k] = rounded_target(numerators[m],
+						denominators[m], problem.decimal_places);
+			}
+		}
+		queries.push_back(query);
+	}
+	return queries;
+}
+
+/**
+ * print_multiclass_problem - print the class counts, decimal places and
+ * targets of a multiclass problem, without a newline.
+ *
+ * Parameters
+ *   multiclass_problem - the problem
+ */
+void print_multiclass_problem(const multiclass_problem & problem)
+{
+	const std::vector<double> * per_class[3] = {&problem.target_precision,
+		&problem.target_recall, &problem.target_f1};
+	const char * const PER_CLASS_NAMES[3] = {"precision", "recall", "f1"};
+	for (size_t k = 0; k < problem.class_counts.size(); k++)
+		printf("%s%lld", k == 0 ? "" : ",", problem.class_counts[k]);
+	printf(" %d %g %g %g %g", problem.decimal_places, problem.target_accuracy,
+			problem.target_macro_precision, problem.target_macro_recall,
+			problem.target_macro_f1);
+	for (int m = 0; m < 3; m++)
+		for (size_t k = 0; k < per_class[m]->size(); k++)
+		{
+			if (k == 0)
+				printf(" %s ", PER_CLASS_NAMES[m]);
+			else
+				printf(",");
+			printf("%g", (*per_class[m])[k]);
+		}
+}
+
+/**
+ * multiclass_oracle - find the solutions of a multiclass problem by building
+ * every K x K matrix with its class sizes, sharing no code with the search.
+ *
+ * The solutions are in the order of the serial search: each class but the
+ * last two by true positives from the largest down, then predicted counts
+ * from the smallest up, then the next to last and last class's true
+ * positives from the largest down and the next to last predicted count from
+ * the smallest up.
+ *
+ * Parameters
+ *   multiclass_problem - the problem, with every class count small
+ *   std::vector - set to the solutions
+ */
+void multiclass_oracle(const multiclass_problem & problem,
+		std::vector<multiclass_solution> & found)
+{
+	int classes = (int)problem.class_counts.size();
+	multiclass_solution current;
+	current.tp.assign(classes, 0);
+	current.predicted.assign(classes, 0);
+	std::map<std::vector<count_int>, multiclass_solution> solutions;
+	multiclass_oracle_rows(problem, 0, 0, problem.class_counts[0], current,
+			solutions);
+
+	found.clear();
+	std::map<std::vector<count_int>, multiclass_solution>::const_iterator it;
+	for (it = solutions.begin(); it != solutions.end(); ++it)
+		if (multiclass_oracle_matches(problem, it->second))
+			found.push_back(it->second);
+}
+
+/**
+ * multiclass_oracle_rows - add the diagonal and column sums of every matrix
+ * that completes some cells, keyed by their search order.
+ *
+ * Parameters
+ *   multiclass_problem - the class counts
+ *   int - the row of the next cell
+ *   int - the column of the next cell
+ *   count_int - the samples of the row left for it and the cells after it
+ *   multiclass_solution - the diagonal and column sums of the cells before
+ *   std::map - the solutions found, added to
+ */
+void multiclass_oracle_rows(const multiclass_problem & problem, int row,
+		int column, count_int left, multiclass_solution & current,
+		std::map<std::vector<count_int>, multiclass_solution> & solutions)
+{
+	int classes = (int)problem.class_counts.size();
+	if (row == classes)
+	{
+		std::vector<count_int> key;
+		for (int k = 0; k + 2 < classes; k++)
+		{
+			key.push_back(-current.tp[k]);
+			key.push_back(current.predicted[k]);
+		}
+		key.push_back(-current.tp[classes - 2]);
+		key.push_back(-current.tp[classes - 1]);
+		key.push_back(current.predicted[classes - 2]);
+		solutions[key] = current;
+		return;
+	}
+
+	count_int first = column == classes - 1 ? left : 0;
+	for (count_int cell = first; cell <= left; cell++)
+	{
+		current.predicted[column] += cell;
+		if (column == row)
+			current.tp[row] = cell;
+		if (column == classes - 1)
+			multiclass_oracle_rows(problem, row + 1, 0, row + 1 < classes ?
+					problem.class_counts[row + 1] : 0, current, solutions);
+		else
+			multiclass_oracle_rows(problem, row, column + 1, left - cell,
+					current, solutions);
+		current.predicted[column] -= cell;
+	}
+}
+
+/**
+ * multiclass_oracle_matches - whether a diagonal and column sums meet every
+ * target of a problem, each rounded half up from its exact value.
+ *
+ * Parameters
+ *   multiclass_problem - the problem
+ *   multiclass_solution - the diagonal and column sums
+ *
+ * Returns
+ *   bool - if every target is met
+ */
+bool multiclass_oracle_matches(const multiclass_problem & problem,
+		const multiclass_solution & solution)
+{
+	int classes = (int)problem.class_counts.size();
+	int dp = problem.decimal_places;
+	count_int total = 0, correct = 0;
+	std::vector<count_int> twice_tp(classes), f1_denominators(classes);
+	for (int k = 0; k < classes; k++)
+	{
+		total += problem.class_counts[k];
+		correct += solution.tp[k];
+		twice_tp[k] = 2 * solution.tp[k];
+		f1_denominators[k] = problem.class_counts[k] + solution.predicted[k];
+	}
+
+	oracle_value accuracy = {correct, total, false};
+	if (!oracle_meets(accuracy, problem.target_accuracy, dp) ||
+			!oracle_meets(oracle_mean(&solution.tp[0], &solution.predicted[0],
+					classes), problem.target_macro_precision, dp) ||
+			!oracle_meets(oracle_mean(&solution.tp[0], &problem.class_counts[0],
+					classes), problem.target_macro_recall, dp) ||
+			!oracle_meets(oracle_mean(&twice_tp[0], &f1_denominators[0],
+					classes), problem.target_macro_f1, dp))
+		return false;
+
+	for (int k = 0; k < classes; k++)
+	{
+		oracle_value precision = {solution.tp[k], solution.predicted[k], false};
+		oracle_value recall = {solution.tp[k], problem.class_counts[k], false};
+		oracle_value f1 = {twice_tp[k], f1_denominators[k], false};
+		if ((!problem.target_precision.empty() &&
+					!oracle_meets(precision, problem.target_precision[k], dp)) ||
+				(!problem.target_recall.empty() &&
+					!oracle_meets(recall, problem.target_recall[k], dp)) ||
+				(!problem.target_f1.empty() &&
+					!oracle_meets(f1, problem.target_f1[k], dp)))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * oracle_mean - the exact mean of some ratios, a ratio with a zero
+ * denominator counting as 0.
+ *
+ * Parameters
+ *   const count_int * - the numerators
+ *   const count_int * - the denominators
+ *   int - the number of ratios
+ *
+ * Returns
+ *   oracle_value - the mean
+ */
+oracle_value oracle_mean(const count_int * numerators,
+		const count_int * denominators, int count)
+{
+	oracle_value mean = {0, 1, false};
+	for (int i = 0; i < count; i++)
+		if (denominators[i] != 0)
+		{
+			mean.numerator = mean.numerator * denominators[i] +
+				numerators[i] * mean.denominator;
+			mean.denominator *= denominators[i];
+		}
+	mean.denominator *= count;
+	return mean;
+}
+
+/**
+ * oracle_meets - whether a metric rounds half up to a target.
+ *
+ * Parameters
+ *   oracle_value - the metric
+ *   double - the target, or -1 for none
+ *   int - the number of decimal places
+ *
+ * Returns
+ *   bool - if there is no target, or the metric is defined and rounds to it
+ */
+bool oracle_meets(const oracle_value & value, double target,
+		int decimal_places)
+{
+	target_range range = {target, target};
+	return target == -1 || oracle_in_range(value, range, decimal_places,
+			ROUND_HALF_UP);
+}
+
+/**
+ * same_solutions - whether two searches found the same solutions in the
+ * same order.
+ *
+ * Parameters
+ *   std::vector - the solutions of one search
+ *   std::vector - the solutions of the other
+ *
+ * Returns
+ *   bool - if they are identical
+ */
+bool same_solutions(const std::vector<multiclass_solution> & expected,
+		const std::vector<multiclass_solution> & found)
+{
+	if (expected.size() != found.size())
+		return false;
+	for (size_t s = 0; s < expected.size(); s++)
+		if (expected[s].tp != found[s].tp ||
+				expected[s].predicted != found[s].predicted)
+			return false;
+	return true;
+}
+
+/**
+ * verify_multiclass - search every multiclass query at each of
+ * VERIFY_MULTICLASS_THREADS and compare the solutions, in order, and their
+ * count without a callback with those of multiclass_oracle.
+ *
+ * Parameters
+ *   unsigned - the seed of the random queries
+ *   int - the number of random queries
+ *
+ * Returns
+ *   int - the number of mismatches
+ */
+int verify_multiclass(unsigned seed, int query_count)
+{
+	const int THREAD_COUNTS = (int)(sizeof(VERIFY_MULTICLASS_THREADS) /
+		sizeof(VERIFY_MULTICLASS_THREADS[0]));
+	std::vector<verify_multiclass_query> queries =
+		make_multiclass_queries(seed, query_count);
+	std::vector<verify_result> results(THREAD_COUNTS, verify_result());
+	double oracle_seconds = 0;
+	uint64_t oracle_matches = 0;
+
+	printf("verify multiclass, %zu queries\n", queries.size());
+	std::vector<multiclass_solution> expected, found;
+	for (size_t q = 0; q < queries.size(); q++)
+	{
+		const multiclass_problem & problem = queries[q].problem;
+		std::chrono::steady_clock::time_point start =
+			std::chrono::steady_clock::now();
+		multiclass_oracle(problem, expected);
+		oracle_seconds += seconds_since(start);
+		oracle_matches += expected.size();
+
+		for (int t = 0; t < THREAD_COUNTS; t++)
+		{
+			int threads = VERIFY_MULTICLASS_THREADS[t];
+			found.clear();
+			start = std::chrono::steady_clock::now();
+			uint64_t reported = search_multiclass(problem, threads,
+					[&found](const multiclass_solution & solution) {
+						found.push_back(solution);
+					});
+			results[t].seconds += seconds_since(start);
+			results[t].matches += found.size();
+			uint64_t counted = search_multiclass(problem, threads,
+					std::function<void(const multiclass_solution &)>());
+
+			if (same_solutions(expected, found) && reported == expected.size() &&
+					counted == expected.size())
+				continue;
+			results[t].mismatches++;
+			printf("MISMATCH multiclass %d thread%s %s: ", threads,
+					threads == 1 ? "" : "s", queries[q].kind);
+			print_multiclass_problem(problem);
+			printf(": expected %zu solutions, found %zu, returned %llu, "
+					"counted %llu\n", expected.size(), found.size(),
+					(unsigned long long)reported, (unsigned long long)counted);
+		}
+	}
+
+	printf("%-10s %12s %10s %10s\n", "threads", "solutions", "seconds",
+			"mismatches");
+	printf("%-10s %12llu %10.4f %10s\n", "oracle",
+			(unsigned long long)oracle_matches, oracle_seconds, "-");
+	int failed = 0;
+	for (int t = 0; t < THREAD_COUNTS; t++)
+	{
+		printf("%-10d %12llu %10.4f %10d\n", VERIFY_MULTICLASS_THREADS[t],
+				(unsigned long long)results[t].matches, results[t].seconds,
+				results[t].mismatches);
+		failed += results[t].mismatches;
+	}
+	return failed;
+}
+
+/**
+ * bench_verify - run every query through every engine and compare the
+ * matches, in order, with those of oracle_search.
+ *
+ * The rounded engine rounds doubles, so it may disagree on exact ties; its
+ * mismatches are reported but do not fail the run. Without a device, the
+ * GPU engine is run by verify_gpu_host, as gpu-host. Search sessions are
+ * then checked by verify_session, with a quarter as many sequences as
+ * random queries, and the multiclass search by verify_multiclass, with half
+ * as many random queries.
+ *
+ * Parameters
+ *   int - the number of worker threads
+ *   unsigned - the seed of the random queries
+ *   int - the number of random queries
+ *
+ * Returns
+ *   int - 0 if every exact engine and the multiclass search agreed with
+ *         the oracles, otherwise 1
+ */
+int bench_verify(int threads, unsigned seed, int query_count)
+{
+	const search_engine ENGINES[5] = {ENGINE_ROUNDED, ENGINE_SCALAR,
+		ENGINE_PRUNED, ENGINE_SIMD, ENGINE_GPU};
+	const char * ENGINE_NAMES[5] = {"rounded", "scalar", "pruned", "simd",
+		gpu_available() ? "gpu" : "gpu-host"};
+	int engine_count = 5;
+	std::vector<verify_query> queries = make_verify_queries(seed, query_count);
+	verify_result results[5] = {};
+	double oracle_seconds = 0;
+	uint64_t oracle_matches = 0;
+
+	printf("verify, %zu queries, seed %u, %d thread%s\n", queries.size(), seed,
+			threads, threads == 1 ? "" : "s");
+	std::vector<confusion_matrix> expected;
+	for (size_t q = 0; q < queries.size(); q++)
+	{
+		const verify_query & query = queries[q];
+		std::chrono::steady_clock::time_point start =
+			std::chrono::steady_clock::now();
+		oracle_search(query, expected);
+		oracle_seconds += seconds_since(start);
+		oracle_matches += expected.size();
+
+		for (int e = 0; e < engine_count; e++)
+		{
+			vector_sink sink;
+			start = std::chrono::steady_clock::now();
+			if (ENGINES[e] == ENGINE_GPU && !gpu_available())
+				verify_gpu_host(query, sink);
+			else
+				search_matrices(query.class_a_count, query.class_b_count,
+						query.decimal_places, verify_targets(query), ENGINES[e],
+						threads, sink);
+			results[e].seconds += seconds_since(start);
+			results[e].matches += sink.results().size();
+
+			size_t m = first_difference(expected, sink.results());
+			if (m == expected.size() && m == sink.results().size())
+				continue;
+			results[e].mismatches++;
+			printf("%s %s %s: ", ENGINES[e] == ENGINE_ROUNDED ? "differs" :
+					"MISMATCH", ENGINE_NAMES[e], query.kind);
+			print_verify_query(query);
+			printf(": expected %zu matches, found %zu, first difference at %zu\n",
+					expected.size(), sink.results().size(), m);
+		}
+	}
+
+	printf("%-8s %12s %10s %10s\n", "engine", "matches", "seconds",
+			"mismatches");
+	printf("%-8s %12llu %10.4f %10s\n", "oracle",
+			(unsigned long long)oracle_matches, oracle_seconds, "-");
+	int failed = 0, fastest = -1;
+	for (int e = 0; e < engine_count; e++)
+	{
+		printf("%-8s %12llu %10.4f %10d\n", ENGINE_NAMES[e],
+				(unsigned long long)results[e].matches, results[e].seconds,
+				results[e].mismatches);
+		if (ENGINES[e] == ENGINE_ROUNDED)
+			continue;
+		failed += results[e].mismatches;
+		bool timed = ENGINES[e] != ENGINE_GPU || gpu_available();
+		if (timed && results[e].mismatches == 0 && (fastest == -1 ||
+					results[e].seconds < results[fastest].seconds))
+			fastest = e;
+	}
+	if (fastest != -1)
+		printf("fastest exact engine: %s\n", ENGINE_NAMES[fastest]);
+
+	failed += verify_session(threads, seed, query_count / 4);
+	failed += verify_multiclass(seed, query_count / 2);
+	if (failed != 0)
+	{
+		printf("%d mismatches\n", failed);
+		return(1);
+	}
+	return(0);
+}
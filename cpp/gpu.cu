@@ -0,0 +1,201 @@
+/**
+ * CUDA source for the GPU engine, built into the library by make GPU=1.
+ *
+ * search_diagonals_gpu hands the device blocks of cells that are already cut
+ * down to the sensitivity and specificity bands. Each device thread checks
+ * cells of the block against the remaining integer bands, exactly as
+ * check_metric does in wide_int, and appends the index of every match to a
+ * device buffer through an atomic counter. Only the matches are copied back.
+ */
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <cstdlib>
+#include <cuda_runtime.h>
+#include "reverse_engineer.hpp"
+
+// Threads per block of check_block_kernel.
+const int GPU_THREADS = 256;
+
+// Most thread blocks check_block_kernel is launched with, each walking the
+// cells with a grid-sized stride.
+const int GPU_MAX_BLOCKS = 4096;
+
+void check_cuda(cudaError_t, const char *);
+
+/**
+ * device_ratio_in_band - the band test of ratio_in_band on the device.
+ *
+ * Parameters
+ *   count_int - the numerator of the ratio
+ *   count_int - the denominator of the ratio
+ *   metric_band - the integer band of the target
+ *   long long - twice the decimal scale
+ *
+ * Returns
+ *   bool - if the ratio is within the band
+ */
+__device__ bool device_ratio_in_band(
+		count_int numerator,
+		count_int denominator,
+		const metric_band & band,
+		long long twice_scale
+		)
+{
+	wide_int scaled = (wide_int)numerator * twice_scale;
+	long long upper_offset = denominator < band.upper_offset ? denominator :
+		band.upper_offset;
+	return (wide_int)band.lower * denominator + band.lower_offset <= scaled &&
+		scaled < (wide_int)band.upper * denominator + upper_offset;
+}
+
+/**
+ * check_block_kernel - check every cell of a block, appending the index of
+ * each match to hits.
+ *
+ * A thread finds the run holding its cell by a binary search of the run
+ * starts, which are in increasing order.
+ *
+ * Parameters
+ *   metric_targets - the integer bands of the targets
+ *   unsigned - the metric mask to check
+ *   count_int - count of items in class A
+ *   count_int - count of items in class B
+ *   gpu_run - the runs of the block
+ *   uint32_t - the number of runs
+ *   uint32_t - the number of cells in the block
+ *   uint32_t - set to the index of each match, in no particular order
+ *   unsigned - counts the matches
+ */
+__global__ void check_block_kernel(
+		metric_targets targets,
+		unsigned check_mask,
+		count_int class_a_count,
+		count_int class_b_count,
+		const gpu_run * runs,
+		uint32_t run_count,
+		uint32_t cells,
+		uint32_t * hits,
+		unsigned * hit_count
+		)
+{
+	uint32_t stride = gridDim.x * blockDim.x;
+	for (uint32_t cell = blockIdx.x * blockDim.x + threadIdx.x; cell < cells;
+			cell += stride)
+	{
+		uint32_t low = 0, high = run_count - 1;
+		while (low < high)
+		{
+			uint32_t middle = (low + high + 1) / 2;
+			if (runs[middle].first_cell <= cell)
+				low = middle;
+			else
+				high = middle - 1;
+		}
+
+		count_int TP = runs[low].max_tp - (cell - runs[low].first_cell);
+		count_int TN = runs[low].correct_preds - TP;
+		count_int FN = class_a_count - TP;
+		count_int FP = class_b_count - TN;
+		if ((check_mask & METRIC_SENSITIVITY) && !device_ratio_in_band(TP,
+					TP + FN, targets.sensitivity, targets.twice_scale))
+			continue;
+		if ((check_mask & METRIC_SPECIFICITY) && !device_ratio_in_band(TN,
+					TN + FP, targets.specificity, targets.twice_scale))
+			continue;
+		if ((check_mask & METRIC_PRECISION) && !device_ratio_in_band(TP,
+					TP + FP, targets.precision, targets.twice_scale))
+			continue;
+		if ((check_mask & METRIC_F1) && !device_ratio_in_band(2 * TP,
+					2 * TP + FP + FN, targets.f1, targets.twice_scale))
+			continue;
+		hits[atomicAdd(hit_count, 1u)] = cell;
+	}
+}
+
+/**
+ * gpu_available - whether the GPU engine can run.
+ *
+ * Returns
+ *   bool - if a CUDA device is present
+ */
+bool gpu_available()
+{
+	int devices = 0;
+	return cudaGetDeviceCount(&devices) == cudaSuccess && devices > 0;
+}
+
+/**
+ * gpu_check_block - check a block of cells for search_diagonals_gpu on the
+ * device.
+ *
+ * Every cell can match, so the hit buffer holds one index per cell and the
+ * atomic counter never overruns it.
+ *
+ * Parameters
+ *   metric_targets - the integer bands of the targets
+ *   unsigned - the metric mask to check
+ *   count_int - count of items in class A
+ *   count_int - count of items in class B
+ *   std::vector - the runs of the block, in search order
+ *   uint32_t - the number of cells in the block
+ *   std::vector - set to the index within the block of every match
+ */
+void gpu_check_block(
+		const metric_targets & targets,
+		unsigned check_mask,
+		count_int class_a_count,
+		count_int class_b_count,
+		const std::vector<gpu_run> & runs,
+		uint32_t cells,
+		std::vector<uint32_t> & hits
+		)
+{
+	gpu_run * device_runs = NULL;
+	uint32_t * device_hits = NULL;
+	unsigned * device_count = NULL;
+	check_cuda(cudaMalloc(&device_runs, runs.size() * sizeof(gpu_run)),
+			"cudaMalloc");
+	check_cuda(cudaMalloc(&device_hits, cells * sizeof(uint32_t)),
+			"cudaMalloc");
+	check_cuda(cudaMalloc(&device_count, sizeof(unsigned)), "cudaMalloc");
+	check_cuda(cudaMemcpy(device_runs, runs.data(),
+				runs.size() * sizeof(gpu_run), cudaMemcpyHostToDevice), "cudaMemcpy");
+	check_cuda(cudaMemset(device_count, 0, sizeof(unsigned)), "cudaMemset");
+
+	int blocks = (int)std::min((cells + GPU_THREADS - 1) / GPU_THREADS,
+			(uint32_t)GPU_MAX_BLOCKS);
+	check_block_kernel<<<blocks, GPU_THREADS>>>(targets, check_mask,
+			class_a_count, class_b_count, device_runs, (uint32_t)runs.size(),
+			cells, device_hits, device_count);
+	check_cuda(cudaGetLastError(), "check_block_kernel");
+
+	unsigned hit_count = 0;
+	check_cuda(cudaMemcpy(&hit_count, device_count, sizeof(unsigned),
+				cudaMemcpyDeviceToHost), "cudaMemcpy");
+	hits.resize(hit_count);
+	if (hit_count != 0)
+		check_cuda(cudaMemcpy(hits.data(), device_hits,
+					hit_count * sizeof(uint32_t), cudaMemcpyDeviceToHost), "cudaMemcpy");
+
+	cudaFree(device_count);
+	cudaFree(device_hits);
+	cudaFree(device_runs);
+}
+
+/**
+ * check_cuda - exit with a message if a CUDA call failed.
+ *
+ * Parameters
+ *   cudaError_t - the result of the call
+ *   const char * - the name of the call
+ */
+void check_cuda(cudaError_t result, const char * call)
+{
+	if (result != cudaSuccess)
+	{
+		std::cerr << call << " failed: " << cudaGetErrorString(result)
+			<< std::endl;
+		exit(1);
+	}
+}
@@ -0,0 +1,848 @@
+/**
+ * Command line front end to reverse engineer all possible matrices from
+ * output metrics.
+ *
+ * The class counts, decimal places and targets default to the modifiers
+ * in the main method, and are set at runtime by the options or a config
+ * file. To exclude an optional target, set it to -1.
+ *
+ */
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <algorithm>
+#include <thread>
+#include <deque>
+#include "reverse_engineer.hpp"
+
+bool read_count(const char *, long long &);
+bool read_number(const char *, double &);
+bool read_count_list(const char *, std::vector<count_int> &);
+bool read_number_list(const char *, std::vector<double> &);
+bool read_config(const char *, std::deque<std::string> &,
+		std::vector<const char *> &);
+
+// Options that take a value, for the error when it is missing.
+const char * const VALUE_OPTIONS[] = {"--config", "--class-a", "--class-b",
+	"--dp", "--accuracy", "--sensitivity", "--specificity", "--f1",
+	"--precision", "--engine", "--threads", "--format", "--output", "--decode",
+	"--batch", "--build-index", "--index", "--serve", "--workers", "--total",
+	"--limit", "--range", "--rounding", "--classes", "--macro-precision",
+	"--macro-recall", "--macro-f1", "--class-precision", "--class-recall",
+	"--class-f1"};
+const int VALUE_OPTION_COUNT = sizeof(VALUE_OPTIONS) / sizeof(VALUE_OPTIONS[0]);
+
+/**
+ * Main method
+ *
+ * The modifiers are the defaults of the options below, so they only need
+ * adjusting to change what a plain ./reverse_engineer searches.
+ *
+ * Options
+ *   --class-a N - count of items in class A
+ *   --class-b N - count of items in class B
+ *   --dp N - decimal places the targets are rounded to, 0 to 18
+ *   --accuracy X - the target accuracy
+ *   --sensitivity X, --specificity X, --f1 X, --precision X - the optional
+ *                                                            targets, -1 to
+ *                                                            leave one out
+ *   --config PATH - read options from a file, one per line as NAME VALUE or
+ *                   NAME = VALUE, NAME without its dashes; blank lines and
+ *                   lines starting with # are skipped. Later options win.
+ *   --engine NAME - search strategy: rounded, scalar, pruned, simd (default)
+ *                   or gpu
+ *   --threads N - number of worker threads, 0 uses every core (default)
+ *   --format F - output file format: csv (default), binary, varint or runs
+ *   --output PATH - output file path
+ *   --decode PATH - print a binary output file as csv and exit
+ *   --batch PATH - solve every query in a batch file, or stdin for -,
+ *                  instead of the modifiers
+ *   --build-index PATH - write an index of every matrix of the modifiers'
+ *                        class counts and decimal places, and exit
+ *   --index PATH - answer the modifiers' targets from an index instead of
+ *                  searching
+ *   --serve ADDRESS - answer JSON queries on a TCP port, host:port or
+ *                     unix:PATH until killed
+ *   --count - print the number of matches instead of writing them
+ *   --exists - print whether any matrix matches, stopping at the first
+ *   --limit K - stop after the first K matches
+ *   --stats - print search counters and phase timings to stderr, needs a
+ *             build with SEARCH_STATS
+ *   --stats-json - as --stats, as one JSON object
+ *   --total N - search every split of N samples into the two classes,
+ *               instead of the modifiers' class counts
+ *   --multiclass - search the multiclass modifiers instead, writing each
+ *                  class's true positives and predicted count. --dp,
+ *                  --accuracy, --threads, --count and --output apply, and
+ *                  the options only for binary searches are rejected.
+ *   --classes N,N,... - the size of each class of a multiclass search
+ *   --macro-precision X, --macro-recall X, --macro-f1 X - the macro targets
+ *                                                        of a multiclass
+ *                                                        search, -1 to
+ *                                                        leave one out
+ *   --class-precision X,X,..., --class-recall X,X,..., --class-f1 X,X,...
+ *       - one per-class target for each class of a multiclass search, -1
+ *         to leave a class out
+ *   --range METRIC=LOW:HIGH - accept any rounded value from LOW to HIGH, or
+ *                             one VALUE, for accuracy, sensitivity,
+ *                             specificity, f1 or precision instead of its
+ *                             modifier, or for a registry metric: npv,
+ *                             balanced-accuracy, jaccard, youden or mcc
+ *   --rounding MODES - comma separated rounding modes any of which may have
+ *                      produced the targets: half-up (default), half-even,
+ *                      half-down, down or up
+ */
+int main(int argc, char ** argv){
+	////////////// MODIFIERS//////////////
+	// Defaults of --dp, --class-a, --class-b and --accuracy.
+	const int DECIMAL_PLACES = 2;
+	const count_int CLASS_A_COUNT = 981;
+	const count_int CLASS_B_COUNT = 981;
+	const double TARGET_ACCURACY = 0.75;
+
+	// Optional modifiers - set to -1 if not needed. Defaults of
+	// --sensitivity, --specificity, --f1 and --precision.
+	const double TARGET_SENSITIVITY = 0.86;
+	const double TARGET_SPECIFICITY = 0.64;
+	const double TARGET_F1 = 0.77;
+	const double TARGET_PRECISION = 0.71;
+
+	// Search strategy - ENGINE_ROUNDED, ENGINE_SCALAR, ENGINE_PRUNED,
+	// ENGINE_SIMD or ENGINE_GPU. --engine overrides it.
+	const search_engine ENGINE = ENGINE_SIMD;
+
+	// Multiclass modifiers, used with --multiclass. The per-class targets
+	// are either empty or hold one target per class, -1 if not needed.
+	// Defaults of --classes, the macro and per-class target options, and of
+	// --dp and --accuracy for a multiclass search.
+	multiclass_problem MULTICLASS;
+	MULTICLASS.class_counts = {50, 30, 20};
+	MULTICLASS.decimal_places = 2;
+	MULTICLASS.target_accuracy = 0.77;
+	MULTICLASS.target_macro_precision = 0.75;
+	MULTICLASS.target_macro_recall = 0.76;
+	MULTICLASS.target_macro_f1 = 0.75;
+	MULTICLASS.target_precision = {};
+	MULTICLASS.target_recall = {};
+	MULTICLASS.target_f1 = {};
+	//////////////////////////////////////
+
+	int threads = 0;
+	output_format format = FORMAT_CSV;
+	const char * output_path = NULL;
+	const char * batch_path = NULL;
+	const char * build_index_path = NULL;
+	const char * index_path = NULL;
+	const char * serve_address = NULL;
+	const char * worker_list = NULL;
+	bool count_only = false;
+	bool exists_only = false;
+	long long match_limit = 0;
+	bool print_stats = false;
+	bool stats_json = false;
+	bool multiclass = false;
+	count_int total_count = 0;
+	search_engine engine = ENGINE;
+	long long class_a_count = CLASS_A_COUNT;
+	long long class_b_count = CLASS_B_COUNT;
+	long long decimal_places = DECIMAL_PLACES;
+	target_ranges ranges = exact_targets(TARGET_ACCURACY, TARGET_SENSITIVITY,
+			TARGET_SPECIFICITY, TARGET_F1, TARGET_PRECISION);
+	multiclass_problem problem = MULTICLASS;
+	bool dp_given = false;
+	bool accuracy_given = false;
+
+	// The last option seen that only applies to binary searches, or only to
+	// multiclass ones, for the error when the other kind is searched.
+	const char * binary_option = NULL;
+	const char * multiclass_option = NULL;
+
+	// Options read from config files are spliced in after the --config that
+	// names them, and kept alive in config_text.
+	std::deque<std::string> config_text;
+	std::vector<const char *> args(argv, argv + argc);
+	for (int i = 1; i < (int)args.size(); i++)
+	{
+		int arg_count = (int)args.size();
+		if (strcmp(args[i], "--config") == 0 && i + 1 < arg_count)
+		{
+			std::vector<const char *> options;
+			if (!read_config(args[i + 1], config_text, options))
+				return(1);
+			args.insert(args.begin() + i + 2, options.begin(), options.end());
+			i++;
+		}
+		else if (strcmp(args[i], "--class-a") == 0 && i + 1 < arg_count)
+		{
+			binary_option = args[i];
+			if (!read_count(args[++i], class_a_count))
+			{
+				std::cerr << "--class-a takes a count: " << args[i] << std::endl;
+				return(1);
+			}
+		}
+		else if (strcmp(args[i], "--class-b") == 0 && i + 1 < arg_count)
+		{
+			binary_option = args[i];
+			if (!read_count(args[++i], class_b_count))
+			{
+				std::cerr << "--class-b takes a count: " << args[i] << std::endl;
+				return(1);
+			}
+		}
+		else if (strcmp(args[i], "--dp") == 0 && i + 1 < arg_count)
+		{
+			if (!read_count(args[++i], decimal_places))
+			{
+				std::cerr << "--dp takes a count: " << args[i] << std::endl;
+				return(1);
+			}
+			dp_given = true;
+		}
+		else if ((strcmp(args[i], "--accuracy") == 0 ||
+					strcmp(args[i], "--sensitivity") == 0 ||
+					strcmp(args[i], "--specificity") == 0 ||
+					strcmp(args[i], "--f1") == 0 ||
+					strcmp(args[i], "--precision") == 0) && i + 1 < arg_count)
+		{
+			target_range * targets[5] = {&ranges.accuracy, &ranges.sensitivity,
+				&ranges.specificity, &ranges.f1, &ranges.precision};
+			const char * names[5] = {"--accuracy", "--sensitivity",
+				"--specificity", "--f1", "--precision"};
+			int metric = 0;
+			while (strcmp(args[i], names[metric]) != 0)
+				metric++;
+			double value;
+			if (!read_number(args[i + 1], value))
+			{
+				std::cerr << names[metric] << " takes a number: " << args[i + 1]
+					<< std::endl;
+				return(1);
+			}
+			target_range range = {value, value};
+			*targets[metric] = range;
+			if (metric == 0)
+				accuracy_given = true;
+			else
+				binary_option = names[metric];
+			i++;
+		}
+		else if ((strcmp(args[i], "--macro-precision") == 0 ||
+					strcmp(args[i], "--macro-recall") == 0 ||
+					strcmp(args[i], "--macro-f1") == 0) && i + 1 < arg_count)
+		{
+			double * targets[3] = {&problem.target_macro_precision,
+				&problem.target_macro_recall, &problem.target_macro_f1};
+			const char * names[3] = {"--macro-precision", "--macro-recall",
+				"--macro-f1"};
+			int metric = 0;
+			while (strcmp(args[i], names[metric]) != 0)
+				metric++;
+			double value;
+			if (!read_number(args[i + 1], value) ||
+					!((value >= 0 && value <= 1) || value == -1))
+			{
+				std::cerr << names[metric] << " must be from 0 to 1, or -1 to "
+					"leave it out: " << args[i + 1] << std::endl;
+				return(1);
+			}
+			*targets[metric] = value;
+			multiclass_option = names[metric];
+			i++;
+		}
+		else if ((strcmp(args[i], "--class-precision") == 0 ||
+					strcmp(args[i], "--class-recall") == 0 ||
+					strcmp(args[i], "--class-f1") == 0) && i + 1 < arg_count)
+		{
+			std::vector<double> * targets[3] = {&problem.target_precision,
+				&problem.target_recall, &problem.target_f1};
+			const char * names[3] = {"--class-precision", "--class-recall",
+				"--class-f1"};
+			int metric = 0;
+			while (strcmp(args[i], names[metric]) != 0)
+				metric++;
+			std::vector<double> values;
+			bool valid = read_number_list(args[i + 1], values);
+			for (size_t k = 0; valid && k < values.size(); k++)
+				valid = (values[k] >= 0 && values[k] <= 1) || values[k] == -1;
+			if (!valid)
+			{
+				std::cerr << names[metric] << " takes a comma separated target "
+					"for each class, from 0 to 1 or -1: " << args[i + 1]
+					<< std::endl;
+				return(1);
+			}
+			*targets[metric] = values;
+			multiclass_option = names[metric];
+			i++;
+		}
+		else if (strcmp(args[i], "--classes") == 0 && i + 1 < arg_count)
+		{
+			std::vector<count_int> counts;
+			bool valid = read_count_list(args[++i], counts) && counts.size() >= 2;
+			for (size_t k = 0; valid && k < counts.size(); k++)
+				valid = counts[k] >= 1;
+			if (!valid)
+			{
+				std::cerr << "--classes takes two or more comma separated class "
+					"sizes of at least 1: " << args[i] << std::endl;
+				return(1);
+			}
+			problem.class_counts = counts;
+			multiclass_option = "--classes";
+		}
+		else if (strcmp(args[i], "--threads") == 0 && i + 1 < arg_count)
+		{
+			long long count;
+			if (!read_count(args[++i], count) || count > INT_MAX)
+			{
+				std::cerr << "--threads takes a count: " << args[i] << std::endl;
+				return(1);
+			}
+			threads = (int)count;
+		}
+		else if (strcmp(args[i], "--engine") == 0 && i + 1 < arg_count)
+		{
+			binary_option = args[i];
+			const char * names[5] = {"rounded", "scalar", "pruned", "simd", "gpu"};
+			const char * name = args[++i];
+			int index = 0;
+			while (index < 5 && strcmp(name, names[index]) != 0)
+				index++;
+			if (index == 5)
+			{
+				std::cerr << "Unknown engine: " << name << std::endl;
+				return(1);
+			}
+			engine = (search_engine)index;
+		}
+		else if (strcmp(args[i], "--format") == 0 && i + 1 < arg_count)
+		{
+			const char * name = args[++i];
+			if (strcmp(name, "csv") == 0)
+				format = FORMAT_CSV;
+			else if (strcmp(name, "binary") == 0)
+				format = FORMAT_BINARY;
+			else if (strcmp(name, "varint") == 0)
+				format = FORMAT_VARINT;
+			else if (strcmp(name, "runs") == 0)
+				format = FORMAT_RUNS;
+			else
+			{
+				std::cerr << "Unknown format: " << name << std::endl;
+				return(1);
+			}
+		}
+		else if (strcmp(args[i], "--output") == 0 && i + 1 < arg_count)
+		{
+			output_path = args[++i];
+		}
+		else if (strcmp(args[i], "--decode") == 0 && i + 1 < arg_count)
+		{
+			return decode_binary_output(args[++i]);
+		}
+		else if (strcmp(args[i], "--batch") == 0 && i + 1 < arg_count)
+		{
+			binary_option = args[i];
+			batch_path = args[++i];
+		}
+		else if (strcmp(args[i], "--build-index") == 0 && i + 1 < arg_count)
+		{
+			binary_option = args[i];
+			build_index_path = args[++i];
+		}
+		else if (strcmp(args[i], "--index") == 0 && i + 1 < arg_count)
+		{
+			binary_option = args[i];
+			index_path = args[++i];
+		}
+		else if (strcmp(args[i], "--serve") == 0 && i + 1 < arg_count)
+		{
+			binary_option = args[i];
+			serve_address = args[++i];
+		}
+		else if (strcmp(args[i], "--workers") == 0 && i + 1 < arg_count)
+		{
+			binary_option = args[i];
+			worker_list = args[++i];
+		}
+		else if (strcmp(args[i], "--stats") == 0)
+		{
+			binary_option = args[i];
+			print_stats = true;
+		}
+		else if (strcmp(args[i], "--stats-json") == 0)
+		{
+			binary_option = args[i];
+			print_stats = true;
+			stats_json = true;
+		}
+		else if (strcmp(args[i], "--total") == 0 && i + 1 < arg_count)
+		{
+			binary_option = args[i];
+			if (!read_count(args[++i], total_count) || total_count < 2)
+			{
+				std::cerr << "--total must be at least 2." << std::endl;
+				return(1);
+			}
+		}
+		else if (strcmp(args[i], "--multiclass") == 0)
+		{
+			multiclass = true;
+		}
+		else if (strcmp(args[i], "--count") == 0)
+		{
+			count_only = true;
+		}
+		else if (strcmp(args[i], "--exists") == 0)
+		{
+			exists_only = true;
+		}
+		else if (strcmp(args[i], "--limit") == 0 && i + 1 < arg_count)
+		{
+			if (!read_count(args[++i], match_limit) || match_limit < 1)
+			{
+				std::cerr << "--limit must be at least 1." << std::endl;
+				return(1);
+			}
+		}
+		else if (strcmp(args[i], "--range") == 0 && i + 1 < arg_count)
+		{
+			binary_option = args[i];
+			std::string text = args[++i];
+			const char * names[5] = {"accuracy", "sensitivity", "specificity",
+				"f1", "precision"};
+			target_range * targets[5] = {&ranges.accuracy, &ranges.sensitivity,
+				&ranges.specificity, &ranges.f1, &ranges.precision};
+			size_t equals = text.find('=');
+			std::string name = text.substr(0, equals);
+			int metric = 0;
+			while (metric < 5 && name != names[metric])
+				metric++;
+			int extra = metric == 5 ? find_extra_metric(name.c_str()) : -1;
+			double minimum = extra != -1 ? EXTRA_METRICS[extra].minimum : 0;
+
+			// Either one value or LOW:HIGH.
+			const char * value = equals != std::string::npos ?
+				text.c_str() + equals + 1 : "";
+			char * end = NULL;
+			double low = strtod(value, &end);
+			double high = low;
+			bool parsed = end != value;
+			if (parsed && *end == ':')
+			{
+				const char * rest = end + 1;
+				high = strtod(rest, &end);
+				parsed = end != rest;
+			}
+			if ((metric == 5 && extra == -1) || !parsed || *end != '\0' ||
+					low < minimum || low > high || high > 1)
+			{
+				std::cerr << "--range takes METRIC=VALUE or METRIC=LOW:HIGH within "
+					"the metric's values: " << text << std::endl;
+				return(1);
+			}
+			target_range range = {low, high};
+			if (extra != -1)
+			{
+				ranges.extra[extra] = range;
+				ranges.extra_mask |= 1u << extra;
+			}
+			else
+				*targets[metric] = range;
+		}
+		else if (strcmp(args[i], "--rounding") == 0 && i + 1 < arg_count)
+		{
+			binary_option = args[i];
+			const char * names[5] = {"half-up", "half-even", "half-down", "down",
+				"up"};
+			std::string list = args[++i];
+			ranges.rounding = 0;
+			size_t start = 0;
+			while (start <= list.size())
+			{
+				size_t comma = std::min(list.find(',', start), list.size());
+				std::string name = list.substr(start, comma - start);
+				int mode = 0;
+				while (mode < 5 && name != names[mode])
+					mode++;
+				if (mode == 5)
+				{
+					std::cerr << "Unknown rounding mode: " << name << std::endl;
+					return(1);
+				}
+				ranges.rounding |= 1u << mode;
+				start = comma + 1;
+			}
+		}
+		else
+		{
+			bool takes_value = false;
+			for (int o = 0; o < VALUE_OPTION_COUNT; o++)
+				takes_value = takes_value || strcmp(args[i], VALUE_OPTIONS[o]) == 0;
+			std::cerr << (takes_value ? "Missing value for option: " :
+					"Unknown option: ") << args[i] << std::endl;
+			return(1);
+		}
+	}
+	if (threads < 0)
+	{
+		std::cerr << "--threads must not be negative." << std::endl;
+		return(1);
+	}
+
+	// The options, the modifiers or both may be out of range.
+	if (class_a_count < 1 || class_b_count < 1)
+	{
+		std::cerr << "--class-a and --class-b must be at least 1." << std::endl;
+		return(1);
+	}
+	if (decimal_places < 0 || decimal_places > 18)
+	{
+		std::cerr << "--dp must be from 0 to 18." << std::endl;
+		return(1);
+	}
+	if (ranges.accuracy.low < 0 || ranges.accuracy.high > 1 ||
+			ranges.accuracy.low > ranges.accuracy.high)
+	{
+		std::cerr << "--accuracy must be from 0 to 1." << std::endl;
+		return(1);
+	}
+	const target_range * optional[4] = {&ranges.sensitivity,
+		&ranges.specificity, &ranges.f1, &ranges.precision};
+	const char * optional_names[4] = {"--sensitivity", "--specificity", "--f1",
+		"--precision"};
+	for (int t = 0; t < 4; t++)
+	{
+		const target_range & range = *optional[t];
+		bool disabled = range.low == -1 && range.high == -1;
+		if (!disabled && !(range.low >= 0 && range.low <= range.high &&
+					range.high <= 1))
+		{
+			std::cerr << optional_names[t] << " must be from 0 to 1, or -1 to "
+				"leave it out." << std::endl;
+			return(1);
+		}
+	}
+	// Searches other than the modifiers' single search take exact targets.
+	const double target_accuracy = ranges.accuracy.low;
+	const double target_sensitivity = ranges.sensitivity.low;
+	const double target_specificity = ranges.specificity.low;
+	const double target_f1 = ranges.f1.low;
+	const double target_precision = ranges.precision.low;
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	if (engine == ENGINE_GPU && !gpu_available())
+		std::cerr << "No GPU engine in this build or no CUDA device, searching "
+			"with the SIMD engine." << std::endl;
+	if (print_stats && !search_stats_enabled())
+	{
+		std::cerr << "--stats needs a build with SEARCH_STATS, such as "
+			"make STATS=1." << std::endl;
+		return(1);
+	}
+	if (!multiclass && multiclass_option != NULL)
+	{
+		std::cerr << multiclass_option << " only applies to --multiclass."
+			<< std::endl;
+		return(1);
+	}
+	if (multiclass)
+	{
+		if (format != FORMAT_CSV || exists_only || match_limit != 0)
+		{
+			std::cerr << "--multiclass only writes csv output or counts."
+				<< std::endl;
+			return(1);
+		}
+		if (binary_option != NULL)
+		{
+			std::cerr << binary_option << " does not apply to --multiclass."
+				<< std::endl;
+			return(1);
+		}
+		if (dp_given)
+			problem.decimal_places = (int)decimal_places;
+		if (accuracy_given)
+			problem.target_accuracy = target_accuracy;
+		const std::vector<double> * per_class[3] = {&problem.target_precision,
+			&problem.target_recall, &problem.target_f1};
+		const char * per_class_names[3] = {"--class-precision",
+			"--class-recall", "--class-f1"};
+		for (int t = 0; t < 3; t++)
+			if (!per_class[t]->empty() &&
+					per_class[t]->size() != problem.class_counts.size())
+			{
+				std::cerr << per_class_names[t] << " needs a target for each of "
+					"the " << problem.class_counts.size() << " classes."
+					<< std::endl;
+				return(1);
+			}
+		return run_multiclass(problem, threads, count_only,
+				output_path != NULL ? output_path :
+				"../data/cpp_multiclass_output.csv");
+	}
+	if (output_path == NULL)
+		output_path = format == FORMAT_CSV ? "../data/cpp_output.csv" :
+			"../data/cpp_output.bin";
+
+	// Ranges only apply to a single search of the modifiers' class counts.
+	if (!exact_ranges(ranges) && (total_count != 0 || serve_address != NULL ||
+			batch_path != NULL || worker_list != NULL ||
+			build_index_path != NULL || index_path != NULL ||
+			(format != FORMAT_CSV && !count_only && !exists_only)))
+	{
+		std::cerr << "--range and --rounding only search the modifiers' class "
+			"counts into csv output or counts." << std::endl;
+		return(1);
+	}
+
+	if (worker_list != NULL)
+	{
+		if (total_count != 0 || serve_address != NULL ||
+				build_index_path != NULL || index_path != NULL || count_only ||
+				exists_only || match_limit != 0)
+		{
+			std::cerr << "--workers only searches a batch or the modifiers into "
+				"an output file." << std::endl;
+			return(1);
+		}
+		std::vector<batch_query> queries;
+		if (batch_path != NULL)
+		{
+			if (!read_batch_file(batch_path, queries))
+				return(1);
+		}
+		else
+		{
+			batch_query modifiers = {0, class_a_count, class_b_count,
+				(int)decimal_places, target_accuracy, target_sensitivity,
+				target_specificity, target_f1, target_precision};
+			queries.push_back(modifiers);
+		}
+		return run_sharded(worker_list, queries, batch_path != NULL, engine,
+				format, output_path);
+	}
+
+	if (total_count != 0)
+	{
+		if (format != FORMAT_CSV || exists_only || match_limit != 0)
+		{
+			std::cerr << "--total only writes csv output or counts." << std::endl;
+			return(1);
+		}
+		if (count_only)
+		{
+			counter_sink counter;
+			search_class_splits(total_count, decimal_places, target_accuracy,
+					target_sensitivity, target_specificity, target_f1,
+					target_precision, engine, threads, counter);
+			std::cout << counter.count() << std::endl;
+		}
+		else
+		{
+			reverse_engineer_class_splits(total_count, decimal_places,
+					target_accuracy, target_sensitivity, target_specificity,
+					target_f1, target_precision, engine, threads, output_path);
+		}
+		if (print_stats)
+			print_search_stats(read_search_stats(), stats_json, stderr);
+		return(0);
+	}
+	if (serve_address != NULL)
+	{
+		query_server server(engine, threads);
+		return server.serve(serve_address);
+	}
+	if (batch_path != NULL)
+		return run_batch(batch_path, engine, threads, format, output_path);
+	if (build_index_path != NULL)
+		return build_index(class_a_count, class_b_count, decimal_places, threads,
+				build_index_path);
+	if (index_path != NULL)
+		return lookup_index(index_path, class_a_count, class_b_count,
+				decimal_places, target_accuracy, target_sensitivity,
+				target_specificity, target_f1, target_precision, format,
+				output_path);
+
+	// Count or existence checks skip the output file entirely.
+	if (count_only || exists_only)
+	{
+		counter_sink counter;
+		search_matrices(class_a_count, class_b_count, decimal_places, ranges,
+				engine, threads, counter, exists_only ? 1 : (uint64_t)match_limit);
+		if (exists_only)
+			std::cout << (counter.count() != 0 ? "true" : "false") << std::endl;
+		else
+			std::cout << counter.count() << std::endl;
+		if (print_stats)
+			print_search_stats(read_search_stats(), stats_json, stderr);
+		return(0);
+	}
+
+	// Trigger main workload
+	reverse_engineer_confusion_matrices(
+			class_a_count,
+			class_b_count,
+			decimal_places,
+			ranges,
+			engine,
+			threads,
+			format,
+			output_path,
+			(uint64_t)match_limit);
+
+	if (print_stats)
+		print_search_stats(read_search_stats(), stats_json, stderr);
+	return(0);
+}
+
+/**
+ * read_count - parse a whole number option value.
+ *
+ * Parameters
+ *   const char * - the text of the value
+ *   long long - set to the number
+ *
+ * Returns
+ *   bool - if the whole text is a number that fits a long long
+ */
+bool read_count(const char * text, long long & value)
+{
+	char * end = NULL;
+	errno = 0;
+	value = strtoll(text, &end, 10);
+	return end != text && *end == '\0' && errno == 0;
+}
+
+/**
+ * read_number - parse a decimal option value.
+ *
+ * Parameters
+ *   const char * - the text of the value
+ *   double - set to the number
+ *
+ * Returns
+ *   bool - if the whole text is a finite number
+ */
+bool read_number(const char * text, double & value)
+{
+	char * end = NULL;
+	value = strtod(text, &end);
+	return end != text && *end == '\0' && std::isfinite(value);
+}
+
+/**
+ * read_count_list - parse a comma separated list of whole numbers.
+ *
+ * Parameters
+ *   const char * - the text of the value
+ *   std::vector - set to the numbers, in order
+ *
+ * Returns
+ *   bool - if every item is a number that fits a long long
+ */
+bool read_count_list(const char * text, std::vector<count_int> & values)
+{
+	std::string list = text;
+	values.clear();
+	size_t start = 0;
+	while (start <= list.size())
+	{
+		size_t comma = std::min(list.find(',', start), list.size());
+		long long value;
+		if (!read_count(list.substr(start, comma - start).c_str(), value))
+			return false;
+		values.push_back(value);
+		start = comma + 1;
+	}
+	return true;
+}
+
+/**
+ * read_number_list - parse a comma separated list of decimals.
+ *
+ * Parameters
+ *   const char * - the text of the value
+ *   std::vector - set to the numbers, in order
+ *
+ * Returns
+ *   bool - if every item is a finite number
+ */
+bool read_number_list(const char * text, std::vector<double> & values)
+{
+	std::string list = text;
+	values.clear();
+	size_t start = 0;
+	while (start <= list.size())
+	{
+		size_t comma = std::min(list.find(',', start), list.size());
+		double value;
+		if (!read_number(list.substr(start, comma - start).c_str(), value))
+			return false;
+		values.push_back(value);
+		start = comma + 1;
+	}
+	return true;
+}
+
+/**
+ * read_config - read the options of a config file.
+ *
+ * Each line holds one option, as NAME, NAME VALUE or NAME = VALUE, where
+ * NAME is the option without its leading dashes and VALUE runs to the end
+ * of the line. Blank lines and lines starting with # are skipped.
+ *
+ * Parameters
+ *   const char * - the path of the config file
+ *   std::deque - the text of the options is added here, and must outlive
+ *                them
+ *   std::vector - set to the options, as command line arguments
+ *
+ * Returns
+ *   bool - false, after printing why, if the file cannot be read or sets
+ *          --config itself
+ */
+bool read_config(const char * path, std::deque<std::string> & text,
+		std::vector<const char *> & options)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		std::cerr << "Failed to open the config file: " << path << std::endl;
+		return false;
+	}
+
+	std::string line;
+	for (int number = 1; std::getline(file, line); number++)
+	{
+		size_t start = line.find_first_not_of(" \t\r");
+		if (start == std::string::npos || line[start] == '#')
+			continue;
+		size_t name_end = std::min(line.find_first_of(" \t\r=", start),
+				line.size());
+		std::string name = "--" + line.substr(start, name_end - start);
+		if (name == "--config")
+		{
+			std::cerr << path << " line " << number << ": config files cannot "
+				"include others." << std::endl;
+			return false;
+		}
+		text.push_back(name);
+		options.push_back(text.back().c_str());
+
+		size_t value_start = line.find_first_not_of(" \t\r", name_end);
+		if (value_start != std::string::npos && line[value_start] == '=')
+			value_start = line.find_first_not_of(" \t\r", value_start + 1);
+		if (value_start == std::string::npos)
+			continue;
+		size_t value_end = line.find_last_not_of(" \t\r") + 1;
+		text.push_back(line.substr(value_start, value_end - value_start));
+		options.push_back(text.back().c_str());
+	}
+	return true;
+}
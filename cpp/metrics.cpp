@@ -0,0 +1,421 @@
+/**
+ * CPP file holding the metric registry, the metrics beyond sensitivity,
+ * specificity, f1 and precision that a search can also be narrowed by.
+ *
+ * Every registry metric is tested exactly against the same integer bands as
+ * check_metric. The ratio metrics are linear in TP along an accuracy
+ * diagonal, in both numerator and denominator, so their bands cut each
+ * diagonal down to one range of TP in closed form. Adding a metric only
+ * takes an extra_metric entry and its row in EXTRA_METRICS.
+ */
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include "reverse_engineer.hpp"
+
+bool check_npv(count_int, count_int, count_int, count_int,
+		const metric_band &, long long);
+bool check_balanced_accuracy(count_int, count_int, count_int, count_int,
+		const metric_band &, long long);
+bool check_jaccard(count_int, count_int, count_int, count_int,
+		const metric_band &, long long);
+bool check_youden(count_int, count_int, count_int, count_int,
+		const metric_band &, long long);
+bool check_mcc(count_int, count_int, count_int, count_int,
+		const metric_band &, long long);
+void narrow_npv(count_int, count_int, count_int, const metric_band &,
+		long long, count_int &, count_int &);
+void narrow_balanced_accuracy(count_int, count_int, count_int,
+		const metric_band &, long long, count_int &, count_int &);
+void narrow_jaccard(count_int, count_int, count_int, const metric_band &,
+		long long, count_int &, count_int &);
+void narrow_youden(count_int, count_int, count_int, const metric_band &,
+		long long, count_int &, count_int &);
+bool wide_in_band(wide_int, wide_int, const metric_band &, long long);
+void narrow_linear_ratio(wide_int, wide_int, wide_int, wide_int,
+		const metric_band &, long long, count_int &, count_int &);
+void narrow_at_least(wide_int, wide_int, wide_int, count_int &, count_int &);
+wide_int floor_div(wide_int, wide_int);
+int root_side(wide_int, long long, wide_int, long double);
+
+// Largest product the exact MCC test squares, leaving headroom in wide_int.
+const long double MCC_EXACT_LIMIT = 1e37L;
+
+// The metric registry, indexed by extra_metric.
+const metric_definition EXTRA_METRICS[EXTRA_METRIC_COUNT] = {
+	{"npv", "NPV", 0, check_npv, narrow_npv},
+	{"balanced-accuracy", "Balanced Accuracy", 0, check_balanced_accuracy,
+		narrow_balanced_accuracy},
+	{"jaccard", "Jaccard", 0, check_jaccard, narrow_jaccard},
+	{"youden", "Youden's J", -1, check_youden, narrow_youden},
+	{"mcc", "MCC", -1, check_mcc, NULL}
+};
+
+/**
+ * find_extra_metric - look up a registry metric by name.
+ *
+ * Parameters
+ *   const char * - the name of the metric
+ *
+ * Returns
+ *   int - the extra_metric of the name, or -1 if there is none
+ */
+int find_extra_metric(const char * name)
+{
+	for (int k = 0; k < EXTRA_METRIC_COUNT; k++)
+		if (strcmp(EXTRA_METRICS[k].name, name) == 0)
+			return k;
+	return -1;
+}
+
+/**
+ * check_extra_metrics - check a matrix against the bands of a set of
+ * registry metrics.
+ *
+ * Parameters
+ *   count_int - TP
+ *   count_int - FN
+ *   count_int - FP
+ *   count_int - TN
+ *   metric_targets - the integer bands of the targets
+ *   unsigned - the extra mask of the metrics to check
+ *
+ * Returns
+ *   bool - if every checked metric meets its band
+ */
+bool check_extra_metrics(
+		count_int TP,
+		count_int FN,
+		count_int FP,
+		count_int TN,
+		const metric_targets & targets,
+		unsigned mask
+		)
+{
+	for (int k = 0; mask != 0; k++, mask >>= 1)
+		if ((mask & 1) && !EXTRA_METRICS[k].check(TP, FN, FP, TN,
+				targets.extra[k], targets.twice_scale))
+			return false;
+	return true;
+}
+
+/**
+ * narrow_extra_metrics - narrow the TP range of an accuracy diagonal by the
+ * registry metrics of a search's extra_prune_mask.
+ *
+ * Parameters
+ *   search_context - the class counts and bands of the search
+ *   count_int - the number of correct predictions on the diagonal
+ *   count_int & - the smallest TP to check, raised in place
+ *   count_int & - the largest TP to check, lowered in place
+ */
+void narrow_extra_metrics(
+		const search_context & context,
+		count_int correct_preds,
+		count_int & min_tp,
+		count_int & max_tp
+		)
+{
+	unsigned mask = context.extra_prune_mask;
+	for (int k = 0; mask != 0 && min_tp <= max_tp; k++, mask >>= 1)
+		if (mask & 1)
+			EXTRA_METRICS[k].narrow(context.class_a_count, context.class_b_count,
+					correct_preds, context.targets.extra[k],
+					context.targets.twice_scale, min_tp, max_tp);
+}
+
+/**
+ * check_npv - check the negative predictive value, TN / (TN + FN).
+ */
+bool check_npv(count_int TP, count_int FN, count_int FP, count_int TN,
+		const metric_band & band, long long twice_scale)
+{
+	(void)TP;
+	(void)FP;
+	return wide_in_band(TN, (wide_int)TN + FN, band, twice_scale);
+}
+
+/**
+ * check_balanced_accuracy - check the balanced accuracy,
+ * (TP / A + TN / B) / 2 = (TP * B + TN * A) / 2AB.
+ */
+bool check_balanced_accuracy(count_int TP, count_int FN, count_int FP,
+		count_int TN, const metric_band & band, long long twice_scale)
+{
+	wide_int class_a_count = (wide_int)TP + FN;
+	wide_int class_b_count = (wide_int)TN + FP;
+	return wide_in_band(TP * class_b_count + TN * class_a_count,
+			2 * class_a_count * class_b_count, band, twice_scale);
+}
+
+/**
+ * check_jaccard - check the Jaccard index, TP / (TP + FP + FN).
+ */
+bool check_jaccard(count_int TP, count_int FN, count_int FP, count_int TN,
+		const metric_band & band, long long twice_scale)
+{
+	(void)TN;
+	return wide_in_band(TP, (wide_int)TP + FP + FN, band, twice_scale);
+}
+
+/**
+ * check_youden - check Youden's J, TP / A + TN / B - 1 =
+ * (TP * B + TN * A - AB) / AB.
+ */
+bool check_youden(count_int TP, count_int FN, count_int FP, count_int TN,
+		const metric_band & band, long long twice_scale)
+{
+	wide_int class_a_count = (wide_int)TP + FN;
+	wide_int class_b_count = (wide_int)TN + FP;
+	wide_int total = class_a_count * class_b_count;
+	return wide_in_band(TP * class_b_count + TN * class_a_count - total, total,
+			band, twice_scale);
+}
+
+/**
+ * check_mcc - check the Matthews correlation coefficient,
+ * (TP * TN - FP * FN) / sqrt((TP + FP)(TP + FN)(TN + FP)(TN + FN)).
+ *
+ * The band test n * twice_scale against lower * sqrt(D) and upper * sqrt(D)
+ * is decided by squaring, exactly while the squares fit in wide_int and in
+ * long double beyond that. A zero denominator never matches.
+ *
+ * Parameters
+ *   count_int - TP
+ *   count_int - FN
+ *   count_int - FP
+ *   count_int - TN
+ *   metric_band - the integer band of the target
+ *   long long - twice the decimal scale, 2 * 10^dp
+ *
+ * Returns
+ *   bool - if the coefficient rounds into the band
+ */
+bool check_mcc(
+		count_int TP,
+		count_int FN,
+		count_int FP,
+		count_int TN,
+		const metric_band & band,
+		long long twice_scale
+		)
+{
+	long double product = (long double)(TP + FP) * (TP + FN) * (TN + FP) *
+		(TN + FN);
+	if (product == 0)
+		return false;
+	wide_int denominator = 0;
+	if (product < MCC_EXACT_LIMIT)
+		denominator = (wide_int)(TP + FP) * (TP + FN) * (TN + FP) * (TN + FN);
+	wide_int scaled = ((wide_int)TP * TN - (wide_int)FP * FN) * twice_scale;
+
+	// An open lower end or a closed upper end admits equality.
+	int lower = root_side(scaled, band.lower, denominator, product);
+	int upper = root_side(scaled, band.upper, denominator, product);
+	return (band.lower_offset ? lower > 0 : lower >= 0) &&
+		(band.upper_offset ? upper <= 0 : upper < 0);
+}
+
+/**
+ * root_side - the sign of a - b * sqrt(D).
+ *
+ * Parameters
+ *   wide_int - a
+ *   long long - b
+ *   wide_int - D, or 0 if it is too large to square against exactly
+ *   long double - D, which must be positive
+ *
+ * Returns
+ *   int - -1, 0 or 1 as a is below, at or above b * sqrt(D)
+ */
+int root_side(wide_int a, long long b, wide_int exact, long double product)
+{
+	// Opposite signs, or zeros, decide it without the root.
+	if (a >= 0 && b <= 0)
+		return a == 0 && b == 0 ? 0 : 1;
+	if (a <= 0 && b >= 0)
+		return -1;
+
+	long double magnitude = (long double)a * (long double)a;
+	long double root = (long double)b * (long double)b * product;
+	if (exact != 0 && magnitude < MCC_EXACT_LIMIT && root < MCC_EXACT_LIMIT)
+	{
+		wide_int left = a * a;
+		wide_int right = (wide_int)b * b * exact;
+		int side = left < right ? -1 : (left > right ? 1 : 0);
+		return a > 0 ? side : -side;
+	}
+	long double difference = (long double)a - b * sqrtl(product);
+	return difference < 0 ? -1 : (difference > 0 ? 1 : 0);
+}
+
+/**
+ * narrow_npv - narrow a diagonal by the negative predictive value, which is
+ * (correct - TP) / (correct + A - 2TP) along it.
+ */
+void narrow_npv(count_int class_a_count, count_int class_b_count,
+		count_int correct_preds, const metric_band & band, long long twice_scale,
+		count_int & min_tp, count_int & max_tp)
+{
+	(void)class_b_count;
+	narrow_linear_ratio(correct_preds, -1, (wide_int)correct_preds +
+			class_a_count, -2, band, twice_scale, min_tp, max_tp);
+
+	// TN + FN is 0 on the cell with every class A item and nothing else
+	// correct, where the value is undefined.
+	if (correct_preds == class_a_count)
+		max_tp = std::min(max_tp, class_a_count - 1);
+}
+
+/**
+ * narrow_balanced_accuracy - narrow a diagonal by the balanced accuracy,
+ * which is (correct * A + TP * (B - A)) / 2AB along it.
+ */
+void narrow_balanced_accuracy(count_int class_a_count,
+		count_int class_b_count, count_int correct_preds,
+		const metric_band & band, long long twice_scale, count_int & min_tp,
+		count_int & max_tp)
+{
+	narrow_linear_ratio((wide_int)correct_preds * class_a_count,
+			(wide_int)class_b_count - class_a_count,
+			2 * (wide_int)class_a_count * class_b_count, 0, band, twice_scale,
+			min_tp, max_tp);
+}
+
+/**
+ * narrow_jaccard - narrow a diagonal by the Jaccard index, which is
+ * TP / (A + B - correct + TP) along it.
+ */
+void narrow_jaccard(count_int class_a_count, count_int class_b_count,
+		count_int correct_preds, const metric_band & band, long long twice_scale,
+		count_int & min_tp, count_int & max_tp)
+{
+	narrow_linear_ratio(0, 1, (wide_int)class_a_count + class_b_count -
+			correct_preds, 1, band, twice_scale, min_tp, max_tp);
+}
+
+/**
+ * narrow_youden - narrow a diagonal by Youden's J, which is
+ * (correct * A - AB + TP * (B - A)) / AB along it.
+ */
+void narrow_youden(count_int class_a_count, count_int class_b_count,
+		count_int correct_preds, const metric_band & band, long long twice_scale,
+		count_int & min_tp, count_int & max_tp)
+{
+	wide_int total = (wide_int)class_a_count * class_b_count;
+	narrow_linear_ratio((wide_int)correct_preds * class_a_count - total,
+			(wide_int)class_b_count - class_a_count, total, 0, band, twice_scale,
+			min_tp, max_tp);
+}
+
+/**
+ * wide_in_band - the band test of check_metric for ratios whose terms need
+ * wide_int.
+ *
+ * Parameters
+ *   wide_int - the numerator of the ratio
+ *   wide_int - the denominator of the ratio, 0 never matches
+ *   metric_band - the integer band of the target
+ *   long long - twice the decimal scale, 2 * 10^dp
+ *
+ * Returns
+ *   bool - if lower * d + lower_offset <= n * twice_scale <
+ *          upper * d + upper_offset
+ */
+bool wide_in_band(
+		wide_int numerator,
+		wide_int denominator,
+		const metric_band & band,
+		long long twice_scale
+		)
+{
+	wide_int scaled = numerator * twice_scale;
+	return band.lower * denominator + band.lower_offset <= scaled &&
+		scaled < band.upper * denominator +
+		std::min(denominator, (wide_int)band.upper_offset);
+}
+
+/**
+ * narrow_linear_ratio - narrow a TP range to the TP whose ratio
+ * (n0 + n1 * TP) / (d0 + d1 * TP) meets a band, where the denominator is
+ * positive over the range.
+ *
+ * Both band tests are linear in TP once cross-multiplied:
+ * (S * n1 - lower * d1) * TP + S * n0 - lower * d0 >= lower_offset and
+ * (upper * d1 - S * n1) * TP + upper * d0 - S * n0 >= 1 - upper_offset.
+ *
+ * Parameters
+ *   wide_int - n0
+ *   wide_int - n1
+ *   wide_int - d0
+ *   wide_int - d1
+ *   metric_band - the integer band of the target
+ *   long long - twice the decimal scale, 2 * 10^dp
+ *   count_int & - the smallest TP, raised in place
+ *   count_int & - the largest TP, lowered in place
+ */
+void narrow_linear_ratio(
+		wide_int numerator_base,
+		wide_int numerator_slope,
+		wide_int denominator_base,
+		wide_int denominator_slope,
+		const metric_band & band,
+		long long twice_scale,
+		count_int & min_tp,
+		count_int & max_tp
+		)
+{
+	narrow_at_least(twice_scale * numerator_slope - band.lower *
+			denominator_slope, twice_scale * numerator_base - band.lower *
+			denominator_base, band.lower_offset, min_tp, max_tp);
+	narrow_at_least(band.upper * denominator_slope - twice_scale *
+			numerator_slope, band.upper * denominator_base - twice_scale *
+			numerator_base, 1 - band.upper_offset, min_tp, max_tp);
+}
+
+/**
+ * narrow_at_least - narrow a TP range to the TP with slope * TP + base at
+ * least a bound.
+ *
+ * Parameters
+ *   wide_int - the slope
+ *   wide_int - the base
+ *   wide_int - the bound
+ *   count_int & - the smallest TP, raised in place
+ *   count_int & - the largest TP, lowered in place
+ */
+void narrow_at_least(
+		wide_int slope,
+		wide_int base,
+		wide_int bound,
+		count_int & min_tp,
+		count_int & max_tp
+		)
+{
+	if (slope > 0)
+		min_tp = (count_int)std::max((wide_int)min_tp,
+				-floor_div(base - bound, slope));
+	else if (slope < 0)
+		max_tp = (count_int)std::min((wide_int)max_tp,
+				floor_div(base - bound, -slope));
+	else if (base < bound)
+		max_tp = min_tp - 1;
+}
+
+/**
+ * floor_div - divide rounding towards negative infinity.
+ *
+ * Parameters
+ *   wide_int - the numerator
+ *   wide_int - the denominator, which must be positive
+ *
+ * Returns
+ *   wide_int - floor(numerator / denominator)
+ */
+wide_int floor_div(wide_int numerator, wide_int denominator)
+{
+	wide_int quotient = numerator / denominator;
+	if (numerator % denominator != 0 && numerator < 0)
+		quotient--;
+	return quotient;
+}
@@ -0,0 +1,1290 @@
+/**
+ * CPP file to reverse engineer K x K confusion matrices from their rounded
+ * multiclass metrics.
+ *
+ * Every metric of a single label multiclass matrix depends only on each
+ * class's true positives (the diagonal) and predicted count (the column
+ * sums), so the search walks those instead of the K * K cells. A diagonal
+ * and column sums belong to a matrix exactly when, for every class k,
+ * (n_k - tp_k) + (predicted_k - tp_k) <= N - sum(tp), and
+ * multiclass_witness builds one such matrix.
+ */
+#include <iostream>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include "reverse_engineer.hpp"
+
+// The class 0 branches handed out per thread, so idle threads can take
+// over the work of slow ones.
+const int MULTICLASS_BRANCHES_PER_THREAD = 8;
+
+// Fewest branches a threaded search with a callback is split into, so the
+// branches buffered at any time only hold a small part of the solutions.
+const int MULTICLASS_REPORT_BRANCHES = 4096;
+
+// Branches that each thread may have searched ahead of the one being
+// reported, which bounds the solutions buffered by a threaded search.
+const int MULTICLASS_PENDING_PER_THREAD = 4;
+
+// Slack on the floating point bounds of the macro averages. The bounds only
+// prune, every solution is checked exactly before it is reported.
+const long double MULTICLASS_SLACK = 1e-12L;
+
+/**
+ * ratio_range - the inclusive range a per-class ratio can take.
+ */
+struct ratio_range
+{
+	long double low;
+	long double high;
+};
+
+/**
+ * multiclass_bounds - the integer bands of a multiclass problem, and the
+ * range of the counts and ratios of every suffix of its classes.
+ *
+ * The suffix vectors hold classes + 1 entries, the last for the empty
+ * suffix.
+ */
+struct multiclass_bounds
+{
+	int classes;
+	count_int total;
+	long long twice_scale;
+	std::vector<count_int> class_counts;
+	count_band correct;
+	metric_band macro_precision;
+	metric_band macro_recall;
+	metric_band macro_f1;
+	std::vector<metric_band> precision;
+	std::vector<metric_band> recall;
+	std::vector<metric_band> f1;
+	std::vector<count_band> tp_band;
+	std::vector<count_int> suffix_min_tp;
+	std::vector<count_int> suffix_max_tp;
+	std::vector<ratio_range> suffix_recall;
+	std::vector<ratio_range> suffix_precision;
+	std::vector<ratio_range> suffix_f1;
+};
+
+/**
+ * multiclass_branch - the solutions with one class 0 true positive count
+ * and a run of class 0 predicted counts.
+ */
+struct multiclass_branch
+{
+	count_int tp;
+	count_int first_predicted;
+	count_int last_predicted;
+};
+
+/**
+ * multiclass_walker - the depth first search of one thread.
+ *
+ * Classes are fixed in order; each takes its true positives from the
+ * largest down, then its predicted count from the smallest up.
+ */
+class multiclass_walker
+{
+public:
+	multiclass_walker(const multiclass_bounds &,
+			const std::function<void(const multiclass_solution &)> &);
+	void walk(const multiclass_branch &);
+	uint64_t matches;
+
+private:
+	void descend(int, count_int, count_int, long double, long double,
+			long double);
+	void choose(int, count_int, count_int, count_int, count_int, count_int,
+			long double, long double, long double);
+	void finish(int, count_int, count_int, count_int, count_int, long double);
+	int macro_runs(int, int, count_int, count_int, count_int,
+			count_int[2][2]);
+	int macro_side(int);
+	bool leaf_matches();
+
+	const multiclass_bounds & bounds;
+	const std::function<void(const multiclass_solution &)> & report;
+	multiclass_solution solution;
+	std::vector<count_int> numerators;
+	std::vector<count_int> denominators;
+};
+
+bool make_multiclass_bounds(const multiclass_problem &, multiclass_bounds &);
+bool multiclass_tp_range(const multiclass_bounds &, int, count_int,
+		long double, count_int &, count_int &);
+bool multiclass_predicted_range(const multiclass_bounds &, int, count_int,
+		count_int, count_int, long double, long double, count_int &,
+		count_int &);
+bool class_predicted_range(const multiclass_bounds &, int, count_int,
+		count_int, count_int &, count_int &);
+ratio_range needed_ratio(const metric_band &, const multiclass_bounds &,
+		long double, const ratio_range &);
+bool excluded_band(const metric_band &);
+ratio_range band_range(const metric_band &, long long);
+count_int count_at_least(long double, count_int);
+count_int count_at_most(long double, count_int);
+int mean_side(const count_int *, const count_int *, int,
+		const metric_band &, long long);
+count_int rising_from(count_int, count_int, count_int, count_int, count_int,
+		count_int);
+
+/**
+ * valid_multiclass_problem - check a problem against the limits of the
+ * search.
+ *
+ * Parameters
+ *   multiclass_problem - the problem to check
+ *
+ * Returns
+ *   bool - if the problem can be searched
+ */
+bool valid_multiclass_problem(const multiclass_problem & problem)
+{
+	size_t classes = problem.class_counts.size();
+	if (classes < 2 || problem.decimal_places < 0 ||
+			problem.decimal_places > 18)
+		return false;
+
+	count_int total = 0;
+	for (size_t k = 0; k < classes; k++)
+	{
+		if (problem.class_counts[k] <= 0 ||
+				problem.class_counts[k] > (count_int)1e15 - total)
+			return false;
+		total += problem.class_counts[k];
+	}
+
+	const double macro[4] = {problem.target_accuracy,
+		problem.target_macro_precision, problem.target_macro_recall,
+		problem.target_macro_f1};
+	for (int t = 0; t < 4; t++)
+		if (!((macro[t] >= 0 && macro[t] <= 1) || macro[t] == -1))
+			return false;
+
+	const std::vector<double> * per_class[3] = {&problem.target_precision,
+		&problem.target_recall, &problem.target_f1};
+	for (int t = 0; t < 3; t++)
+	{
+		if (!per_class[t]->empty() && per_class[t]->size() != classes)
+			return false;
+		for (size_t k = 0; k < per_class[t]->size(); k++)
+		{
+			double target = (*per_class[t])[k];
+			if (!((target >= 0 && target <= 1) || target == -1))
+				return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * search_multiclass - pass every solution of a multiclass problem to a
+ * callback.
+ *
+ * Class 0 is split into branches of one true positive count and a run of
+ * predicted counts, which the threads take in turn. Each branch is buffered
+ * separately and reported in branch order as soon as the branches before it
+ * are, so the callback is called on one thread in the order of the serial
+ * search. A thread does not start a branch more than
+ * MULTICLASS_PENDING_PER_THREAD branches per thread ahead of the one being
+ * reported, so only those branches are held in memory. Without a callback
+ * the solutions are only counted.
+ *
+ * Parameters
+ *   multiclass_problem - the class counts and targets, which must be valid
+ *   int - the number of worker threads
+ *   std::function - called with every solution, or empty to only count them
+ *
+ * Returns
+ *   uint64_t - the number of solutions
+ */
+uint64_t search_multiclass(
+		const multiclass_problem & problem,
+		int thread_count,
+		const std::function<void(const multiclass_solution &)> & report
+		)
+{
+	multiclass_bounds bounds;
+	if (!make_multiclass_bounds(problem, bounds))
+		return 0;
+
+	std::vector<multiclass_branch> branches;
+	count_int first_tp, last_tp;
+	if (multiclass_tp_range(bounds, 0, 0, 0, first_tp, last_tp))
+	{
+		// Split the predicted counts of each true positive count so there
+		// are about MULTICLASS_BRANCHES_PER_THREAD branches per thread, or
+		// MULTICLASS_REPORT_BRANCHES when they are buffered for a callback.
+		count_int wanted = thread_count <= 1 ? 1 :
+			(count_int)thread_count * MULTICLASS_BRANCHES_PER_THREAD;
+		if (thread_count > 1 && report)
+			wanted = std::max(wanted, (count_int)MULTICLASS_REPORT_BRANCHES);
+		count_int slices = std::max((count_int)1,
+				wanted / (last_tp - first_tp + 1));
+		for (count_int tp = last_tp; tp >= first_tp; tp--)
+		{
+			count_int first, last;
+			if (!multiclass_predicted_range(bounds, 0, tp, 0, 0, 0, 0, first,
+					last))
+				continue;
+			count_int length = last - first + 1;
+			count_int pieces = std::min(slices, length);
+			for (count_int piece = 0; piece < pieces; piece++)
+			{
+				multiclass_branch branch = {tp,
+					first + length * piece / pieces,
+					first + length * (piece + 1) / pieces - 1};
+				branches.push_back(branch);
+			}
+		}
+	}
+
+	int branch_count = (int)branches.size();
+	if (thread_count <= 1 || branch_count <= 1)
+	{
+		multiclass_walker walker(bounds, report);
+		for (int b = 0; b < branch_count; b++)
+			walker.walk(branches[b]);
+		return walker.matches;
+	}
+
+	// A branch's buffer is reused once the branch has been reported, since
+	// no thread runs more than pending branches ahead of it.
+	int pending = thread_count * MULTICLASS_PENDING_PER_THREAD;
+	std::vector<std::vector<multiclass_solution> > buffers(report ?
+			std::min(branch_count, pending) : 0);
+	std::atomic<uint64_t> matches(0);
+	run_chunks_in_order(branch_count, thread_count, pending,
+			[&](int b) {
+				std::vector<multiclass_solution> * buffer =
+					report ? &buffers[b % pending] : NULL;
+				std::function<void(const multiclass_solution &)> keep;
+				if (buffer != NULL)
+					keep = [buffer](const multiclass_solution & solution) {
+						buffer->push_back(solution);
+					};
+				multiclass_walker walker(bounds, keep);
+				walker.walk(branches[b]);
+				matches += walker.matches;
+			},
+			[&](int b) {
+				if (!report)
+					return;
+				std::vector<multiclass_solution> & buffer = buffers[b % pending];
+				for (size_t s = 0; s < buffer.size(); s++)
+					report(buffer[s]);
+				buffer.clear();
+			});
+	return matches;
+}
+
+/**
+ * multiclass_witness - build a matrix with a given diagonal and column sums.
+ *
+ * The off-diagonal cells are a transport of row surpluses n_i - tp_i to
+ * column surpluses predicted_j - tp_j that avoids the diagonal, found as a
+ * maximum flow with augmenting shortest paths.
+ *
+ * Parameters
+ *   multiclass_problem - the class counts of the matrix
+ *   multiclass_solution - the diagonal and column sums
+ *   std::vector<count_int> - filled with the matrix in row major order, rows
+ *                            the actual class and columns the predicted one
+ *
+ * Returns
+ *   bool - if a matrix exists
+ */
+bool multiclass_witness(
+		const multiclass_problem & problem,
+		const multiclass_solution & solution,
+		std::vector<count_int> & matrix
+		)
+{
+	int classes = (int)problem.class_counts.size();
+	if ((int)solution.tp.size() != classes ||
+			(int)solution.predicted.size() != classes)
+		return false;
+
+	// Nodes are the source, the K rows, the K columns and the sink.
+	int source = 0, sink = 2 * classes + 1, nodes = 2 * classes + 2;
+	std::vector<count_int> capacity((size_t)nodes * nodes, 0);
+	count_int supply = 0, demand = 0;
+	for (int k = 0; k < classes; k++)
+	{
+		count_int surplus = problem.class_counts[k] - solution.tp[k];
+		count_int shortfall = solution.predicted[k] - solution.tp[k];
+		if (surplus < 0 || shortfall < 0)
+			return false;
+		capacity[(size_t)source * nodes + 1 + k] = surplus;
+		capacity[(size_t)(1 + classes + k) * nodes + sink] = shortfall;
+		supply += surplus;
+		demand += shortfall;
+	}
+	if (supply != demand)
+		return false;
+	for (int i = 0; i < classes; i++)
+		for (int j = 0; j < classes; j++)
+			if (i != j)
+				capacity[(size_t)(1 + i) * nodes + 1 + classes + j] = supply;
+
+	std::vector<count_int> residual(capacity);
+	std::vector<int> parent(nodes);
+	count_int flow = 0;
+	while (flow < supply)
+	{
+		std::fill(parent.begin(), parent.end(), -1);
+		parent[source] = source;
+		std::deque<int> queue(1, source);
+		while (!queue.empty() && parent[sink] == -1)
+		{
+			int node = queue.front();
+			queue.pop_front();
+			for (int next = 0; next < nodes; next++)
+				if (parent[next] == -1 && residual[(size_t)node * nodes + next] > 0)
+				{
+					parent[next] = node;
+					queue.push_back(next);
+				}
+		}
+		if (parent[sink] == -1)
+			return false;
+
+		count_int step = supply - flow;
+		for (int node = sink; node != source; node = parent[node])
+			step = std::min(step, residual[(size_t)parent[node] * nodes + node]);
+		for (int node = sink; node != source; node = parent[node])
+		{
+			residual[(size_t)parent[node] * nodes + node] -= step;
+			residual[(size_t)node * nodes + parent[node]] += step;
+		}
+		flow += step;
+	}
+
+	matrix.assign((size_t)classes * classes, 0);
+	for (int i = 0; i < classes; i++)
+		for (int j = 0; j < classes; j++)
+		{
+			size_t edge = (size_t)(1 + i) * nodes + 1 + classes + j;
+			matrix[(size_t)i * classes + j] = i == j ? solution.tp[i] :
+				capacity[edge] - residual[edge];
+		}
+	return true;
+}
+
+/**
+ * run_multiclass - search a multiclass problem and write the solutions to a
+ * csv file, or print how many there are.
+ *
+ * Each row holds the true positives and predicted count of every class,
+ * followed by the targets. multiclass_witness turns a row into a matrix.
+ *
+ * Parameters
+ *   multiclass_problem - the class counts and targets
+ *   int - the number of worker threads
+ *   bool - print the number of solutions instead of writing them
+ *   const char * - the path of the output file
+ *
+ * Returns
+ *   int - the exit status
+ */
+int run_multiclass(
+		const multiclass_problem & problem,
+		int thread_count,
+		bool count_only,
+		const char * output_path
+		)
+{
+	if (!valid_multiclass_problem(problem))
+	{
+		std::cerr << "Invalid multiclass problem." << std::endl;
+		return(1);
+	}
+
+	multiclass_bounds bounds;
+	if (!make_multiclass_bounds(problem, bounds))
+	{
+		if (count_only)
+			std::cout << 0 << std::endl;
+		else
+			std::cout << "There are no combinations that can achieve these "
+				"targets." << std::endl;
+		return(0);
+	}
+
+	if (count_only)
+	{
+		std::cout << search_multiclass(problem, thread_count,
+				std::function<void(const multiclass_solution &)>()) << std::endl;
+		return(0);
+	}
+
+	FILE * file = fopen(output_path, "w");
+	if (file == NULL)
+	{
+		std::cerr << "Failed to open the output file." << std::endl;
+		return(1);
+	}
+
+	int classes = (int)problem.class_counts.size();
+	for (int k = 0; k < classes; k++)
+		fprintf(file, "TP_%d,", k + 1);
+	for (int k = 0; k < classes; k++)
+		fprintf(file, "Predicted_%d,", k + 1);
+	fputs("Accuracy,Macro Precision,Macro Recall,Macro F1,\n", file);
+
+	char suffix[128];
+	snprintf(suffix, sizeof(suffix), "%g,%g,%g,%g,\n", problem.target_accuracy,
+			problem.target_macro_precision, problem.target_macro_recall,
+			problem.target_macro_f1);
+
+	search_multiclass(problem, thread_count,
+			[&](const multiclass_solution & solution) {
+				for (int k = 0; k < classes; k++)
+					fprintf(file, "%lld,", solution.tp[k]);
+				for (int k = 0; k < classes; k++)
+					fprintf(file, "%lld,", solution.predicted[k]);
+				fputs(suffix, file);
+			});
+
+	if (fclose(file) != 0)
+	{
+		std::cerr << "Failed to write the output file." << std::endl;
+		return(1);
+	}
+	return(0);
+}
+
+/**
+ * make_multiclass_bounds - convert a problem into its integer bands and
+ * suffix ranges.
+ *
+ * Parameters
+ *   multiclass_problem - the class counts and targets
+ *   multiclass_bounds - filled with the bands and ranges
+ *
+ * Returns
+ *   bool - false if some target excludes every solution
+ */
+bool make_multiclass_bounds(
+		const multiclass_problem & problem,
+		multiclass_bounds & bounds
+		)
+{
+	int classes = (int)problem.class_counts.size();
+	bounds.classes = classes;
+	bounds.class_counts = problem.class_counts;
+	bounds.total = 0;
+	for (int k = 0; k < classes; k++)
+		bounds.total += problem.class_counts[k];
+	bounds.twice_scale = 2;
+	for (int d = 0; d < problem.decimal_places; d++)
+		bounds.twice_scale *= 10;
+
+	int dp = problem.decimal_places;
+	bounds.correct = find_ratio_band(bounds.total,
+			make_metric_band(problem.target_accuracy, dp), bounds.twice_scale);
+	if (!bounds.correct.feasible)
+		return false;
+	bounds.macro_precision = make_metric_band(problem.target_macro_precision,
+			dp);
+	bounds.macro_recall = make_metric_band(problem.target_macro_recall, dp);
+	bounds.macro_f1 = make_metric_band(problem.target_macro_f1, dp);
+
+	bounds.precision.assign(classes, metric_band());
+	bounds.recall.assign(classes, metric_band());
+	bounds.f1.assign(classes, metric_band());
+	for (int k = 0; k < classes; k++)
+	{
+		bounds.precision[k] = make_metric_band(problem.target_precision.empty() ?
+				-1 : problem.target_precision[k], dp);
+		bounds.recall[k] = make_metric_band(problem.target_recall.empty() ?
+				-1 : problem.target_recall[k], dp);
+		bounds.f1[k] = make_metric_band(problem.target_f1.empty() ?
+				-1 : problem.target_f1[k], dp);
+		if (excluded_band(bounds.precision[k]) ||
+				excluded_band(bounds.recall[k]) || excluded_band(bounds.f1[k]))
+			return false;
+	}
+	if (excluded_band(bounds.macro_precision) ||
+			excluded_band(bounds.macro_recall) || excluded_band(bounds.macro_f1))
+		return false;
+
+	bounds.tp_band.resize(classes);
+	for (int k = 0; k < classes; k++)
+	{
+		bounds.tp_band[k] = find_ratio_band(problem.class_counts[k],
+				bounds.recall[k], bounds.twice_scale);
+		if (!bounds.tp_band[k].feasible)
+			return false;
+	}
+
+	bounds.suffix_min_tp.assign(classes + 1, 0);
+	bounds.suffix_max_tp.assign(classes + 1, 0);
+	ratio_range empty = {0, 0};
+	bounds.suffix_recall.assign(classes + 1, empty);
+	bounds.suffix_precision.assign(classes + 1, empty);
+	bounds.suffix_f1.assign(classes + 1, empty);
+	for (int k = classes - 1; k >= 0; k--)
+	{
+		const count_band & tp = bounds.tp_band[k];
+		long double count = (long double)problem.class_counts[k];
+		ratio_range precision = band_range(bounds.precision[k],
+				bounds.twice_scale);
+		ratio_range f1 = band_range(bounds.f1[k], bounds.twice_scale);
+
+		bounds.suffix_min_tp[k] = bounds.suffix_min_tp[k + 1] + tp.min_count;
+		bounds.suffix_max_tp[k] = bounds.suffix_max_tp[k + 1] + tp.max_count;
+		bounds.suffix_recall[k].low = bounds.suffix_recall[k + 1].low +
+			tp.min_count / count;
+		bounds.suffix_recall[k].high = bounds.suffix_recall[k + 1].high +
+			tp.max_count / count;
+		bounds.suffix_precision[k].low = bounds.suffix_precision[k + 1].low +
+			precision.low;
+		bounds.suffix_precision[k].high = bounds.suffix_precision[k + 1].high +
+			precision.high;
+		bounds.suffix_f1[k].low = bounds.suffix_f1[k + 1].low + f1.low;
+		bounds.suffix_f1[k].high = bounds.suffix_f1[k + 1].high + f1.high;
+	}
+	return true;
+}
+
+/**
+ * multiclass_tp_range - the true positive counts of a class that leave the
+ * accuracy, its recall and the macro recall reachable.
+ *
+ * Parameters
+ *   multiclass_bounds - the bands of the problem
+ *   int - the class
+ *   count_int - the true positives of the classes before it
+ *   long double - the recall sum of the classes before it
+ *   count_int - set to the smallest count
+ *   count_int - set to the largest count
+ *
+ * Returns
+ *   bool - if any count is left
+ */
+bool multiclass_tp_range(
+		const multiclass_bounds & bounds,
+		int k,
+		count_int tp_sum,
+		long double recall_sum,
+		count_int & first,
+		count_int & last
+		)
+{
+	count_int count = bounds.class_counts[k];
+	first = std::max(bounds.tp_band[k].min_count,
+			bounds.correct.min_count - tp_sum - bounds.suffix_max_tp[k + 1]);
+	last = std::min(bounds.tp_band[k].max_count,
+			bounds.correct.max_count - tp_sum - bounds.suffix_min_tp[k + 1]);
+
+	if (bounds.macro_recall.enabled)
+	{
+		ratio_range needed = needed_ratio(bounds.macro_recall, bounds,
+				recall_sum, bounds.suffix_recall[k + 1]);
+		first = std::max(first, count_at_least(needed.low * count, count));
+		last = std::min(last, count_at_most(needed.high * count, count));
+	}
+	return first <= last;
+}
+
+/**
+ * multiclass_predicted_range - the predicted counts of a class, given its
+ * true positives, that leave the counts, its precision and f1 and the macro
+ * precision and f1 reachable.
+ *
+ * Parameters
+ *   multiclass_bounds - the bands of the problem
+ *   int - the class
+ *   count_int - the true positives of the class
+ *   count_int - the true positives of the classes before it
+ *   count_int - the predicted counts of the classes before it
+ *   long double - the precision sum of the classes before it
+ *   long double - the f1 sum of the classes before it
+ *   count_int - set to the smallest count
+ *   count_int - set to the largest count
+ *
+ * Returns
+ *   bool - if any count is left
+ */
+bool multiclass_predicted_range(
+		const multiclass_bounds & bounds,
+		int k,
+		count_int tp,
+		count_int tp_sum,
+		count_int predicted_sum,
+		long double precision_sum,
+		long double f1_sum,
+		count_int & first,
+		count_int & last
+		)
+{
+	count_int total = bounds.total;
+	count_int count = bounds.class_counts[k];
+	if (!class_predicted_range(bounds, k, tp,
+			tp_sum + tp + bounds.suffix_min_tp[k + 1], first, last))
+		return false;
+
+	// Every later class predicts at least its own true positives.
+	last = std::min(last, total - predicted_sum - bounds.suffix_min_tp[k + 1]);
+	if (k == bounds.classes - 1)
+		first = std::max(first, total - predicted_sum);
+
+	// A ratio r = a / (b + P) is in [low, high] when P is in
+	// [a / high - b, a / low - b]; with a = 0 the ratio is 0 for every P.
+	const metric_band * macro[2] = {&bounds.macro_precision, &bounds.macro_f1};
+	const long double sums[2] = {precision_sum, f1_sum};
+	const ratio_range * suffix[2] = {&bounds.suffix_precision[k + 1],
+		&bounds.suffix_f1[k + 1]};
+	const long double numerator[2] = {(long double)tp, 2.0L * tp};
+	const count_int offset[2] = {0, count};
+	for (int m = 0; m < 2; m++)
+	{
+		if (!macro[m]->enabled)
+			continue;
+		ratio_range needed = needed_ratio(*macro[m], bounds, sums[m],
+				*suffix[m]);
+		if (tp == 0)
+		{
+			if (needed.low > 0 || needed.high < 0)
+				return false;
+			continue;
+		}
+		if (needed.high <= 0)
+			return false;
+		first = std::max(first,
+				count_at_least(numerator[m] / needed.high - offset[m], total));
+		if (needed.low > 0)
+			last = std::min(last,
+					count_at_most(numerator[m] / needed.low - offset[m], total));
+	}
+	return first <= last;
+}
+
+/**
+ * class_predicted_range - the predicted counts of a class, given its true
+ * positives, allowed by its own targets and the incorrect predictions.
+ *
+ * The per-class bands are solved for the predicted count exactly, as
+ * find_ratio_band does for a fixed denominator.
+ *
+ * Parameters
+ *   multiclass_bounds - the bands of the problem
+ *   int - the class
+ *   count_int - the true positives of the class
+ *   count_int - a lower bound on the true positives of every class
+ *   count_int - set to the smallest count
+ *   count_int - set to the largest count
+ *
+ * Returns
+ *   bool - if any count is left
+ */
+bool class_predicted_range(
+		const multiclass_bounds & bounds,
+		int k,
+		count_int tp,
+		count_int tp_total,
+		count_int & first,
+		count_int & last
+		)
+{
+	count_int count = bounds.class_counts[k];
+	long long scale = bounds.twice_scale;
+
+	// The off-diagonal cells of row k and column k are disjoint, and all of
+	// them are among the N - sum(tp) incorrect predictions.
+	first = tp;
+	last = bounds.total - tp_total - count + 2 * tp;
+
+	const metric_band & precision = bounds.precision[k];
+	if (precision.enabled)
+	{
+		first = std::max(first,
+				(count_int)((wide_int)tp * scale / precision.upper) + 1);
+		if (precision.lower > 0)
+			last = std::min(last,
+					(count_int)((wide_int)tp * scale / precision.lower));
+	}
+	const metric_band & f1 = bounds.f1[k];
+	if (f1.enabled)
+	{
+		first = std::max(first,
+				(count_int)((wide_int)2 * tp * scale / f1.upper) + 1 - count);
+		if (f1.lower > 0)
+			last = std::min(last,
+					(count_int)((wide_int)2 * tp * scale / f1.lower) - count);
+	}
+	return first <= last;
+}
+
+/**
+ * needed_ratio - the range one class's ratio must fall in for a macro
+ * average to stay reachable.
+ *
+ * Parameters
+ *   metric_band - the band of the macro average
+ *   multiclass_bounds - the bands of the problem
+ *   long double - the ratio sum of the classes before it
+ *   ratio_range - the range of the ratio sum of the classes after it
+ *
+ * Returns
+ *   ratio_range - the range of the class's ratio, widened by
+ *                 MULTICLASS_SLACK
+ */
+ratio_range needed_ratio(
+		const metric_band & macro,
+		const multiclass_bounds & bounds,
+		long double sum_before,
+		const ratio_range & after
+		)
+{
+	long double classes = (long double)bounds.classes;
+	long double scale = (long double)bounds.twice_scale;
+	ratio_range needed;
+	needed.low = classes * macro.lower / scale - sum_before - after.high -
+		MULTICLASS_SLACK;
+	needed.high = classes * macro.upper / scale - sum_before - after.low +
+		MULTICLASS_SLACK;
+	return needed;
+}
+
+/**
+ * excluded_band - whether a target is enabled but no ratio rounds to it.
+ *
+ * Parameters
+ *   metric_band - the band of the target
+ *
+ * Returns
+ *   bool - if the band is empty
+ */
+bool excluded_band(const metric_band & band)
+{
+	return band.enabled && band.upper <= 0;
+}
+
+/**
+ * band_range - the range of ratios a band allows, within [0, 1].
+ *
+ * Parameters
+ *   metric_band - the band of the target
+ *   long long - twice the decimal scale, 2 * 10^dp
+ *
+ * Returns
+ *   ratio_range - the ratios, [0, 1] for a disabled target
+ */
+ratio_range band_range(const metric_band & band, long long twice_scale)
+{
+	ratio_range range = {0, 1};
+	if (band.enabled)
+	{
+		range.low = std::max(0.0L, (long double)band.lower / twice_scale);
+		range.high = std::min(1.0L, (long double)band.upper / twice_scale);
+	}
+	return range;
+}
+
+/**
+ * count_at_least - the smallest count no less than a bound.
+ *
+ * Parameters
+ *   long double - the bound
+ *   count_int - the largest count of interest
+ *
+ * Returns
+ *   count_int - the count, clamped to [0, limit + 1]
+ */
+count_int count_at_least(long double bound, count_int limit)
+{
+	if (!(bound > 0))
+		return 0;
+	if (bound > (long double)limit)
+		return limit + 1;
+	return (count_int)ceill(bound);
+}
+
+/**
+ * count_at_most - the largest count no more than a bound.
+ *
+ * Parameters
+ *   long double - the bound
+ *   count_int - the largest count of interest
+ *
+ * Returns
+ *   count_int - the count, clamped to [-1, limit]
+ */
+count_int count_at_most(long double bound, count_int limit)
+{
+	if (!(bound >= 0))
+		return -1;
+	if (bound >= (long double)limit)
+		return limit;
+	return (count_int)floorl(bound);
+}
+
+/**
+ * mean_side - where the mean of K ratios falls against a band.
+ *
+ * A ratio with a zero denominator counts as 0, following the zero_division
+ * convention of macro averages. The test is exact over the common
+ * denominator while that fits a wide_int, and in long double otherwise.
+ *
+ * Parameters
+ *   const count_int * - the numerators
+ *   const count_int * - the denominators
+ *   int - the number of ratios
+ *   metric_band - the band of the mean
+ *   long long - twice the decimal scale, 2 * 10^dp
+ *
+ * Returns
+ *   int - -1 below the band, 0 in it and 1 above it
+ */
+int mean_side(
+		const count_int * numerators,
+		const count_int * denominators,
+		int count,
+		const metric_band & band,
+		long long twice_scale
+		)
+{
+	// Every ratio is at most 1, so the scaled sum stays below
+	// (twice_scale + 1) * K * product.
+	const wide_int limit = ((wide_int)1 << 125) /
+		((wide_int)(twice_scale + 1) * count);
+	wide_int product = 1;
+	bool exact = true;
+	for (int i = 0; i < count && exact; i++)
+	{
+		if (denominators[i] == 0)
+			continue;
+		if (product > limit / denominators[i])
+			exact = false;
+		else
+			product *= denominators[i];
+	}
+
+	if (exact)
+	{
+		wide_int sum = 0;
+		for (int i = 0; i < count; i++)
+			if (denominators[i] != 0)
+				sum += (wide_int)numerators[i] * (product / denominators[i]);
+		sum *= twice_scale;
+		wide_int total = product * count;
+		return sum < band.lower * total ? -1 : sum < band.upper * total ? 0 : 1;
+	}
+
+	long double sum = 0;
+	for (int i = 0; i < count; i++)
+		if (denominators[i] != 0)
+			sum += (long double)numerators[i] / denominators[i];
+	sum *= twice_scale;
+	return sum < (long double)band.lower * count ? -1 :
+		sum < (long double)band.upper * count ? 0 : 1;
+}
+
+/**
+ * rising_from - the first P in [first, last] from which
+ * a / (x + P) + b / (y - P) stops falling.
+ *
+ * The sum is convex in P, so it falls up to this P and rises after it. Its
+ * step from P to P + 1 has the sign of b * X * (X + 1) - a * Y * (Y - 1)
+ * with X = x + P and Y = y - P, which is tested exactly while it fits a
+ * wide_int, and in long double otherwise.
+ *
+ * Parameters
+ *   count_int - a, the numerator of the falling ratio
+ *   count_int - x, the denominator offset of the falling ratio
+ *   count_int - b, the numerator of the rising ratio
+ *   count_int - y, the denominator offset of the rising ratio
+ *   count_int - the first P
+ *   count_int - the last P, where y - P stays above 0
+ *
+ * Returns
+ *   count_int - the turning P
+ */
+count_int rising_from(
+		count_int a,
+		count_int x,
+		count_int b,
+		count_int y,
+		count_int first,
+		count_int last
+		)
+{
+	if (a == 0)
+		return first;
+	if (b == 0)
+		return last;
+
+	bool exact = std::max(x + last, y - first) < ((count_int)1 << 40);
+	while (first < last)
+	{
+		count_int middle = first + (last - first) / 2;
+		count_int X = x + middle, Y = y - middle;
+		bool rising;
+		if (exact)
+			rising = (wide_int)b * X * (X + 1) >= (wide_int)a * Y * (Y - 1);
+		else
+			rising = (long double)b * X * (X + 1) >=
+				(long double)a * Y * (Y - 1);
+		if (rising)
+			last = middle;
+		else
+			first = middle + 1;
+	}
+	return first;
+}
+
+/**
+ * multiclass_walker - set up a search of the given problem.
+ *
+ * Parameters
+ *   multiclass_bounds - the bands of the problem
+ *   std::function - called with every solution, or empty to only count them
+ */
+multiclass_walker::multiclass_walker(
+		const multiclass_bounds & problem_bounds,
+		const std::function<void(const multiclass_solution &)> & callback
+		) : matches(0), bounds(problem_bounds), report(callback)
+{
+	solution.tp.assign(bounds.classes, 0);
+	solution.predicted.assign(bounds.classes, 0);
+	numerators.resize(bounds.classes);
+	denominators.resize(bounds.classes);
+}
+
+/**
+ * walk - report every solution of a class 0 branch.
+ *
+ * Parameters
+ *   multiclass_branch - the class 0 true positives and predicted counts
+ */
+void multiclass_walker::walk(const multiclass_branch & branch)
+{
+	choose(0, branch.tp, branch.first_predicted, branch.last_predicted, 0, 0,
+			0, 0, 0);
+}
+
+/**
+ * descend - report every solution that extends the classes before k, for
+ * all but the last class.
+ *
+ * Parameters
+ *   int - the next class
+ *   count_int - the true positives of the classes before it
+ *   count_int - the predicted counts of the classes before it
+ *   long double - the recall sum of the classes before it
+ *   long double - the precision sum of the classes before it
+ *   long double - the f1 sum of the classes before it
+ */
+void multiclass_walker::descend(
+		int k,
+		count_int tp_sum,
+		count_int predicted_sum,
+		long double recall_sum,
+		long double precision_sum,
+		long double f1_sum
+		)
+{
+	count_int first_tp, last_tp;
+	if (!multiclass_tp_range(bounds, k, tp_sum, recall_sum, first_tp, last_tp))
+		return;
+	for (count_int tp = last_tp; tp >= first_tp; tp--)
+	{
+		count_int first, last;
+		if (!multiclass_predicted_range(bounds, k, tp, tp_sum, predicted_sum,
+				precision_sum, f1_sum, first, last))
+			continue;
+		choose(k, tp, first, last, tp_sum, predicted_sum, recall_sum,
+				precision_sum, f1_sum);
+	}
+}
+
+/**
+ * choose - fix the true positives of class k and try each of a run of its
+ * predicted counts.
+ *
+ * Parameters
+ *   int - the class
+ *   count_int - its true positives
+ *   count_int - its smallest predicted count
+ *   count_int - its largest predicted count
+ *   count_int - the true positives of the classes before it
+ *   count_int - the predicted counts of the classes before it
+ *   long double - the recall sum of the classes before it
+ *   long double - the precision sum of the classes before it
+ *   long double - the f1 sum of the classes before it
+ */
+void multiclass_walker::choose(
+		int k,
+		count_int tp,
+		count_int first,
+		count_int last,
+		count_int tp_sum,
+		count_int predicted_sum,
+		long double recall_sum,
+		long double precision_sum,
+		long double f1_sum
+		)
+{
+	count_int count = bounds.class_counts[k];
+	long double recall = recall_sum + (long double)tp / count;
+	solution.tp[k] = tp;
+	if (k == bounds.classes - 2)
+	{
+		finish(k, first, last, tp_sum + tp, predicted_sum, recall);
+		return;
+	}
+
+	for (count_int predicted = first; predicted <= last; predicted++)
+	{
+		solution.predicted[k] = predicted;
+		long double precision = predicted == 0 ? 0 :
+			(long double)tp / predicted;
+		long double f1 = 2.0L * tp / (count + predicted);
+		descend(k + 1, tp_sum + tp, predicted_sum + predicted, recall,
+				precision_sum + precision, f1_sum + f1);
+	}
+}
+
+/**
+ * finish - report every solution of the last two classes, the true
+ * positives of the next to last class being fixed.
+ *
+ * The last predicted count is what the others leave over, so with both true
+ * positives fixed each macro precision and f1 is a convex function of the
+ * next to last predicted count. Its band is then at most two runs of counts,
+ * one on each side of the turn, found by bisection.
+ *
+ * Parameters
+ *   int - the next to last class
+ *   count_int - its smallest predicted count
+ *   count_int - its largest predicted count
+ *   count_int - the true positives of every class but the last
+ *   count_int - the predicted counts of the classes before it
+ *   long double - the recall sum of every class but the last
+ */
+void multiclass_walker::finish(
+		int k,
+		count_int first,
+		count_int last,
+		count_int tp_sum,
+		count_int predicted_sum,
+		long double recall_sum
+		)
+{
+	int final_class = k + 1;
+	count_int remaining = bounds.total - predicted_sum;
+	count_int first_tp, last_tp;
+	if (!multiclass_tp_range(bounds, final_class, tp_sum, recall_sum, first_tp,
+			last_tp))
+		return;
+
+	for (count_int tp = last_tp; tp >= first_tp; tp--)
+	{
+		count_int low, high;
+		if (!class_predicted_range(bounds, final_class, tp, tp_sum + tp, low,
+				high))
+			continue;
+		solution.tp[final_class] = tp;
+
+		// Runs of next to last predicted counts, in increasing order.
+		count_int runs[4][2] = {{std::max(first, remaining - high),
+			std::min(last, remaining - low)}};
+		int run_count = runs[0][0] <= runs[0][1] ? 1 : 0;
+		for (int m = 0; m < 2 && run_count > 0; m++)
+		{
+			count_int bands[2][2];
+			int band_count = macro_runs(k, m, remaining, runs[0][0],
+					runs[run_count - 1][1], bands);
+			count_int kept[4][2];
+			int kept_count = 0;
+			for (int r = 0; r < run_count; r++)
+				for (int b = 0; b < band_count; b++)
+				{
+					count_int from = std::max(runs[r][0], bands[b][0]);
+					count_int to = std::min(runs[r][1], bands[b][1]);
+					if (from <= to && kept_count < 4)
+					{
+						kept[kept_count][0] = from;
+						kept[kept_count][1] = to;
+						kept_count++;
+					}
+				}
+			memcpy(runs, kept, sizeof(kept));
+			run_count = kept_count;
+		}
+
+		for (int r = 0; r < run_count; r++)
+			for (count_int predicted = runs[r][0]; predicted <= runs[r][1];
+					predicted++)
+			{
+				solution.predicted[k] = predicted;
+				solution.predicted[final_class] = remaining - predicted;
+				if (leaf_matches())
+				{
+					matches++;
+					if (report)
+						report(solution);
+				}
+			}
+	}
+}
+
+/**
+ * macro_runs - the runs of next to last predicted counts that put a macro
+ * precision or f1 in its band.
+ *
+ * Parameters
+ *   int - the next to last class, whose true positives and those of every
+ *         other class are set
+ *   int - 0 for the macro precision, 1 for the macro f1
+ *   count_int - the predicted counts left to the last two classes
+ *   count_int - the smallest predicted count
+ *   count_int - the largest predicted count
+ *   count_int[2][2] - set to the runs, in increasing order
+ *
+ * Returns
+ *   int - the number of runs, 1 for a disabled target
+ */
+int multiclass_walker::macro_runs(
+		int k,
+		int metric,
+		count_int remaining,
+		count_int first,
+		count_int last,
+		count_int runs[2][2]
+		)
+{
+	const metric_band & band = metric == 0 ? bounds.macro_precision :
+		bounds.macro_f1;
+	if (!band.enabled)
+	{
+		runs[0][0] = first;
+		runs[0][1] = last;
+		return 1;
+	}
+
+	int final_class = k + 1;
+	count_int offset = metric == 0 ? 0 : bounds.class_counts[k];
+	count_int final_offset = metric == 0 ? 0 : bounds.class_counts[final_class];
+	count_int turn = rising_from(solution.tp[k], offset,
+			solution.tp[final_class], final_offset + remaining, first, last);
+
+	// side(P) falls, or stays, up to the turn and rises after it.
+	auto side = [&](count_int predicted) {
+		solution.predicted[k] = predicted;
+		solution.predicted[final_class] = remaining - predicted;
+		return macro_side(metric);
+	};
+	// The first P in [from, to] for which test holds, test being monotone.
+	auto first_where = [&](count_int from, count_int to, bool rising,
+			int limit) {
+		while (from < to)
+		{
+			count_int middle = from + (to - from) / 2;
+			int value = side(middle);
+			if (rising ? value >= limit : value <= limit)
+				to = middle;
+			else
+				from = middle + 1;
+		}
+		return from;
+	};
+
+	int count = 0;
+	if (first <= turn)
+	{
+		// Falling: side goes 1, 0, -1.
+		count_int from = first_where(first, turn, false, 0);
+		count_int to = first_where(first, turn, false, -1);
+		if (side(to) >= 0)
+			to++;
+		if (from <= turn && side(from) == 0)
+		{
+			runs[count][0] = from;
+			runs[count][1] = std::min(to - 1, turn);
+			count++;
+		}
+	}
+	if (turn < last)
+	{
+		// Rising: side goes -1, 0, 1.
+		count_int from = first_where(turn + 1, last, true, 0);
+		count_int to = first_where(turn + 1, last, true, 1);
+		if (side(to) <= 0)
+			to++;
+		if (side(from) == 0)
+		{
+			runs[count][0] = from;
+			runs[count][1] = std::min(to - 1, last);
+			count++;
+		}
+	}
+	return count;
+}
+
+/**
+ * macro_side - where the macro precision or f1 of the current solution
+ * falls against its band.
+ *
+ * Parameters
+ *   int - 0 for the macro precision, 1 for the macro f1
+ *
+ * Returns
+ *   int - -1 below the band, 0 in it and 1 above it
+ */
+int multiclass_walker::macro_side(int metric)
+{
+	int classes = bounds.classes;
+	if (metric == 0)
+		return mean_side(&solution.tp[0], &solution.predicted[0], classes,
+				bounds.macro_precision, bounds.twice_scale);
+
+	for (int k = 0; k < classes; k++)
+	{
+		numerators[k] = 2 * solution.tp[k];
+		denominators[k] = bounds.class_counts[k] + solution.predicted[k];
+	}
+	return mean_side(&numerators[0], &denominators[0], classes,
+			bounds.macro_f1, bounds.twice_scale);
+}
+
+/**
+ * leaf_matches - check a full diagonal and column sums exactly.
+ *
+ * The searched ranges already hold the accuracy, the column sum total and
+ * each per-class target exactly; this adds the exact transport condition of
+ * every class and the exact macro averages.
+ *
+ * Returns
+ *   bool - if the solution meets every target
+ */
+bool multiclass_walker::leaf_matches()
+{
+	int classes = bounds.classes;
+	count_int incorrect = bounds.total;
+	for (int k = 0; k < classes; k++)
+		incorrect -= solution.tp[k];
+	for (int k = 0; k < classes; k++)
+		if (bounds.class_counts[k] + solution.predicted[k] - 2 * solution.tp[k] >
+				incorrect)
+			return false;
+
+	if (bounds.macro_recall.enabled &&
+			mean_side(&solution.tp[0], &bounds.class_counts[0], classes,
+				bounds.macro_recall, bounds.twice_scale) != 0)
+		return false;
+	if (bounds.macro_precision.enabled && macro_side(0) != 0)
+		return false;
+	if (bounds.macro_f1.enabled && macro_side(1) != 0)
+		return false;
+	return true;
+}
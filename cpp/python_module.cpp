@@ -0,0 +1,487 @@
+/**
+ * CPP file for the _reverse_engineer Python extension, built by
+ * make python into the python folder.
+ *
+ * search and search_batch run the C++ engines and return Matches objects,
+ * which keep the match_arena of a search. A Matches object exposes its
+ * matches through the buffer protocol as a read-only (N, 4) array of int64
+ * TP, FN, FP and TN. collect_matrices keeps up to ARENA_RESERVE_LIMIT
+ * matches in one block at any thread count, and numpy.asarray, or
+ * memoryview, then reads that block in place. Larger results are joined
+ * into one array the first time they are read. The searches run without
+ * the GIL.
+ */
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include "reverse_engineer.hpp"
+
+// Names of the search engines, indexed by search_engine.
+const char * const PYTHON_ENGINE_NAMES[] = {"rounded", "scalar", "pruned",
+	"simd", "gpu"};
+
+/**
+ * python_matches - the Python object holding the matches of one search.
+ *
+ * The arena's blocks are joined into one array the first time a buffer is
+ * asked for, unless the search filled a single block, which is then shared
+ * as it is.
+ */
+struct python_matches
+{
+	PyObject_HEAD
+	match_arena * arena;
+	std::vector<confusion_matrix> * joined;
+	Py_ssize_t shape[2];
+	Py_ssize_t strides[2];
+};
+
+bool read_python_query(PyObject *, PyObject *, batch_query &, search_engine &,
+		int &);
+bool read_engine(const char *, search_engine &);
+int thread_count_or_cores(int);
+PyObject * wrap_matches(match_arena &&);
+match_arena search_query(const batch_query &, search_engine, int);
+PyObject * python_search(PyObject *, PyObject *, PyObject *);
+PyObject * python_search_batch(PyObject *, PyObject *, PyObject *);
+void matches_dealloc(PyObject *);
+Py_ssize_t matches_length(PyObject *);
+PyObject * matches_item(PyObject *, Py_ssize_t);
+int matches_get_buffer(PyObject *, Py_buffer *, int);
+
+PyType_Slot MATCHES_SLOTS[] = {
+	{Py_tp_doc, (void *)"The matches of a search, as a read-only (N, 4) int64 "
+		"buffer of TP, FN, FP and TN."},
+	{Py_tp_dealloc, (void *)matches_dealloc},
+	{Py_sq_length, (void *)matches_length},
+	{Py_sq_item, (void *)matches_item},
+	{Py_bf_getbuffer, (void *)matches_get_buffer},
+	{0, NULL}
+};
+
+PyType_Spec MATCHES_SPEC = {
+	"_reverse_engineer.Matches", /* name */
+	sizeof(python_matches), /* basicsize */
+	0, /* itemsize */
+	Py_TPFLAGS_DEFAULT, /* flags */
+	MATCHES_SLOTS /* slots */
+};
+
+// The Matches type, made when the module is first imported.
+PyTypeObject * MATCHES_TYPE = NULL;
+
+PyMethodDef MODULE_METHODS[] = {
+	{"search", (PyCFunction)(void (*)(void))python_search,
+		METH_VARARGS | METH_KEYWORDS,
+		"search(class_a, class_b, decimal_places, accuracy, sensitivity=-1, "
+		"specificity=-1, f1=-1, precision=-1, engine='simd', threads=0)\n\n"
+		"Find every matrix matching the targets, in search order."},
+	{"search_batch", (PyCFunction)(void (*)(void))python_search_batch,
+		METH_VARARGS | METH_KEYWORDS,
+		"search_batch(queries, engine='simd', threads=0)\n\n"
+		"Search each (class_a, class_b, decimal_places, accuracy, sensitivity, "
+		"specificity, f1, precision) query in turn, returning a list of "
+		"Matches."},
+	{NULL, NULL, 0, NULL}
+};
+
+PyModuleDef MODULE = {
+	PyModuleDef_HEAD_INIT,
+	"_reverse_engineer", /* m_name */
+	"Reverse engineer confusion matrices from rounded metrics with the C++ "
+		"engines.", /* m_doc */
+	-1, /* m_size */
+	MODULE_METHODS, /* m_methods */
+	NULL, /* m_slots */
+	NULL, /* m_traverse */
+	NULL, /* m_clear */
+	NULL /* m_free */
+};
+
+/**
+ * PyInit__reverse_engineer - create the module.
+ *
+ * Returns
+ *   PyObject - the module, or NULL with an exception set
+ */
+PyMODINIT_FUNC PyInit__reverse_engineer()
+{
+	PyObject * module = PyModule_Create(&MODULE);
+	if (module == NULL)
+		return NULL;
+	MATCHES_TYPE = (PyTypeObject *)PyType_FromSpec(&MATCHES_SPEC);
+	if (MATCHES_TYPE == NULL || PyModule_AddObject(module, "Matches",
+				(PyObject *)MATCHES_TYPE) < 0)
+	{
+		Py_XDECREF(MATCHES_TYPE);
+		Py_DECREF(module);
+		return NULL;
+	}
+	Py_INCREF(MATCHES_TYPE);
+	return module;
+}
+
+/**
+ * python_search - the search function of the module.
+ *
+ * Parameters
+ *   PyObject - the module
+ *   PyObject - the positional arguments
+ *   PyObject - the keyword arguments
+ *
+ * Returns
+ *   PyObject - a Matches object, or NULL with an exception set
+ */
+PyObject * python_search(PyObject *, PyObject * args, PyObject * kwargs)
+{
+	batch_query query;
+	search_engine engine;
+	int threads;
+	if (!read_python_query(args, kwargs, query, engine, threads))
+		return NULL;
+
+	match_arena arena;
+	Py_BEGIN_ALLOW_THREADS
+	arena = search_query(query, engine, threads);
+	Py_END_ALLOW_THREADS
+	return wrap_matches(std::move(arena));
+}
+
+/**
+ * python_search_batch - the search_batch function of the module.
+ *
+ * Every query is read before any is searched, and all of them are searched
+ * in one stretch without the GIL.
+ *
+ * Parameters
+ *   PyObject - the module
+ *   PyObject - the positional arguments
+ *   PyObject - the keyword arguments
+ *
+ * Returns
+ *   PyObject - a list of Matches objects, or NULL with an exception set
+ */
+PyObject * python_search_batch(PyObject *, PyObject * args, PyObject * kwargs)
+{
+	const char * keywords[] = {"queries", "engine", "threads", NULL};
+	PyObject * list;
+	const char * engine_name = "simd";
+	int threads = 0;
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|si", (char **)keywords,
+				&list, &engine_name, &threads))
+		return NULL;
+	search_engine engine;
+	if (!read_engine(engine_name, engine))
+		return NULL;
+
+	PyObject * sequence = PySequence_Fast(list, "queries must be a sequence");
+	if (sequence == NULL)
+		return NULL;
+	Py_ssize_t query_count = PySequence_Fast_GET_SIZE(sequence);
+	std::vector<batch_query> queries(query_count);
+	for (Py_ssize_t q = 0; q < query_count; q++)
+	{
+		PyObject * item = PySequence_Fast_GET_ITEM(sequence, q);
+		PyObject * fields = PySequence_Tuple(item);
+		search_engine unused_engine;
+		int unused_threads;
+		bool read = fields != NULL && read_python_query(fields, NULL, queries[q],
+				unused_engine, unused_threads);
+		Py_XDECREF(fields);
+		if (!read)
+		{
+			Py_DECREF(sequence);
+			return NULL;
+		}
+		queries[q].line = (int)q;
+	}
+	Py_DECREF(sequence);
+
+	std::vector<match_arena> results(query_count);
+	Py_BEGIN_ALLOW_THREADS
+	for (Py_ssize_t q = 0; q < query_count; q++)
+		results[q] = search_query(queries[q], engine, threads);
+	Py_END_ALLOW_THREADS
+
+	PyObject * matches = PyList_New(query_count);
+	if (matches == NULL)
+		return NULL;
+	for (Py_ssize_t q = 0; q < query_count; q++)
+	{
+		PyObject * wrapped = wrap_matches(std::move(results[q]));
+		if (wrapped == NULL)
+		{
+			Py_DECREF(matches);
+			return NULL;
+		}
+		PyList_SET_ITEM(matches, q, wrapped);
+	}
+	return matches;
+}
+
+/**
+ * read_python_query - read the arguments of a query.
+ *
+ * Parameters
+ *   PyObject - the positional arguments
+ *   PyObject - the keyword arguments, or NULL
+ *   batch_query - set to the query
+ *   search_engine - set to the engine to search with
+ *   int - set to the number of worker threads
+ *
+ * Returns
+ *   bool - false, with an exception set, if the arguments are invalid
+ */
+bool read_python_query(
+		PyObject * args,
+		PyObject * kwargs,
+		batch_query & query,
+		search_engine & engine,
+		int & threads
+		)
+{
+	const char * keywords[] = {"class_a", "class_b", "decimal_places",
+		"accuracy", "sensitivity", "specificity", "f1", "precision", "engine",
+		"threads", NULL};
+	const char * engine_name = "simd";
+	query.line = 0;
+	query.target_sensitivity = -1;
+	query.target_specificity = -1;
+	query.target_f1 = -1;
+	query.target_precision = -1;
+	threads = 0;
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "LLid|ddddsi",
+				(char **)keywords, &query.class_a_count, &query.class_b_count,
+				&query.decimal_places, &query.target_accuracy,
+				&query.target_sensitivity, &query.target_specificity,
+				&query.target_f1, &query.target_precision, &engine_name, &threads))
+		return false;
+	if (!valid_batch_query(query))
+	{
+		PyErr_SetString(PyExc_ValueError, "class counts must be at least 1, "
+				"decimal places from 0 to 18, the accuracy from 0 to 1 and the "
+				"other targets from 0 to 1 or -1");
+		return false;
+	}
+	if (threads < 0)
+	{
+		PyErr_SetString(PyExc_ValueError, "threads must not be negative");
+		return false;
+	}
+	return read_engine(engine_name, engine);
+}
+
+/**
+ * read_engine - look up an engine by name.
+ *
+ * Parameters
+ *   const char * - the name of the engine
+ *   search_engine - set to the engine
+ *
+ * Returns
+ *   bool - false, with an exception set, if there is no such engine
+ */
+bool read_engine(const char * name, search_engine & engine)
+{
+	for (int e = 0; e <= ENGINE_GPU; e++)
+		if (strcmp(name, PYTHON_ENGINE_NAMES[e]) == 0)
+		{
+			engine = (search_engine)e;
+			return true;
+		}
+	PyErr_Format(PyExc_ValueError, "unknown engine: %s", name);
+	return false;
+}
+
+/**
+ * thread_count_or_cores - the number of worker threads to search with.
+ *
+ * Parameters
+ *   int - the number asked for, 0 for every core
+ *
+ * Returns
+ *   int - the number of worker threads
+ */
+int thread_count_or_cores(int threads)
+{
+	if (threads == 0)
+		return (int)std::max(1u, std::thread::hardware_concurrency());
+	return threads;
+}
+
+/**
+ * search_query - search one query into an arena. Called without the GIL.
+ *
+ * Parameters
+ *   batch_query - the query
+ *   search_engine - the strategy used to search the diagonals
+ *   int - the number of worker threads, 0 for every core
+ *
+ * Returns
+ *   match_arena - the matches, in search order
+ */
+match_arena search_query(const batch_query & query, search_engine engine,
+		int threads)
+{
+	target_ranges ranges = exact_targets(query.target_accuracy,
+			query.target_sensitivity, query.target_specificity, query.target_f1,
+			query.target_precision);
+	return collect_matrices(query.class_a_count, query.class_b_count,
+			query.decimal_places, ranges, engine, thread_count_or_cores(threads));
+}
+
+/**
+ * wrap_matches - make a Matches object owning an arena.
+ *
+ * Parameters
+ *   match_arena - the matches, moved into the object
+ *
+ * Returns
+ *   PyObject - the Matches object, or NULL with an exception set
+ */
+PyObject * wrap_matches(match_arena && arena)
+{
+	python_matches * matches = PyObject_New(python_matches, MATCHES_TYPE);
+	if (matches == NULL)
+		return NULL;
+	matches->joined = NULL;
+	matches->arena = new (std::nothrow) match_arena(std::move(arena));
+	if (matches->arena == NULL)
+	{
+		Py_DECREF(matches);
+		return PyErr_NoMemory();
+	}
+	matches->shape[0] = (Py_ssize_t)matches->arena->size();
+	matches->shape[1] = 4;
+	matches->strides[0] = sizeof(confusion_matrix);
+	matches->strides[1] = sizeof(count_int);
+	return (PyObject *)matches;
+}
+
+/**
+ * matches_dealloc - free a Matches object and its matches.
+ *
+ * Parameters
+ *   PyObject - the Matches object
+ */
+void matches_dealloc(PyObject * self)
+{
+	python_matches * matches = (python_matches *)self;
+	PyTypeObject * type = Py_TYPE(self);
+	delete matches->joined;
+	delete matches->arena;
+	PyObject_Free(self);
+	Py_DECREF(type);
+}
+
+/**
+ * matches_length - the number of matches, for len().
+ *
+ * Parameters
+ *   PyObject - the Matches object
+ *
+ * Returns
+ *   Py_ssize_t - the number of matches
+ */
+Py_ssize_t matches_length(PyObject * self)
+{
+	return ((python_matches *)self)->shape[0];
+}
+
+/**
+ * matches_item - one match as a (TP, FN, FP, TN) tuple.
+ *
+ * Parameters
+ *   PyObject - the Matches object
+ *   Py_ssize_t - the index of the match
+ *
+ * Returns
+ *   PyObject - the tuple, or NULL with an IndexError set
+ */
+PyObject * matches_item(PyObject * self, Py_ssize_t index)
+{
+	python_matches * matches = (python_matches *)self;
+	if (index < 0 || index >= matches->shape[0])
+	{
+		PyErr_SetString(PyExc_IndexError, "match index out of range");
+		return NULL;
+	}
+
+	// Walk the blocks, which are few, to the one holding the match.
+	size_t offset = (size_t)index;
+	size_t chunk = 0;
+	while (offset >= matches->arena->chunk_size(chunk))
+		offset -= matches->arena->chunk_size(chunk++);
+	const confusion_matrix & matrix = matches->arena->chunk_data(chunk)[offset];
+	return Py_BuildValue("(LLLL)", matrix.tp, matrix.fn, matrix.fp, matrix.tn);
+}
+
+/**
+ * matches_get_buffer - expose the matches as a read-only (N, 4) int64
+ * buffer.
+ *
+ * Parameters
+ *   PyObject - the Matches object
+ *   Py_buffer - set to the buffer
+ *   int - the PyBUF flags of the request
+ *
+ * Returns
+ *   int - 0, or -1 with an exception set
+ */
+int matches_get_buffer(PyObject * self, Py_buffer * view, int flags)
+{
+	python_matches * matches = (python_matches *)self;
+	if ((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE)
+	{
+		PyErr_SetString(PyExc_BufferError, "matches are read-only");
+		return -1;
+	}
+
+	const match_arena & arena = *matches->arena;
+	const confusion_matrix * data = NULL;
+	size_t used_chunks = 0;
+	for (size_t c = 0; c < arena.chunk_count(); c++)
+		if (arena.chunk_size(c) != 0)
+		{
+			data = arena.chunk_data(c);
+			used_chunks++;
+		}
+	if (used_chunks > 1)
+	{
+		if (matches->joined == NULL)
+		{
+			matches->joined = new (std::nothrow) std::vector<confusion_matrix>();
+			if (matches->joined == NULL)
+			{
+				PyErr_NoMemory();
+				return -1;
+			}
+			matches->joined->reserve(arena.size());
+			for (size_t c = 0; c < arena.chunk_count(); c++)
+				matches->joined->insert(matches->joined->end(), arena.chunk_data(c),
+						arena.chunk_data(c) + arena.chunk_size(c));
+		}
+		data = matches->joined->data();
+	}
+
+	// The buffer must not be NULL, even when there are no matches.
+	static confusion_matrix empty;
+	view->buf = (void *)(data != NULL ? data : &empty);
+	view->obj = self;
+	Py_INCREF(self);
+	view->len = matches->shape[0] * (Py_ssize_t)sizeof(confusion_matrix);
+	view->readonly = 1;
+	view->itemsize = sizeof(count_int);
+	view->format = (flags & PyBUF_FORMAT) ? (char *)"q" : NULL;
+	view->ndim = 2;
+	view->shape = (flags & PyBUF_ND) ? matches->shape : NULL;
+	view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ?
+		matches->strides : NULL;
+	view->suboffsets = NULL;
+	view->internal = NULL;
+	return 0;
+}
@@ -1,8 +1,7 @@
 /**
  * CPP file to reverse engineer all possible matrices from output metrics.
  *
- * To exclude the optional parameters, set them to -1 in the main method.
- * 
+ * The command line front end is in main.cpp.
  */
 #include <iostream>
 #include <cassert>
@@ -13,114 +12,478 @@
 #include <array>
 #include <fstream>
 #include <cstdio>
+#include <algorithm>
+#include <string>
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <cerrno>
+#include <utility>
+#include <memory>
+#include <map>
+#include <tuple>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <signal.h>
+#include "reverse_engineer.hpp"
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+#ifdef SEARCH_STATS
+#include <chrono>
+#endif
 
-void reverse_engineer_confusion_matrices(int, int, int,
-		double, double, double, double, double);
-int * find_positives_vs_negatives(int, double, int);
-double round_dp(double,int);
-void find_matrices(int, int, int *, double, double,
-		double, double, double, int);
-bool check_metric(double, double, double, double, double, double, double,
-		double, int);
-
-/**
- * Main method
- *
- * Adjust the values in the modifiers to your target
- */
-int main(){
-	////////////// MODIFIERS//////////////
-	const int DECIMAL_PLACES = 2;
-	const int CLASS_A_COUNT = 981;
-	const int CLASS_B_COUNT = 981;
-	const double TARGET_ACCURACY = 0.75;
-
-	// Optional modifiers - set to -1 if not needed.
-	const double TARGET_SENSITIVITY = 0.86;
-	const double TARGET_SPECIFICITY = 0.64;
-	const double TARGET_F1 = 0.77;
-	const double TARGET_PRECISION = 0.71;
-	//////////////////////////////////////
-
-	// Assertions..
-	assert(DECIMAL_PLACES >= 0);
-	assert(CLASS_A_COUNT && CLASS_B_COUNT > 0);
-	assert(TARGET_ACCURACY >= 0 && TARGET_ACCURACY <= 1);
-	assert((TARGET_SENSITIVITY >= 0 && TARGET_SENSITIVITY <= 1) ||
-			TARGET_SENSITIVITY == -1);
-	assert((TARGET_SPECIFICITY >= 0 && TARGET_SPECIFICITY <= 1) ||
-			TARGET_SPECIFICITY == -1);
-	assert((TARGET_F1 >= 0 && TARGET_F1 <= 1) || TARGET_F1 == -1);
-	assert((TARGET_PRECISION >= 0 && TARGET_PRECISION <= 1) ||
-			TARGET_PRECISION == -1);
-
-	// Trigger main workload
-	reverse_engineer_confusion_matrices(
-			CLASS_A_COUNT,
-			CLASS_B_COUNT,
-			DECIMAL_PLACES,
-			TARGET_ACCURACY,
-			TARGET_SENSITIVITY,
-			TARGET_SPECIFICITY,
-			TARGET_F1,
-			TARGET_PRECISION);
+#ifdef SEARCH_STATS
+/**
+ * stats_counters - the search counters of one thread, added to the totals
+ * at the end of every run of diagonals so the hot path stays thread local.
+ */
+struct stats_counters
+{
+	uint64_t combinations;
+	uint64_t candidates;
+	uint64_t pruned;
+	uint64_t rejected[5];
+	uint64_t matches;
+};
 
-	return(0);
-}
+/**
+ * stats_totals - the counters and phase timings of every thread.
+ */
+struct stats_totals
+{
+	std::atomic<uint64_t> combinations;
+	std::atomic<uint64_t> candidates;
+	std::atomic<uint64_t> pruned;
+	std::atomic<uint64_t> rejected[5];
+	std::atomic<uint64_t> matches;
+	std::atomic<uint64_t> bytes_written;
+	std::atomic<uint64_t> solve_ns;
+	std::atomic<uint64_t> search_ns;
+	std::atomic<uint64_t> output_ns;
+};
+
+thread_local stats_counters thread_stats;
+stats_totals stats;
+void stats_flush();
+
+// Add to a counter of the calling thread.
+#define STATS_ADD(counter, value) (thread_stats.counter += (uint64_t)(value))
+// Add to a shared total directly, outside the search loops.
+#define STATS_TOTAL(total, value) (stats.total += (uint64_t)(value))
+// Start a phase timer.
+#define STATS_TIMER(timer) \
+	std::chrono::steady_clock::time_point timer = std::chrono::steady_clock::now()
+// Add the time since a timer started to a phase total.
+#define STATS_ELAPSED(total, timer) STATS_TOTAL(total, \
+		std::chrono::duration_cast<std::chrono::nanoseconds>( \
+			std::chrono::steady_clock::now() - timer).count())
+#define STATS_FLUSH() stats_flush()
+#else
+#define STATS_ADD(counter, value) ((void)0)
+#define STATS_TOTAL(total, value) ((void)0)
+#define STATS_TIMER(timer) ((void)0)
+#define STATS_ELAPSED(total, timer) ((void)0)
+#define STATS_FLUSH() ((void)0)
+#endif
+
+// Signatures of the per-mask specialisations of check_metric and
+// check_metric_batch.
+typedef bool (*metric_check)(count_int, count_int, count_int, count_int,
+		const metric_targets &);
+typedef uint64_t (*metric_batch_check)(const int *, const int *, int, int,
+		int, const metric_targets &);
+
+// Signature of the per count type, decimal place and metric mask
+// specialisations of search_diagonals.
+typedef void (*diagonal_search)(const search_context &, count_int, count_int,
+		result_sink &);
+
+typedef std::array<diagonal_search, METRIC_ALL + 1> diagonal_search_row;
+
+// Decimal places 0 to this limit get a search specialised on their scale,
+// more decimal places use the runtime scale.
+const int SPECIALISED_DECIMAL_PLACES = 6;
+
+double round_dp(double,int);
+constexpr long long power_of_ten(int);
+wide_int ceil_div(wide_int, long long);
+int rounded_ratio(long long, long long, long long);
+bool read_json_query(const std::string &, batch_query &, std::string &,
+		count_int &, count_int &);
+template <typename COUNT, int DP, unsigned MASK>
+void search_diagonals_fixed(const search_context &, count_int, count_int,
+		result_sink &);
+void search_diagonals_rounded(const search_context &, count_int, count_int,
+		result_sink &);
+void search_diagonals_gpu(const search_context &, count_int, count_int,
+		result_sink &);
+void search_context_limited(const search_context &, count_int, int,
+		result_sink &);
+void pipeline_chunk_bounds(const search_context &, count_int, int,
+		std::vector<count_int> &);
+void write_chunks_in_order(int, int, int,
+		const std::function<std::unique_ptr<result_sink>(int)> &, result_sink &);
+void class_split_range(count_int, const accuracy_band &,
+		const metric_targets &, count_int &, count_int &);
+bool split_feasible(count_int, count_int, const accuracy_band &,
+		const metric_targets &);
+template <typename COUNT>
+void diagonal_tp_range(const search_context &, COUNT, COUNT &, COUNT &);
+template <unsigned MASK, int DP = -1>
+bool check_metric_masked(count_int, count_int, count_int, count_int,
+		const metric_targets &);
+bool check_metric_rounded(double, double, double, double, double, double,
+		double, double, int);
+bool ratio_in_band(long long, long long, const metric_band &, long long);
+uint64_t check_metric_batch(const int *, const int *, int, int, int,
+		const metric_targets &);
+template <typename COUNT, unsigned MASK, int DP = -1>
+uint64_t check_metric_batch_masked(const COUNT *, const COUNT *, int, COUNT,
+		COUNT, const metric_targets &);
+extern const metric_check METRIC_CHECKS[METRIC_ALL + 1];
+extern const metric_batch_check METRIC_BATCH_CHECKS[METRIC_ALL + 1];
+extern const diagonal_search_row
+	DIAGONAL_SEARCHES[2][SPECIALISED_DECIMAL_PLACES + 2];
 
 /**
  * reverse_engineer_confusion_matrix - Extract all possible confusion matrices
  * that meet the following criteria.
  *
- * Output is dumped to a csv file in the project data folder.
+ * Output is dumped to a csv or binary file, in the project data folder by
+ * default.
  *
  * Parameters
- *   int - the class size of class A
- *   int - the class size of class B
+ *   count_int - the class size of class A
+ *   count_int - the class size of class B
  *   int - the number of decimal places to round to
  *   double - the target accuracy
  *   double - the target sensitivity
  *   double - the target specificity
  *   double - the target f1 score
  *   double - the target precision
+ *   search_engine - the strategy used to search the diagonals
+ *   int - the number of worker threads
+ *   output_format - the layout of the output file
+ *   const char * - the path of the output file
+ *   uint64_t - the most matches to write, 0 for all of them
  */
 void reverse_engineer_confusion_matrices(
-		int class_a_count,
-		int class_b_count,
+		count_int class_a_count,
+		count_int class_b_count,
 		int decimal_places,
 		double target_accuracy,
 		double target_sensitivity,
 		double target_specificity,
 		double target_f1,
-		double target_precision
+		double target_precision,
+		search_engine engine,
+		int thread_count,
+		output_format format,
+		const char * output_path,
+		uint64_t match_limit
+		)
+{
+	reverse_engineer_confusion_matrices(class_a_count, class_b_count,
+			decimal_places, exact_targets(target_accuracy, target_sensitivity,
+			target_specificity, target_f1, target_precision), engine,
+			thread_count, format, output_path, match_limit);
+}
+
+/**
+ * reverse_engineer_confusion_matrices - reverse_engineer_confusion_matrices
+ * for ranges of targets under a set of rounding modes.
+ *
+ * Parameters
+ *   count_int - the class size of class A
+ *   count_int - the class size of class B
+ *   int - the number of decimal places to round to
+ *   target_ranges - the target ranges and rounding modes
+ *   search_engine - the strategy used to search the diagonals
+ *   int - the number of worker threads
+ *   output_format - the layout of the output file
+ *   const char * - the path of the output file
+ *   uint64_t - the most matches to write, 0 for all of them
+ */
+void reverse_engineer_confusion_matrices(
+		count_int class_a_count,
+		count_int class_b_count,
+		int decimal_places,
+		const target_ranges & ranges,
+		search_engine engine,
+		int thread_count,
+		output_format format,
+		const char * output_path,
+		uint64_t match_limit
 		)
 {
-	int total_sample_size = class_a_count + class_b_count;
+	count_int total_sample_size = class_a_count + class_b_count;
 
 	// Extract the min max values for correct vs incorrect.
-	int * min_max_values = find_positives_vs_negatives(
+	STATS_TIMER(solve_start);
+	accuracy_band band = find_accuracy_band(
 			total_sample_size,
-			target_accuracy,
-			decimal_places);
+			ranges.accuracy,
+			decimal_places,
+			ranges.rounding);
+	STATS_ELAPSED(solve_ns, solve_start);
 
 	// No combinations exit
-	if (*(min_max_values) == -1)
+	if (!band.feasible)
 	{
 		std::cout << "There are no combinations that can achieve this accuracy." <<
 			std::endl;
-		exit(0);
+		return;
 	}
 
 	// Calculate each of the matrices that are possible
-	find_matrices(class_a_count, class_b_count, min_max_values,
+	find_matrices(class_a_count, class_b_count, band, ranges, decimal_places,
+			engine, thread_count, format, output_path, match_limit);
+}
+
+/**
+ * reverse_engineer_class_splits - Extract all possible confusion matrices of
+ * a total sample size, over every split into class A and class B, that meet
+ * the targets.
+ *
+ * Output is dumped to a csv file, in the project data folder by default.
+ * The class A count of a row is its TP + FN.
+ *
+ * Parameters
+ *   count_int - the total sample size
+ *   int - the number of decimal places to round to
+ *   double - the target accuracy
+ *   double - the target sensitivity
+ *   double - the target specificity
+ *   double - the target f1 score
+ *   double - the target precision
+ *   search_engine - the strategy used to search the diagonals
+ *   int - the number of worker threads
+ *   const char * - the path of the output file
+ */
+void reverse_engineer_class_splits(
+		count_int total_sample_size,
+		int decimal_places,
+		double target_accuracy,
+		double target_sensitivity,
+		double target_specificity,
+		double target_f1,
+		double target_precision,
+		search_engine engine,
+		int thread_count,
+		const char * output_path
+		)
+{
+	int fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1)
+	{
+		std::cerr << "Failed to open the output file." << std::endl;
+		exit(1);
+	}
+
+	// The csv rows only need the targets of the context.
+	search_context context = search_context();
+	context.target_accuracy = target_accuracy;
+	context.target_sensitivity = target_sensitivity;
+	context.target_specificity = target_specificity;
+	context.target_f1 = target_f1;
+	context.target_precision = target_precision;
+	match_sink file(context, FORMAT_CSV, fd);
+	file.begin();
+	if (!search_class_splits(total_sample_size, decimal_places,
 			target_accuracy, target_sensitivity, target_specificity, target_f1,
-			target_precision, decimal_places);
+			target_precision, engine, thread_count, file))
+		std::cout << "There are no combinations that can achieve this accuracy." <<
+			std::endl;
+	file.finish();
+	close(fd);
+}
+
+/**
+ * power_of_ten - integer power of ten.
+ *
+ * Parameters
+ *   int - the exponent
+ *
+ * Returns
+ *   long long - 10 raised to the exponent
+ */
+constexpr long long power_of_ten(int exponent)
+{
+	return exponent <= 0 ? 1 : 10 * power_of_ten(exponent - 1);
 }
 
 /**
  * check_metric - check the current state of the confusion matrix against all
  * of the target values.
  *
+ * Each metric is tested exactly by cross-multiplying its ratio against the
+ * integer band of the target, so there are no divisions and no floating
+ * point rounding at the band edges. Only enabled metrics are tested.
+ *
+ * Parameters
+ *   count_int - TP
+ *   count_int - FN
+ *   count_int - FP
+ *   count_int - TN
+ *   metric_targets - the integer bands of the targets
+ *
+ * Returns
+ *   bool - if the criteria is met or not
+ */
+bool check_metric(
+		count_int TP,
+		count_int FN,
+		count_int FP,
+		count_int TN,
+		const metric_targets & targets
+		)
+{
+	return METRIC_CHECKS[targets.mask & METRIC_ALL](TP, FN, FP, TN, targets);
+}
+
+/**
+ * check_metric_masked - check_metric specialised for one set of enabled
+ * metrics.
+ *
+ * Disabled metrics compile away, and the rest are tested cheapest first,
+ * returning on the first failure. Sensitivity and specificity have a fixed
+ * denominator, and precision is cheaper than F1. When DP is not -1 the
+ * decimal scale is a compile time constant.
+ *
+ * Parameters
+ *   count_int - TP
+ *   count_int - FN
+ *   count_int - FP
+ *   count_int - TN
+ *   metric_targets - the integer bands of the targets
+ *
+ * Returns
+ *   bool - if the criteria of every metric in MASK is met or not
+ */
+template <unsigned MASK, int DP>
+bool check_metric_masked(
+		count_int TP,
+		count_int FN,
+		count_int FP,
+		count_int TN,
+		const metric_targets & targets
+		)
+{
+	const long long twice_scale = DP < 0 ? targets.twice_scale :
+		2 * power_of_ten(DP);
+	if ((MASK & METRIC_SENSITIVITY) && !ratio_in_band(TP, TP + FN,
+				targets.sensitivity, twice_scale))
+		return false;
+	if ((MASK & METRIC_SPECIFICITY) && !ratio_in_band(TN, TN + FP,
+				targets.specificity, twice_scale))
+		return false;
+	if ((MASK & METRIC_PRECISION) && !ratio_in_band(TP, TP + FP,
+				targets.precision, twice_scale))
+		return false;
+	if ((MASK & METRIC_F1) && !ratio_in_band(2 * TP, 2 * TP + FP + FN,
+				targets.f1, twice_scale))
+		return false;
+	return true;
+}
+
+#ifdef SEARCH_STATS
+/**
+ * stats_reject - count a cell check_metric_masked rejected against the first
+ * metric it fails, in the order check_metric_masked tests them.
+ *
+ * Parameters
+ *   count_int - TP
+ *   count_int - FN
+ *   count_int - FP
+ *   count_int - TN
+ *   metric_targets - the integer bands of the targets
+ */
+template <unsigned MASK, int DP>
+void stats_reject(
+		count_int TP,
+		count_int FN,
+		count_int FP,
+		count_int TN,
+		const metric_targets & targets
+		)
+{
+	const long long twice_scale = DP < 0 ? targets.twice_scale :
+		2 * power_of_ten(DP);
+	if ((MASK & METRIC_SENSITIVITY) && !ratio_in_band(TP, TP + FN,
+				targets.sensitivity, twice_scale))
+		STATS_ADD(rejected[0], 1);
+	else if ((MASK & METRIC_SPECIFICITY) && !ratio_in_band(TN,
+				TN + FP, targets.specificity, twice_scale))
+		STATS_ADD(rejected[1], 1);
+	else if ((MASK & METRIC_PRECISION) && !ratio_in_band(TP,
+				TP + FP, targets.precision, twice_scale))
+		STATS_ADD(rejected[2], 1);
+	else
+		STATS_ADD(rejected[3], 1);
+}
+#endif
+
+// check_metric_masked for every metric mask, indexed by the mask.
+const metric_check METRIC_CHECKS[METRIC_ALL + 1] = {
+	check_metric_masked<0>, check_metric_masked<1>,
+	check_metric_masked<2>, check_metric_masked<3>,
+	check_metric_masked<4>, check_metric_masked<5>,
+	check_metric_masked<6>, check_metric_masked<7>,
+	check_metric_masked<8>, check_metric_masked<9>,
+	check_metric_masked<10>, check_metric_masked<11>,
+	check_metric_masked<12>, check_metric_masked<13>,
+	check_metric_masked<14>, check_metric_masked<15>
+};
+
+/**
+ * ratio_in_band - check if a ratio rounds into a target band.
+ *
+ * A zero denominator never matches, as the ratio is undefined, so the upper
+ * offset is capped at the denominator to keep the upper test strict there.
+ *
+ * Parameters
+ *   long long - the numerator of the ratio
+ *   long long - the denominator of the ratio
+ *   metric_band - the integer band of the target
+ *   long long - twice the decimal scale, 2 * 10^dp
+ *
+ * Returns
+ *   bool - if lower * d + lower_offset <= n * twice_scale <
+ *          upper * d + upper_offset
+ */
+inline bool ratio_in_band(
+		long long numerator,
+		long long denominator,
+		const metric_band & band,
+		long long twice_scale
+		)
+{
+	wide_int scaled = (wide_int)numerator * twice_scale;
+	return (wide_int)band.lower * denominator + band.lower_offset <= scaled &&
+		scaled < (wide_int)band.upper * denominator +
+		std::min(denominator, band.upper_offset);
+}
+
+/**
+ * check_metric_rounded - check the current state of the confusion matrix
+ * against all of the target values by comparing round_dp results.
+ *
+ * Floating point ratios can land either side of a rounding boundary, so
+ * this may disagree with check_metric on exact ties. It is kept to
+ * reproduce the output of the Python version.
+ *
  * Parameters
  *   double - casted double version of TP for more mathematical accuracy
  *   double - casted double version of FN for more mathematical accuracy
@@ -135,7 +498,7 @@ void reverse_engineer_confusion_matrices(
  * Returns
  *   bool - if the criteria is met or not
  */
-bool check_metric(
+bool check_metric_rounded(
 		double TP,
 		double FN,
 		double FP,
@@ -147,146 +510,4579 @@ bool check_metric(
 		int decimal_places
 		)
 {
-	bool meets_criteria = true;
+	// Cycle through each of the enabled metrics, calc and check against the
+	// targets
+	if (target_sensitivity != -1 &&
+			round_dp(TP/(TP+FN), decimal_places) != target_sensitivity)
+	{
+		STATS_ADD(rejected[0], 1);
+		return false;
+	}
+	if (target_specificity != -1 &&
+			round_dp(TN/(TN+FP), decimal_places) != target_specificity)
+	{
+		STATS_ADD(rejected[1], 1);
+		return false;
+	}
+	if (target_precision != -1 &&
+			round_dp(TP/(TP+FP), decimal_places) != target_precision)
+	{
+		STATS_ADD(rejected[2], 1);
+		return false;
+	}
+	if (target_f1 != -1 &&
+			round_dp(2*TP/(2*TP+FP+FN), decimal_places) != target_f1)
+	{
+		STATS_ADD(rejected[3], 1);
+		return false;
+	}
+	return true;
+}
 
-	// Cycle through each of the metrics, calc and check against the targets
-	if (round_dp(TP/(TP+FN), decimal_places) != target_sensitivity || target_sensitivity == -1)
-		meets_criteria = false;
-	if (round_dp(TN/(TN+FP), decimal_places) != target_specificity || target_specificity == -1)
-		meets_criteria = false;
-	if (round_dp(2*TP/(2*TP+FP+FN), decimal_places) != target_f1 || target_f1 == -1)
-		meets_criteria = false;
-	if (round_dp(TP/(TP+FP), decimal_places) != target_precision || target_precision == -1)
-		meets_criteria = false;
-	return meets_criteria;
+#if defined(__AVX512F__)
+/**
+ * band_contains_pd - the integer band test of ratio_in_band on every lane.
+ *
+ * The lanes hold integers and check_metric_batch only vectorises when every
+ * product stays below 2^53, so the double arithmetic is exact. The minimum
+ * is zero-masked on all lanes, which keeps GCC from warning about the
+ * undefined source vector of _mm512_min_pd.
+ */
+static inline __mmask8 band_contains_pd(__m512d numerator,
+		__m512d denominator, const metric_band & band, __m512d twice_scale)
+{
+	__m512d scaled = _mm512_mul_pd(numerator, twice_scale);
+	__mmask8 above = _mm512_cmp_pd_mask(_mm512_add_pd(
+				_mm512_mul_pd(_mm512_set1_pd((double)band.lower), denominator),
+				_mm512_set1_pd((double)band.lower_offset)), scaled, _CMP_LE_OQ);
+	__mmask8 below = _mm512_cmp_pd_mask(scaled, _mm512_add_pd(
+				_mm512_mul_pd(_mm512_set1_pd((double)band.upper), denominator),
+				_mm512_maskz_min_pd(0xff, denominator,
+					_mm512_set1_pd((double)band.upper_offset))), _CMP_LT_OQ);
+	return above & below;
+}
+#elif defined(__AVX2__)
+/**
+ * band_contains_pd - the integer band test of ratio_in_band on every lane.
+ *
+ * The lanes hold integers and check_metric_batch only vectorises when every
+ * product stays below 2^53, so the double arithmetic is exact.
+ */
+static inline __m256d band_contains_pd(__m256d numerator,
+		__m256d denominator, const metric_band & band, __m256d twice_scale)
+{
+	__m256d scaled = _mm256_mul_pd(numerator, twice_scale);
+	__m256d above = _mm256_cmp_pd(_mm256_add_pd(
+				_mm256_mul_pd(_mm256_set1_pd((double)band.lower), denominator),
+				_mm256_set1_pd((double)band.lower_offset)), scaled, _CMP_LE_OQ);
+	__m256d below = _mm256_cmp_pd(scaled, _mm256_add_pd(
+				_mm256_mul_pd(_mm256_set1_pd((double)band.upper), denominator),
+				_mm256_min_pd(denominator,
+					_mm256_set1_pd((double)band.upper_offset))), _CMP_LT_OQ);
+	return _mm256_and_pd(above, below);
 }
+#endif
 
 /**
- * find_matrices - extract all of the matrices that fit the accuracy criteria.
+ * check_metric_batch - check a batch of matrices against all of the target
+ * values at once.
+ *
+ * The batch is evaluated with AVX-512 or AVX2 when the compiler targets them
+ * (e.g. -march=native), with a scalar tail and fallback. The vector lanes run
+ * the integer band tests of check_metric in double arithmetic, which is exact
+ * while 2N * (2 * 10^dp + 2) < 2^53; larger searches use check_metric.
  *
  * Parameters
+ *   const int * - TP of each matrix
+ *   const int * - TN of each matrix
+ *   int - the number of matrices, at most METRIC_BATCH
  *   int - count of items in class A
  *   int - count of items in class B
- *   int * - the pointer to the min/max values array
+ *   metric_targets - the integer bands of the targets
+ *
+ * Returns
+ *   uint64_t - bit k is set if matrix k meets the criteria
+ */
+uint64_t check_metric_batch(
+		const int * TP,
+		const int * TN,
+		int count,
+		int class_a_count,
+		int class_b_count,
+		const metric_targets & targets
+		)
+{
+	return METRIC_BATCH_CHECKS[targets.mask & METRIC_ALL](TP, TN, count,
+			class_a_count, class_b_count, targets);
+}
+
+/**
+ * check_metric_batch_masked - check_metric_batch specialised for one set of
+ * enabled metrics, so the lanes only evaluate the metrics in MASK. When DP
+ * is not -1 the decimal scale is a compile time constant. The lanes load
+ * 32-bit counts, so batches of 64-bit counts are checked one at a time.
+ *
+ * Parameters
+ *   const COUNT * - TP of each matrix
+ *   const COUNT * - TN of each matrix
+ *   int - the number of matrices, at most METRIC_BATCH
+ *   COUNT - count of items in class A
+ *   COUNT - count of items in class B
+ *   metric_targets - the integer bands of the targets
+ *
+ * Returns
+ *   uint64_t - bit k is set if matrix k meets the criteria of MASK
+ */
+template <typename COUNT, unsigned MASK, int DP>
+uint64_t check_metric_batch_masked(
+		const COUNT * TP,
+		const COUNT * TN,
+		int count,
+		COUNT class_a_count,
+		COUNT class_b_count,
+		const metric_targets & targets
+		)
+{
+	uint64_t matches = 0;
+
+	int k = 0;
+#if defined(__AVX512F__) || defined(__AVX2__)
+	const long long scale = DP < 0 ? targets.twice_scale : 2 * power_of_ten(DP);
+	const double EXACT_LIMIT = 9007199254740992.0;
+	int vector_count = count;
+	if (sizeof(COUNT) != sizeof(int32_t) ||
+			2.0 * ((double)class_a_count + class_b_count) * ((double)scale + 2) >=
+			EXACT_LIMIT)
+		vector_count = 0;
+#endif
+#if defined(__AVX512F__)
+	const __m512d twice_scale = _mm512_set1_pd((double)scale);
+	const __m512d class_a = _mm512_set1_pd((double)class_a_count);
+	const __m512d class_b = _mm512_set1_pd((double)class_b_count);
+	for (; k + 8 <= vector_count; k += 8)
+	{
+		// The zero-masked conversion keeps GCC from warning about the
+		// undefined source vector of the unmasked intrinsic.
+		__m512d tp = _mm512_maskz_cvtepi32_pd(0xff,
+				_mm256_loadu_si256((const __m256i *)(TP + k)));
+		__m512d tn = _mm512_maskz_cvtepi32_pd(0xff,
+				_mm256_loadu_si256((const __m256i *)(TN + k)));
+		__m512d fn = _mm512_sub_pd(class_a, tp);
+		__m512d fp = _mm512_sub_pd(class_b, tn);
+		__m512d two_tp = _mm512_add_pd(tp, tp);
+
+		__mmask8 lanes = 0xff;
+		if (MASK & METRIC_SENSITIVITY)
+			lanes &= band_contains_pd(tp, class_a, targets.sensitivity,
+					twice_scale);
+		if (MASK & METRIC_SPECIFICITY)
+			lanes &= band_contains_pd(tn, class_b, targets.specificity,
+					twice_scale);
+		if (MASK & METRIC_PRECISION)
+			lanes &= band_contains_pd(tp, _mm512_add_pd(tp, fp),
+					targets.precision, twice_scale);
+		if (MASK & METRIC_F1)
+			lanes &= band_contains_pd(two_tp,
+					_mm512_add_pd(_mm512_add_pd(two_tp, fp), fn), targets.f1,
+					twice_scale);
+		matches |= (uint64_t)lanes << k;
+	}
+#elif defined(__AVX2__)
+	const __m256d twice_scale = _mm256_set1_pd((double)scale);
+	const __m256d class_a = _mm256_set1_pd((double)class_a_count);
+	const __m256d class_b = _mm256_set1_pd((double)class_b_count);
+	for (; k + 4 <= vector_count; k += 4)
+	{
+		__m256d tp = _mm256_cvtepi32_pd(
+				_mm_loadu_si128((const __m128i *)(TP + k)));
+		__m256d tn = _mm256_cvtepi32_pd(
+				_mm_loadu_si128((const __m128i *)(TN + k)));
+		__m256d fn = _mm256_sub_pd(class_a, tp);
+		__m256d fp = _mm256_sub_pd(class_b, tn);
+		__m256d two_tp = _mm256_add_pd(tp, tp);
+
+		__m256d lanes = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+		if (MASK & METRIC_SENSITIVITY)
+			lanes = _mm256_and_pd(lanes, band_contains_pd(tp, class_a,
+						targets.sensitivity, twice_scale));
+		if (MASK & METRIC_SPECIFICITY)
+			lanes = _mm256_and_pd(lanes, band_contains_pd(tn, class_b,
+						targets.specificity, twice_scale));
+		if (MASK & METRIC_PRECISION)
+			lanes = _mm256_and_pd(lanes, band_contains_pd(tp,
+						_mm256_add_pd(tp, fp), targets.precision, twice_scale));
+		if (MASK & METRIC_F1)
+			lanes = _mm256_and_pd(lanes, band_contains_pd(two_tp,
+						_mm256_add_pd(_mm256_add_pd(two_tp, fp), fn), targets.f1,
+						twice_scale));
+		matches |= (uint64_t)_mm256_movemask_pd(lanes) << k;
+	}
+#endif
+
+	// Scalar tail, or the whole batch without vector support.
+	for (; k < count; k++)
+	{
+		if (check_metric_masked<MASK, DP>(TP[k], class_a_count - TP[k],
+					class_b_count - TN[k], TN[k], targets))
+			matches |= (uint64_t)1 << k;
+	}
+	return matches;
+}
+
+// check_metric_batch_masked for every metric mask, indexed by the mask.
+const metric_batch_check METRIC_BATCH_CHECKS[METRIC_ALL + 1] = {
+	check_metric_batch_masked<int, 0>, check_metric_batch_masked<int, 1>,
+	check_metric_batch_masked<int, 2>, check_metric_batch_masked<int, 3>,
+	check_metric_batch_masked<int, 4>, check_metric_batch_masked<int, 5>,
+	check_metric_batch_masked<int, 6>, check_metric_batch_masked<int, 7>,
+	check_metric_batch_masked<int, 8>, check_metric_batch_masked<int, 9>,
+	check_metric_batch_masked<int, 10>, check_metric_batch_masked<int, 11>,
+	check_metric_batch_masked<int, 12>, check_metric_batch_masked<int, 13>,
+	check_metric_batch_masked<int, 14>, check_metric_batch_masked<int, 15>
+};
+
+// Chunks of diagonals handed out per worker thread for each search.
+const int CHUNKS_PER_THREAD = 8;
+
+// Most chunks of a batch that may be searched ahead of the one being written.
+const int BATCH_PENDING_CHUNKS = 1024;
+
+// Most cells in a chunk of a pipelined search, which bounds the matches a
+// chunk buffers.
+const uint64_t PIPELINE_CHUNK_CELLS = 1 << 14;
+
+// Chunks of a pipelined search that each worker thread may have searched
+// ahead of the one being written.
+const int PIPELINE_PENDING_PER_THREAD = 4;
+
+// Matches in each block a match_arena adds as it fills up.
+const size_t ARENA_CHUNK_MATCHES = 1 << 12;
+
+// Most matches an arena_sink reserves room for up front.
+const size_t ARENA_RESERVE_LIMIT = 1 << 20;
+
+// Most cells handed to the GPU in one block, the default gpu_block_cells.
+const uint32_t GPU_BLOCK_CELLS = 1 << 24;
+
+/**
+ * find_matrices - extract all of the matrices that fit the accuracy criteria.
+ *
+ * Parameters
+ *   count_int - count of items in class A
+ *   count_int - count of items in class B
+ *   accuracy_band - the band of correct predictions meeting the accuracy
  *   double - the target accuracy
  *   double - the target sensitivity
  *   double - the target specificity
  *   double - the target f1 score
  *   double - the target precision
  *   int - the number of decimal places to round to
+ *   search_engine - the strategy used to search the diagonals
+ *   int - the number of worker threads
+ *   output_format - the layout of the output file
+ *   const char * - the path of the output file
+ *   uint64_t - the most matches to write, 0 for all of them
  */
 void find_matrices(
-		int class_a_count,
-		int class_b_count,
-		int * min_max_values,
+		count_int class_a_count,
+		count_int class_b_count,
+		const accuracy_band & band,
 		double target_accuracy,
 		double target_sensitivity,
 		double target_specificity,
 		double target_f1,
 		double target_precision,
-		int decimal_places
+		int decimal_places,
+		search_engine engine,
+		int thread_count,
+		output_format format,
+		const char * output_path,
+		uint64_t match_limit
 		)
 {
-	// Calculate the total number of combinations.
-	int combinations = 1;
-	if (*(min_max_values + 2) != -1)
-		combinations = *(min_max_values) - *(min_max_values + 2) + 1;
-
-	std::ofstream file;
-	file.open("../data/cpp_output2.csv");
-	file << "TP,FN,FP,TN,Accuracy,Sensitivity,Specificity,F1,Precision,\n";
-
-	// Calculate and store the matrices.
-	//std::vector<std::array<int,4>> matrices;
-	for (int i = 0; i < combinations; i++)
-	{
-		// Base matrix
-		int TP = class_a_count - i;
-		if ((*(min_max_values) - i) < class_a_count)
-			TP = *(min_max_values) - i;
-		int FN = class_a_count - TP;
-		int FP = *(min_max_values + 1) + i - FN;
-		int TN = class_b_count - FP;
-
-		if (check_metric((double)TP,(double)FN,(double)FP,(double)TN,
-					target_sensitivity, target_specificity, target_f1, target_precision,
-					decimal_places))
-		{
-			file << TP << "," << FN << "," << FP << "," << TN << ",";
-			file << target_accuracy << ",";
-			file << target_sensitivity << ",";
-			file << target_specificity << ",";
-			file << target_f1 << ",";
-			file << target_precision << ",\n";
-		}
+	find_matrices(class_a_count, class_b_count, band,
+			exact_targets(target_accuracy, target_sensitivity,
+			target_specificity, target_f1, target_precision), decimal_places,
+			engine, thread_count, format, output_path, match_limit);
+}
 
-		while (TP > 0 && TN < class_b_count)
-		{
-			--TP;
-			++FN;
-			--FP;
-			++TN;
+/**
+ * find_matrices - find_matrices for ranges of targets under a set of
+ * rounding modes.
+ *
+ * Parameters
+ *   count_int - count of items in class A
+ *   count_int - count of items in class B
+ *   accuracy_band - the band of correct predictions meeting the accuracy
+ *   target_ranges - the target ranges and rounding modes
+ *   int - the number of decimal places to round to
+ *   search_engine - the strategy used to search the diagonals
+ *   int - the number of worker threads
+ *   output_format - the layout of the output file
+ *   const char * - the path of the output file
+ *   uint64_t - the most matches to write, 0 for all of them
+ */
+void find_matrices(
+		count_int class_a_count,
+		count_int class_b_count,
+		const accuracy_band & band,
+		const target_ranges & ranges,
+		int decimal_places,
+		search_engine engine,
+		int thread_count,
+		output_format format,
+		const char * output_path,
+		uint64_t match_limit
+		)
+{
+	if (format == FORMAT_BINARY &&
+			(class_a_count > INT32_MAX || class_b_count > INT32_MAX))
+	{
+		std::cerr << "Binary output holds 32-bit counts, use varint for larger "
+			"classes." << std::endl;
+		exit(1);
+	}
 
-			if (check_metric((double)TP,(double)FN,(double)FP,(double)TN,
-						target_sensitivity, target_specificity, target_f1, target_precision,
-						decimal_places))
-			{
-				file << TP << "," << FN << "," << FP << "," << TN << ",";
-				file << target_accuracy << ",";
-				file << target_sensitivity << ",";
-				file << target_specificity << ",";
-				file << target_f1 << ",";
-				file << target_precision << ",\n";
-			}
-		}
+	STATS_TIMER(solve_start);
+	search_context context;
+	count_int combinations = make_search_context(class_a_count, class_b_count,
+			band, ranges, decimal_places, engine, context);
+	context.match_limit = match_limit;
+	STATS_ELAPSED(solve_ns, solve_start);
+
+	int fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1)
+	{
+		std::cerr << "Failed to open the output file." << std::endl;
+		exit(1);
 	}
-	file.close();
+	match_sink file(context, format, fd);
+	file.begin();
+	STATS_TIMER(search_start);
+	search_context_pipelined(context, combinations, thread_count, file);
+	STATS_ELAPSED(search_ns, search_start);
+	file.finish();
+	close(fd);
 }
 
 /**
- * find_positives_vs_negatives - Extract the minima and maxima correct and
- * incorrect predictions.
- *
- * These values will be used to determine the values to check.
+ * search_matrices - write every matrix meeting the targets to a sink.
  *
  * Parameters
- *   int - the total sample size
+ *   count_int - count of items in class A
+ *   count_int - count of items in class B
+ *   int - the number of decimal places to round to
  *   double - the target accuracy
- *   int - the total number of decimal places to round to
+ *   double - the target sensitivity
+ *   double - the target specificity
+ *   double - the target f1 score
+ *   double - the target precision
+ *   search_engine - the strategy used to search the diagonals
+ *   int - the number of worker threads
+ *   result_sink - the sink matches are written to
+ *   uint64_t - the most matches to write, 0 for all of them
  *
  * Returns
- *   int * - pointer to static array
- *           max correct, min incorrect, min correct, max incorrect.
+ *   bool - false if no combination can achieve the accuracy
  */
-int * find_positives_vs_negatives(
-		int total_sample_size,
+bool search_matrices(
+		count_int class_a_count,
+		count_int class_b_count,
+		int decimal_places,
 		double target_accuracy,
-		int decimal_places
+		double target_sensitivity,
+		double target_specificity,
+		double target_f1,
+		double target_precision,
+		search_engine engine,
+		int thread_count,
+		result_sink & sink,
+		uint64_t match_limit
 		)
 {
-	static int min_max_values[4] = {-1,-1,-1,-1};
+	return search_matrices(class_a_count, class_b_count, decimal_places,
+			exact_targets(target_accuracy, target_sensitivity,
+			target_specificity, target_f1, target_precision), engine,
+			thread_count, sink, match_limit);
+}
 
-	for(int i = total_sample_size; i > 0; i--)
+/**
+ * search_matrices - search_matrices for ranges of targets under a set of
+ * rounding modes.
+ *
+ * Parameters
+ *   count_int - count of items in class A
+ *   count_int - count of items in class B
+ *   int - the number of decimal places to round to
+ *   target_ranges - the target ranges and rounding modes
+ *   search_engine - the strategy used to search the diagonals
+ *   int - the number of worker threads
+ *   result_sink - the sink matches are written to
+ *   uint64_t - the most matches to write, 0 for all of them
+ *
+ * Returns
+ *   bool - false if no combination can achieve the accuracy
+ */
+bool search_matrices(
+		count_int class_a_count,
+		count_int class_b_count,
+		int decimal_places,
+		const target_ranges & ranges,
+		search_engine engine,
+		int thread_count,
+		result_sink & sink,
+		uint64_t match_limit
+		)
+{
+	STATS_TIMER(solve_start);
+	accuracy_band band = find_accuracy_band(class_a_count + class_b_count,
+			ranges.accuracy, decimal_places, ranges.rounding);
+	if (!band.feasible)
 	{
-		int correct_preds = i;
-		int incorrect_preds = total_sample_size - i;
-		double calculated_accuracy = (double)correct_preds / (double)total_sample_size;
+		STATS_ELAPSED(solve_ns, solve_start);
+		return false;
+	}
 
-		if(round_dp(calculated_accuracy, decimal_places) == target_accuracy)
-		{
-			if(min_max_values[0] == -1)
-			{
-				min_max_values[0] = correct_preds;
-				min_max_values[1] = incorrect_preds;
-			}
-			else
-			{
-				min_max_values[2] = correct_preds;
-				min_max_values[3] = incorrect_preds;
-			}
-		}
+	search_context context;
+	count_int combinations = make_search_context(class_a_count, class_b_count,
+			band, ranges, decimal_places, engine, context);
+	context.match_limit = match_limit;
+	STATS_ELAPSED(solve_ns, solve_start);
+
+	STATS_TIMER(search_start);
+	search_context_into(context, combinations, thread_count, sink);
+	STATS_ELAPSED(search_ns, search_start);
+	return true;
+}
+
+/**
+ * collect_matrices - search_matrices into memory, returning every match in
+ * a match_arena.
+ *
+ * The arena reserves room for the estimate_matches bound up front. A
+ * threaded search's chunks are copied into that block as they are appended,
+ * so when the bound fits under ARENA_RESERVE_LIMIT the matches end up in
+ * one contiguous block whatever the thread count, and the arena moves to
+ * the caller without a further copy.
+ *
+ * Parameters
+ *   count_int - count of items in class A
+ *   count_int - count of items in class B
+ *   int - the number of decimal places to round to
+ *   target_ranges - the target ranges and rounding modes
+ *   search_engine - the strategy used to search the diagonals
+ *   int - the number of worker threads
+ *
+ * Returns
+ *   match_arena - the matches in search order, empty if no combination can
+ *                 achieve the accuracy
+ */
+match_arena collect_matrices(
+		count_int class_a_count,
+		count_int class_b_count,
+		int decimal_places,
+		const target_ranges & ranges,
+		search_engine engine,
+		int thread_count
+		)
+{
+	STATS_TIMER(solve_start);
+	accuracy_band band = find_accuracy_band(class_a_count + class_b_count,
+			ranges.accuracy, decimal_places, ranges.rounding);
+	if (!band.feasible)
+	{
+		STATS_ELAPSED(solve_ns, solve_start);
+		return match_arena();
 	}
-	return min_max_values;
+
+	search_context context;
+	count_int combinations = make_search_context(class_a_count, class_b_count,
+			band, ranges, decimal_places, engine, context);
+	arena_sink sink((size_t)std::min(estimate_matches(context, combinations),
+			(uint64_t)ARENA_RESERVE_LIMIT));
+	STATS_ELAPSED(solve_ns, solve_start);
+
+	STATS_TIMER(search_start);
+	search_context_into(context, combinations, thread_count, sink);
+	STATS_ELAPSED(search_ns, search_start);
+	return sink.take();
+}
+
+/**
+ * search_class_splits - write every matrix meeting the targets, over every
+ * split of a total sample size into class A and class B, to a sink.
+ *
+ * The accuracy band depends only on the total, so it is found once. With
+ * the exact pruned engines, the splits that cannot reach the sensitivity
+ * and specificity bands together with the accuracy band are skipped: the
+ * range of class A counts is first narrowed in closed form, and each split
+ * left is checked before it is searched. The rest are handed out in chunks
+ * of consecutive splits that idle threads claim, and matches reach the sink
+ * by increasing class A count, as if each split were searched in turn.
+ *
+ * Parameters
+ *   count_int - the total sample size
+ *   int - the number of decimal places to round to
+ *   double - the target accuracy
+ *   double - the target sensitivity
+ *   double - the target specificity
+ *   double - the target f1 score
+ *   double - the target precision
+ *   search_engine - the strategy used to search the diagonals
+ *   int - the number of worker threads
+ *   result_sink - the sink matches are written to
+ *
+ * Returns
+ *   bool - false if no matrix of this size can achieve the accuracy
+ */
+bool search_class_splits(
+		count_int total_sample_size,
+		int decimal_places,
+		double target_accuracy,
+		double target_sensitivity,
+		double target_specificity,
+		double target_f1,
+		double target_precision,
+		search_engine engine,
+		int thread_count,
+		result_sink & sink
+		)
+{
+	STATS_TIMER(solve_start);
+	accuracy_band band = find_positives_vs_negatives(total_sample_size,
+			target_accuracy, decimal_places);
+	if (!band.feasible || total_sample_size < 2)
+	{
+		STATS_ELAPSED(solve_ns, solve_start);
+		return band.feasible;
+	}
+
+	count_int first = 1, last = total_sample_size - 1;
+	metric_targets targets = make_metric_targets(target_sensitivity,
+			target_specificity, target_f1, target_precision, decimal_places);
+	bool prune = engine == ENGINE_PRUNED || engine == ENGINE_SIMD ||
+		engine == ENGINE_GPU;
+	if (prune)
+		class_split_range(total_sample_size, band, targets, first, last);
+	STATS_ELAPSED(solve_ns, solve_start);
+
+	// Search one split, on every thread when there are too few splits to
+	// share out.
+	auto search_split = [&](count_int class_a_count, int threads,
+			result_sink & into) {
+		if (prune && !split_feasible(class_a_count,
+				total_sample_size - class_a_count, band, targets))
+			return;
+		search_context context;
+		count_int combinations = make_search_context(class_a_count,
+				total_sample_size - class_a_count, band, target_accuracy,
+				target_sensitivity, target_specificity, target_f1,
+				target_precision, decimal_places, engine, context);
+		search_context_into(context, combinations, threads, into);
+	};
+
+	STATS_TIMER(search_start);
+	count_int splits = last - first + 1;
+	if (thread_count <= 1 || splits < thread_count)
+	{
+		for (count_int class_a_count = first; class_a_count <= last;
+				class_a_count++)
+			search_split(class_a_count, thread_count, sink);
+		STATS_ELAPSED(search_ns, search_start);
+		return true;
+	}
+
+	int chunk_count = (int)std::min(splits,
+			(count_int)thread_count * CHUNKS_PER_THREAD);
+	std::vector<std::unique_ptr<result_sink> > buffers(chunk_count);
+	std::atomic<int> next_chunk(0);
+	search_context unsplit;
+	make_search_context(first, total_sample_size - first, band,
+			target_accuracy, target_sensitivity, target_specificity, target_f1,
+			target_precision, decimal_places, engine, unsplit);
+
+	std::vector<std::thread> workers;
+	for (int t = 0; t < thread_count; t++)
+	{
+		workers.emplace_back([&]() {
+			int chunk;
+			while ((chunk = next_chunk++) < chunk_count)
+			{
+				count_int chunk_first = first + splits * chunk / chunk_count;
+				count_int chunk_last = first + splits * (chunk + 1) / chunk_count;
+				buffers[chunk] = sink.make_buffer(unsplit);
+				for (count_int class_a_count = chunk_first;
+						class_a_count < chunk_last; class_a_count++)
+					search_split(class_a_count, 1, *buffers[chunk]);
+			}
+		});
+	}
+	for (size_t t = 0; t < workers.size(); t++)
+		workers[t].join();
+
+	for (int chunk = 0; chunk < chunk_count; chunk++)
+		sink.append(*buffers[chunk]);
+	STATS_ELAPSED(search_ns, search_start);
+	return true;
+}
+
+/**
+ * class_split_range - narrow the class A counts of a total that can meet
+ * the sensitivity and specificity bands along with the accuracy band.
+ *
+ * Writing the bands as l_s / S <= TP / A < u_s / S and
+ * l_t / S <= TN / B < u_t / S, with B = N - A, a split can only match if
+ * l_s * A + l_t * B <= S * max_correct and
+ * u_s * A + u_t * B > S * min_correct, each side shifted by the band
+ * offsets. Both are linear in A, so each leaves
+ * a half line of counts. A disabled target counts as the band [0, 1].
+ *
+ * Parameters
+ *   count_int - the total sample size
+ *   accuracy_band - the band of correct predictions meeting the accuracy
+ *   metric_targets - the integer bands of the targets
+ *   count_int - the first class A count, narrowed in place
+ *   count_int - the last class A count, narrowed in place
+ */
+void class_split_range(
+		count_int total_sample_size,
+		const accuracy_band & band,
+		const metric_targets & targets,
+		count_int & first,
+		count_int & last
+		)
+{
+	long long scale = targets.twice_scale;
+	const metric_band & sensitivity = targets.sensitivity;
+	const metric_band & specificity = targets.specificity;
+	wide_int lower_a = sensitivity.enabled ? sensitivity.lower : 0;
+	wide_int lower_b = specificity.enabled ? specificity.lower : 0;
+	wide_int upper_a = sensitivity.enabled ? sensitivity.upper : scale + 1;
+	wide_int upper_b = specificity.enabled ? specificity.upper : scale + 1;
+	wide_int lower_offset = (sensitivity.enabled ? sensitivity.lower_offset : 0) +
+		(specificity.enabled ? specificity.lower_offset : 0);
+	wide_int upper_offset = (sensitivity.enabled ? sensitivity.upper_offset : 0) +
+		(specificity.enabled ? specificity.upper_offset : 0);
+	wide_int total = total_sample_size;
+
+	// (lower_a - lower_b) * A <= S * max_correct - lower_b * N
+	wide_int slope = lower_a - lower_b;
+	wide_int bound = (wide_int)scale * band.max_correct - lower_b * total -
+		lower_offset;
+	if (slope > 0)
+		last = (count_int)std::min((wide_int)last,
+				-ceil_div(-bound, (long long)slope));
+	else if (slope < 0)
+		first = (count_int)std::max((wide_int)first,
+				ceil_div(-bound, (long long)-slope));
+	else if (bound < 0)
+		last = first - 1;
+
+	// (upper_a - upper_b) * A > S * min_correct - upper_b * N
+	slope = upper_a - upper_b;
+	bound = (wide_int)scale * band.min_correct - upper_b * total -
+		upper_offset;
+	if (slope > 0)
+		first = (count_int)std::max((wide_int)first,
+				1 - ceil_div(-bound, (long long)slope));
+	else if (slope < 0)
+		last = (count_int)std::min((wide_int)last,
+				ceil_div(-bound, (long long)-slope) - 1);
+	else if (bound >= 0)
+		last = first - 1;
+}
+
+/**
+ * split_feasible - whether a split's sensitivity and specificity bands
+ * leave a number of correct predictions within the accuracy band.
+ *
+ * Parameters
+ *   count_int - the class A count
+ *   count_int - the class B count
+ *   accuracy_band - the band of correct predictions meeting the accuracy
+ *   metric_targets - the integer bands of the targets
+ *
+ * Returns
+ *   bool - if the split can hold a match
+ */
+bool split_feasible(
+		count_int class_a_count,
+		count_int class_b_count,
+		const accuracy_band & band,
+		const metric_targets & targets
+		)
+{
+	count_band tp = find_ratio_band(class_a_count, targets.sensitivity,
+			targets.twice_scale);
+	count_band tn = find_ratio_band(class_b_count, targets.specificity,
+			targets.twice_scale);
+	return tp.feasible && tn.feasible &&
+		tp.min_count + tn.min_count <= band.max_correct &&
+		tp.max_count + tn.max_count >= band.min_correct;
+}
+
+/**
+ * search_context_into - search the diagonals of a context on worker threads
+ * and write the matches to a sink in search order.
+ *
+ * Parameters
+ *   search_context - the class counts, bands and targets of the search
+ *   count_int - the number of diagonals to search
+ *   int - the number of worker threads
+ *   result_sink - the sink matches are written to
+ */
+void search_context_into(
+		const search_context & context,
+		count_int combinations,
+		int thread_count,
+		result_sink & sink
+		)
+{
+	// The GPU engine spreads each block over the device itself.
+	if (thread_count <= 1 || combinations <= 1 || context.engine == ENGINE_GPU)
+	{
+		search_diagonals(context, 0, combinations, sink);
+		return;
+	}
+	if (context.match_limit != 0)
+	{
+		search_context_limited(context, combinations, thread_count, sink);
+		return;
+	}
+
+	// Diagonals differ in length, so hand out several chunks per thread and
+	// let idle threads claim the next one. Each chunk is buffered separately
+	// and the buffers are written in chunk order, matching the serial output.
+	int chunk_count = (int)std::min(combinations,
+			(count_int)thread_count * CHUNKS_PER_THREAD);
+	std::vector<std::unique_ptr<result_sink> > buffers(chunk_count);
+	std::atomic<int> next_chunk(0);
+
+	std::vector<std::thread> workers;
+	for (int t = 0; t < thread_count && t < chunk_count; t++)
+	{
+		workers.emplace_back([&]() {
+			int chunk;
+			while ((chunk = next_chunk++) < chunk_count)
+			{
+				count_int first = combinations * chunk / chunk_count;
+				count_int last = combinations * (chunk + 1) / chunk_count;
+				buffers[chunk] = sink.make_buffer(context);
+				search_diagonals(context, first, last, *buffers[chunk]);
+			}
+		});
+	}
+	for (size_t t = 0; t < workers.size(); t++)
+		workers[t].join();
+
+	for (int chunk = 0; chunk < chunk_count; chunk++)
+		sink.append(*buffers[chunk]);
+}
+
+/**
+ * search_context_limited - search_context_into for a search that stops
+ * after its first match_limit matches.
+ *
+ * Each chunk stops at the limit by itself. Once the finished chunks at the
+ * start of the search hold enough matches, the chunks after them are not
+ * started, and only the first match_limit matches reach the sink.
+ *
+ * Parameters
+ *   search_context - the class counts, bands, targets and limit of the search
+ *   count_int - the number of diagonals to search
+ *   int - the number of worker threads
+ *   result_sink - the sink matches are written to
+ */
+void search_context_limited(
+		const search_context & context,
+		count_int combinations,
+		int thread_count,
+		result_sink & sink
+		)
+{
+	int chunk_count = (int)std::min(combinations,
+			(count_int)thread_count * CHUNKS_PER_THREAD);
+	std::vector<std::unique_ptr<vector_sink> > buffers(chunk_count);
+	std::atomic<int> next_chunk(0);
+	std::atomic<int> needed_chunks(chunk_count);
+	std::mutex progress;
+	int settled_chunks = 0;
+	uint64_t settled_matches = 0;
+
+	std::vector<std::thread> workers;
+	for (int t = 0; t < thread_count && t < chunk_count; t++)
+	{
+		workers.emplace_back([&]() {
+			int chunk;
+			while ((chunk = next_chunk++) < needed_chunks)
+			{
+				count_int first = combinations * chunk / chunk_count;
+				count_int last = combinations * (chunk + 1) / chunk_count;
+				std::unique_ptr<vector_sink> buffer(new vector_sink());
+				search_diagonals(context, first, last, *buffer);
+
+				std::lock_guard<std::mutex> guard(progress);
+				buffers[chunk].swap(buffer);
+				while (settled_chunks < needed_chunks && buffers[settled_chunks])
+				{
+					settled_matches += buffers[settled_chunks]->results().size();
+					settled_chunks++;
+					if (settled_matches >= context.match_limit)
+						needed_chunks = settled_chunks;
+				}
+			}
+		});
+	}
+	for (size_t t = 0; t < workers.size(); t++)
+		workers[t].join();
+
+	uint64_t written = 0;
+	for (int chunk = 0; chunk < needed_chunks; chunk++)
+	{
+		const std::vector<confusion_matrix> & matches = buffers[chunk]->results();
+		for (size_t m = 0; m < matches.size() && written < context.match_limit;
+				m++, written++)
+			sink.write_match(matches[m].tp, matches[m].fn, matches[m].fp,
+					matches[m].tn);
+	}
+}
+
+/**
+ * search_context_pipelined - search_context_into for a sink that writes to
+ * a file, overlapping the search with the writes.
+ *
+ * The diagonals are cut into chunks of at most PIPELINE_CHUNK_CELLS cells.
+ * Worker threads search and format the chunks into buffers while the
+ * calling thread writes the finished ones out in order, so the search does
+ * not wait on the file, even with one worker thread. Workers stop
+ * PIPELINE_PENDING_PER_THREAD chunks each ahead of the writer, which keeps
+ * the matches held in memory bounded however loose the targets are.
+ *
+ * Parameters
+ *   search_context - the class counts, bands and targets of the search
+ *   count_int - the number of diagonals to search
+ *   int - the number of worker threads
+ *   result_sink - the sink matches are written to
+ */
+void search_context_pipelined(
+		const search_context & context,
+		count_int combinations,
+		int thread_count,
+		result_sink & sink
+		)
+{
+	if (combinations <= 1 || context.match_limit != 0 ||
+			context.engine == ENGINE_GPU)
+	{
+		search_context_into(context, combinations, thread_count, sink);
+		return;
+	}
+
+	thread_count = std::max(thread_count, 1);
+	std::vector<count_int> bounds;
+	pipeline_chunk_bounds(context, combinations, thread_count, bounds);
+	write_chunks_in_order((int)bounds.size() - 1, thread_count,
+			thread_count * PIPELINE_PENDING_PER_THREAD, [&](int chunk) {
+		std::unique_ptr<result_sink> buffer = sink.make_buffer(context);
+		search_diagonals(context, bounds[chunk], bounds[chunk + 1], *buffer);
+		return buffer;
+	}, sink);
+}
+
+/**
+ * pipeline_chunk_bounds - cut the diagonals of a search into chunks for
+ * search_context_pipelined.
+ *
+ * A chunk ends once it holds at least PIPELINE_CHUNK_CELLS cells, or fewer
+ * when the search is small enough that every thread would not otherwise get
+ * CHUNKS_PER_THREAD of them. A chunk always holds whole diagonals, so one
+ * long diagonal makes a larger chunk.
+ *
+ * Parameters
+ *   search_context - the class counts and bands of the search
+ *   count_int - the number of diagonals to search
+ *   int - the number of worker threads
+ *   std::vector - set to the first diagonal of every chunk, then the number
+ *                 of diagonals
+ */
+void pipeline_chunk_bounds(
+		const search_context & context,
+		count_int combinations,
+		int thread_count,
+		std::vector<count_int> & bounds
+		)
+{
+	uint64_t total = estimate_matches(context, combinations);
+	uint64_t chunk_cells = std::max((uint64_t)1, std::min(PIPELINE_CHUNK_CELLS,
+				total / ((uint64_t)thread_count * CHUNKS_PER_THREAD)));
+
+	bounds.assign(1, 0);
+	uint64_t cells = 0;
+	for (count_int i = 0; i < combinations; i++)
+	{
+		count_int min_tp, max_tp;
+		diagonal_tp_range(context, context.max_correct - i, min_tp, max_tp);
+		if (max_tp >= min_tp)
+			cells += (uint64_t)(max_tp - min_tp + 1);
+		if (cells >= chunk_cells && i + 1 < combinations)
+		{
+			bounds.push_back(i + 1);
+			cells = 0;
+		}
+	}
+	bounds.push_back(combinations);
+}
+
+/**
+ * run_chunks_in_order - run chunks of work on worker threads and finish them
+ * in chunk order on the calling thread as they are done.
+ *
+ * A worker does not start a chunk more than a number of chunks ahead of the
+ * one being finished, which bounds the results waiting to be written, so
+ * chunk % pending can index the buffer of a chunk.
+ *
+ * Parameters
+ *   int - the number of chunks
+ *   int - the number of worker threads
+ *   int - the most chunks that may be started ahead of the one being finished
+ *   std::function - runs a chunk, on a worker thread
+ *   std::function - finishes a chunk, on the calling thread in chunk order
+ */
+void run_chunks_in_order(
+		int chunk_count,
+		int thread_count,
+		int pending_chunks,
+		const std::function<void(int)> & run_chunk,
+		const std::function<void(int)> & finish_chunk
+		)
+{
+	std::vector<char> finished(chunk_count, 0);
+	std::atomic<int> next_chunk(0);
+	int written = 0;
+	std::mutex progress;
+	std::condition_variable chunk_finished;
+	std::condition_variable chunk_written;
+
+	std::vector<std::thread> workers;
+	for (int t = 0; t < thread_count && t < chunk_count; t++)
+	{
+		workers.emplace_back([&]() {
+			int chunk;
+			while ((chunk = next_chunk++) < chunk_count)
+			{
+				{
+					std::unique_lock<std::mutex> lock(progress);
+					chunk_written.wait(lock, [&]() {
+						return chunk < written + pending_chunks;
+					});
+				}
+				run_chunk(chunk);
+				{
+					std::lock_guard<std::mutex> lock(progress);
+					finished[chunk] = 1;
+				}
+				chunk_finished.notify_one();
+			}
+		});
+	}
+
+	for (int chunk = 0; chunk < chunk_count; chunk++)
+	{
+		{
+			std::unique_lock<std::mutex> lock(progress);
+			chunk_finished.wait(lock, [&]() { return finished[chunk] != 0; });
+		}
+		finish_chunk(chunk);
+		{
+			std::lock_guard<std::mutex> lock(progress);
+			written = chunk + 1;
+		}
+		chunk_written.notify_all();
+	}
+	for (size_t t = 0; t < workers.size(); t++)
+		workers[t].join();
+}
+
+/**
+ * write_chunks_in_order - search chunks on worker threads and append them to
+ * a sink in chunk order on the calling thread as they finish.
+ *
+ * Parameters
+ *   int - the number of chunks
+ *   int - the number of worker threads
+ *   int - the most chunks that may be started ahead of the one being appended
+ *   std::function - searches a chunk into a new buffer of the sink
+ *   result_sink - the sink the buffers are appended to
+ */
+void write_chunks_in_order(
+		int chunk_count,
+		int thread_count,
+		int pending_chunks,
+		const std::function<std::unique_ptr<result_sink>(int)> & search_chunk,
+		result_sink & sink
+		)
+{
+	std::vector<std::unique_ptr<result_sink> > buffers(
+			std::min(chunk_count, pending_chunks));
+	run_chunks_in_order(chunk_count, thread_count, pending_chunks,
+			[&](int chunk) {
+				buffers[chunk % pending_chunks] = search_chunk(chunk);
+			},
+			[&](int chunk) {
+				sink.append(*buffers[chunk % pending_chunks]);
+				buffers[chunk % pending_chunks].reset();
+			});
+}
+
+/**
+ * make_search_context - set up the bands and targets of a search.
+ *
+ * Parameters
+ *   count_int - count of items in class A
+ *   count_int - count of items in class B
+ *   accuracy_band - the band of correct predictions meeting the accuracy
+ *   double - the target accuracy
+ *   double - the target sensitivity
+ *   double - the target specificity
+ *   double - the target f1 score
+ *   double - the target precision
+ *   int - the number of decimal places to round to
+ *   search_engine - the strategy used to search the diagonals
+ *   search_context - set to the context of the search
+ *
+ * Returns
+ *   count_int - the number of diagonals to search, 0 if nothing can match
+ */
+count_int make_search_context(
+		count_int class_a_count,
+		count_int class_b_count,
+		const accuracy_band & band,
+		double target_accuracy,
+		double target_sensitivity,
+		double target_specificity,
+		double target_f1,
+		double target_precision,
+		int decimal_places,
+		search_engine engine,
+		search_context & context
+		)
+{
+	return make_search_context(class_a_count, class_b_count, band,
+			exact_targets(target_accuracy, target_sensitivity,
+			target_specificity, target_f1, target_precision), decimal_places,
+			engine, context);
+}
+
+/**
+ * make_search_context - make_search_context for ranges of targets under a
+ * set of rounding modes.
+ *
+ * The rounded engine compares against single targets rounded half up, so
+ * any other ranges, or registry metrics, are searched with the scalar
+ * engine instead. The pruned engines narrow every diagonal by the registry
+ * metrics that allow it and check the rest on every cell.
+ *
+ * Parameters
+ *   count_int - count of items in class A
+ *   count_int - count of items in class B
+ *   accuracy_band - the band of correct predictions meeting the accuracy
+ *   target_ranges - the target ranges and rounding modes
+ *   int - the number of decimal places to round to
+ *   search_engine - the strategy used to search the diagonals
+ *   search_context - set to the context of the search
+ *
+ * Returns
+ *   count_int - the number of diagonals to search, 0 if nothing can match
+ */
+count_int make_search_context(
+		count_int class_a_count,
+		count_int class_b_count,
+		const accuracy_band & band,
+		const target_ranges & ranges,
+		int decimal_places,
+		search_engine engine,
+		search_context & context
+		)
+{
+	// Calculate the total number of combinations.
+	count_int combinations = band.max_correct - band.min_correct + 1;
+	if (engine == ENGINE_ROUNDED && !exact_ranges(ranges))
+		engine = ENGINE_SCALAR;
+	if (engine == ENGINE_GPU && !gpu_available())
+		engine = ENGINE_SIMD;
+
+	search_context initial = {class_a_count, class_b_count, band.max_correct,
+		{true, 0, class_a_count}, {true, 0, class_b_count},
+		ranges.accuracy.low, ranges.sensitivity.low, ranges.specificity.low,
+		ranges.f1.low, ranges.precision.low, decimal_places,
+		make_range_targets(ranges, decimal_places), 0, engine, 0, ranges, 0, 0,
+		GPU_BLOCK_CELLS};
+	context = initial;
+	context.check_mask = context.targets.mask;
+	context.extra_check_mask = context.targets.extra_mask;
+
+	// Sensitivity only depends on TP and specificity only on TN, so each
+	// gives a fixed range of counts that a match must fall within.
+	if (engine == ENGINE_PRUNED || engine == ENGINE_SIMD || engine == ENGINE_GPU)
+	{
+		context.tp_band = find_ratio_band(class_a_count,
+				context.targets.sensitivity, context.targets.twice_scale);
+		context.tn_band = find_ratio_band(class_b_count,
+				context.targets.specificity, context.targets.twice_scale);
+		if (!context.tp_band.feasible || !context.tn_band.feasible)
+			combinations = 0;
+
+		// The bands are exact, so every cell within them already meets the
+		// sensitivity and specificity targets.
+		context.check_mask &= ~(unsigned)(METRIC_SENSITIVITY | METRIC_SPECIFICITY);
+
+		// So does narrowing by a registry metric.
+		for (int k = 0; k < EXTRA_METRIC_COUNT; k++)
+			if (((context.extra_check_mask >> k) & 1) && EXTRA_METRICS[k].narrow)
+				context.extra_prune_mask |= 1u << k;
+		context.extra_check_mask &= ~context.extra_prune_mask;
+	}
+	return combinations;
+}
+
+/**
+ * run_batch - solve every query of a batch file into one tagged csv file.
+ *
+ * Each line holds the class A count, class B count, decimal places and the
+ * accuracy, sensitivity, specificity, f1 and precision targets, separated by
+ * spaces or commas. Blank lines and lines starting with # are skipped. Every
+ * output row starts with the line number of its query.
+ *
+ * The queries are split into chunks of diagonals that one pool of threads
+ * works through, while the calling thread writes the finished chunks out in
+ * query order. Queries with the same sample size, accuracy and decimal
+ * places share one accuracy band.
+ *
+ * Parameters
+ *   const char * - the path of the batch file, or - for stdin
+ *   search_engine - the strategy used to search the diagonals
+ *   int - the number of worker threads
+ *   output_format - the layout of the output file, which must be csv
+ *   const char * - the path of the output file
+ *
+ * Returns
+ *   int - the process exit code
+ */
+int run_batch(
+		const char * batch_path,
+		search_engine engine,
+		int thread_count,
+		output_format format,
+		const char * output_path
+		)
+{
+	if (format != FORMAT_CSV)
+	{
+		std::cerr << "--batch only writes csv output." << std::endl;
+		return(1);
+	}
+
+	std::vector<batch_query> queries;
+	if (!read_batch_file(batch_path, queries))
+		return(1);
+
+	// A chunk is a run of diagonals of one query.
+	struct batch_chunk
+	{
+		int query;
+		count_int first;
+		count_int last;
+	};
+
+	std::map<std::tuple<count_int, int, double>, accuracy_band> bands;
+	std::vector<search_context> contexts(queries.size());
+	std::vector<batch_chunk> chunks;
+	for (size_t q = 0; q < queries.size(); q++)
+	{
+		const batch_query & query = queries[q];
+		std::tuple<count_int, int, double> key(
+				query.class_a_count + query.class_b_count, query.decimal_places,
+				query.target_accuracy);
+		std::map<std::tuple<count_int, int, double>, accuracy_band>::iterator
+			cached = bands.find(key);
+		if (cached == bands.end())
+			cached = bands.insert(std::make_pair(key, find_positives_vs_negatives(
+					std::get<0>(key), query.target_accuracy,
+					query.decimal_places))).first;
+
+		const accuracy_band & band = cached->second;
+		if (!band.feasible)
+		{
+			std::cerr << "Line " << query.line << ": there are no combinations "
+				"that can achieve this accuracy." << std::endl;
+			continue;
+		}
+
+		count_int combinations = make_search_context(query.class_a_count,
+				query.class_b_count, band, query.target_accuracy,
+				query.target_sensitivity, query.target_specificity,
+				query.target_f1, query.target_precision, query.decimal_places,
+				engine, contexts[q]);
+		int chunk_count = (int)std::min(combinations,
+				(count_int)thread_count * CHUNKS_PER_THREAD);
+		for (int chunk = 0; chunk < chunk_count; chunk++)
+		{
+			batch_chunk next = {(int)q, combinations * chunk / chunk_count,
+				combinations * (chunk + 1) / chunk_count};
+			chunks.push_back(next);
+		}
+	}
+
+	int fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1)
+	{
+		std::cerr << "Failed to open the output file." << std::endl;
+		return(1);
+	}
+	match_sink file(search_context(), FORMAT_CSV, fd, "");
+	file.begin();
+
+	// Workers wait rather than run more than BATCH_PENDING_CHUNKS ahead of
+	// the writer, which bounds the matches held in memory.
+	write_chunks_in_order((int)chunks.size(), thread_count,
+			BATCH_PENDING_CHUNKS, [&](int chunk) {
+		const batch_chunk & work = chunks[chunk];
+		const search_context & context = contexts[work.query];
+		char tag[16];
+		snprintf(tag, sizeof(tag), "%d", queries[work.query].line);
+		std::unique_ptr<result_sink> buffer(new match_sink(context, FORMAT_CSV,
+				-1, tag));
+		search_diagonals(context, work.first, work.last, *buffer);
+		return buffer;
+	}, file);
+
+	file.finish();
+	close(fd);
+	return(0);
+}
+
+/**
+ * read_batch_file - read and check every query of a batch file.
+ *
+ * Parameters
+ *   const char * - the path of the batch file, or - for stdin
+ *   std::vector - set to the queries, in file order
+ *
+ * Returns
+ *   bool - false, after printing why, if the file cannot be read or holds
+ *          an invalid query
+ */
+bool read_batch_file(const char * batch_path, std::vector<batch_query> & queries)
+{
+	std::ifstream batch_file;
+	if (strcmp(batch_path, "-") != 0)
+	{
+		batch_file.open(batch_path);
+		if (!batch_file)
+		{
+			std::cerr << "Failed to open the batch file." << std::endl;
+			return false;
+		}
+	}
+	std::istream & input = batch_file.is_open() ? batch_file : std::cin;
+
+	queries.clear();
+	std::string text;
+	for (int line = 1; std::getline(input, text); line++)
+	{
+		size_t start = text.find_first_not_of(" \t\r");
+		if (start == std::string::npos || text[start] == '#')
+			continue;
+
+		batch_query query;
+		if (!read_batch_query(text, line, query) || !valid_batch_query(query))
+		{
+			std::cerr << "Invalid query on line " << line << "." << std::endl;
+			return false;
+		}
+		queries.push_back(query);
+	}
+	return true;
+}
+
+/**
+ * read_batch_query - parse one line of a batch file.
+ *
+ * Parameters
+ *   std::string - the text of the line
+ *   int - the line number
+ *   batch_query - set to the parsed query
+ *
+ * Returns
+ *   bool - if the line holds exactly the eight fields of a query
+ */
+bool read_batch_query(const std::string & text, int line, batch_query & query)
+{
+	std::string fields = text;
+	std::replace(fields.begin(), fields.end(), ',', ' ');
+
+	int consumed = 0;
+	query.line = line;
+	int read = sscanf(fields.c_str(), "%lld %lld %d %lf %lf %lf %lf %lf %n",
+			&query.class_a_count, &query.class_b_count, &query.decimal_places,
+			&query.target_accuracy, &query.target_sensitivity,
+			&query.target_specificity, &query.target_f1,
+			&query.target_precision, &consumed);
+	return read == 8 && fields[consumed] == '\0';
+}
+
+/**
+ * valid_batch_query - check a query against the limits main asserts for the
+ * modifiers.
+ *
+ * Parameters
+ *   batch_query - the query to check
+ *
+ * Returns
+ *   bool - if the query can be searched
+ */
+bool valid_batch_query(const batch_query & query)
+{
+	const double targets[4] = {query.target_sensitivity,
+		query.target_specificity, query.target_f1, query.target_precision};
+	for (int t = 0; t < 4; t++)
+		if (!((targets[t] >= 0 && targets[t] <= 1) || targets[t] == -1))
+			return false;
+	return query.decimal_places >= 0 && query.decimal_places <= 18 &&
+		query.class_a_count > 0 && query.class_b_count > 0 &&
+		query.target_accuracy >= 0 && query.target_accuracy <= 1;
+}
+
+/**
+ * search_diagonals - check every candidate on a run of accuracy diagonals and
+ * write the matches out.
+ *
+ * Diagonal i holds the matrices with band.max_correct - i correct
+ * predictions, and is walked from its largest TP downwards. The exact
+ * engines run a search specialised on the decimal places and checked
+ * metrics, in 32-bit counts when the sample size fits an int32 and in
+ * count_int otherwise.
+ *
+ * Parameters
+ *   search_context - the class counts, bands and targets of the search
+ *   count_int - the first diagonal to search
+ *   count_int - one past the last diagonal to search
+ *   result_sink - the sink matches are written to
+ */
+void search_diagonals(
+		const search_context & context,
+		count_int first,
+		count_int last,
+		result_sink & out
+		)
+{
+	STATS_ADD(combinations, last - first);
+	if (context.engine == ENGINE_ROUNDED)
+	{
+		search_diagonals_rounded(context, first, last, out);
+		STATS_FLUSH();
+		return;
+	}
+	if (context.engine == ENGINE_GPU)
+	{
+		search_diagonals_gpu(context, first, last, out);
+		STATS_FLUSH();
+		return;
+	}
+
+	int wide = context.class_a_count + context.class_b_count > INT32_MAX;
+	int row = SPECIALISED_DECIMAL_PLACES + 1;
+	if (context.decimal_places <= SPECIALISED_DECIMAL_PLACES)
+		row = context.decimal_places;
+	DIAGONAL_SEARCHES[wide][row][context.check_mask](context, first, last, out);
+	STATS_FLUSH();
+}
+
+/**
+ * search_diagonals_fixed - search_diagonals for the exact engines,
+ * specialised on the count type, the decimal places and the checked metrics.
+ *
+ * With both known at compile time the scale factors fold into constants and
+ * the checks of unchecked metrics disappear. DP is -1 for a runtime scale.
+ * COUNT must hold the sample size.
+ *
+ * Parameters
+ *   search_context - the class counts, bands and targets of the search
+ *   count_int - the first diagonal to search
+ *   count_int - one past the last diagonal to search
+ *   result_sink - the sink matches are written to
+ */
+template <typename COUNT, int DP, unsigned MASK>
+void search_diagonals_fixed(
+		const search_context & context,
+		count_int first,
+		count_int last,
+		result_sink & out
+		)
+{
+	COUNT class_a_count = (COUNT)context.class_a_count;
+	COUNT class_b_count = (COUNT)context.class_b_count;
+	uint64_t found = 0;
+
+	for (count_int i = first; i < last; i++)
+	{
+		COUNT correct_preds = (COUNT)(context.max_correct - i);
+		COUNT min_tp, max_tp;
+		diagonal_tp_range(context, correct_preds, min_tp, max_tp);
+		STATS_ADD(candidates, std::max((COUNT)0, max_tp - min_tp + 1));
+		STATS_ADD(pruned, std::min(class_a_count, correct_preds) -
+				std::max((COUNT)0, correct_preds - class_b_count) + 1 -
+				std::max((COUNT)0, max_tp - min_tp + 1));
+
+		// With nothing left to check, every cell the bands leave matches, so
+		// the diagonal is written as one run.
+		if (MASK == 0 && context.extra_check_mask == 0)
+		{
+			if (max_tp < min_tp)
+				continue;
+			count_int length = (count_int)max_tp - min_tp + 1;
+			if (context.match_limit != 0)
+				length = std::min(length, (count_int)(context.match_limit - found));
+			count_int TN = (count_int)correct_preds - max_tp;
+			out.write_run(max_tp, class_a_count - max_tp, class_b_count - TN, TN,
+					length);
+			STATS_ADD(matches, length);
+			found += (uint64_t)length;
+			if (found == context.match_limit)
+				return;
+			continue;
+		}
+
+		if (context.engine == ENGINE_SIMD)
+		{
+			COUNT tp_batch[METRIC_BATCH];
+			COUNT tn_batch[METRIC_BATCH];
+			COUNT TP = max_tp;
+			while (TP >= min_tp)
+			{
+				int count = 0;
+				for (; count < METRIC_BATCH && TP >= min_tp; count++, TP--)
+				{
+					tp_batch[count] = TP;
+					tn_batch[count] = correct_preds - TP;
+				}
+
+				uint64_t matches = check_metric_batch_masked<COUNT, MASK, DP>(
+						tp_batch, tn_batch, count, class_a_count, class_b_count,
+						context.targets);
+#ifdef SEARCH_STATS
+				for (int k = 0; k < count; k++)
+					if (!((matches >> k) & 1))
+						stats_reject<MASK, DP>(tp_batch[k],
+								class_a_count - tp_batch[k], class_b_count - tn_batch[k],
+								tn_batch[k], context.targets);
+#endif
+				for (int k = 0; matches != 0; k++, matches >>= 1)
+				{
+					if (!(matches & 1))
+						continue;
+					if (context.extra_check_mask != 0 && !check_extra_metrics(
+							tp_batch[k], class_a_count - tp_batch[k],
+							class_b_count - tn_batch[k], tn_batch[k], context.targets,
+							context.extra_check_mask))
+					{
+						STATS_ADD(rejected[4], 1);
+						continue;
+					}
+					out.write_match(tp_batch[k], class_a_count - tp_batch[k],
+							class_b_count - tn_batch[k], tn_batch[k]);
+					STATS_ADD(matches, 1);
+					if (++found == context.match_limit)
+						return;
+				}
+			}
+			continue;
+		}
+
+		for (COUNT TP = max_tp; TP >= min_tp; TP--)
+		{
+			COUNT FN = class_a_count - TP;
+			COUNT TN = correct_preds - TP;
+			COUNT FP = class_b_count - TN;
+
+			if (check_metric_masked<MASK, DP>(TP, FN, FP, TN, context.targets))
+			{
+				if (context.extra_check_mask != 0 && !check_extra_metrics(TP, FN,
+						FP, TN, context.targets, context.extra_check_mask))
+				{
+					STATS_ADD(rejected[4], 1);
+					continue;
+				}
+				out.write_match(TP, FN, FP, TN);
+				STATS_ADD(matches, 1);
+				if (++found == context.match_limit)
+					return;
+			}
+#ifdef SEARCH_STATS
+			else
+				stats_reject<MASK, DP>(TP, FN, FP, TN, context.targets);
+#endif
+		}
+	}
+}
+
+/**
+ * search_table_row - search_diagonals_fixed for one count type, one decimal
+ * place count and every metric mask.
+ */
+template <typename COUNT, int DP, unsigned... MASKS>
+constexpr diagonal_search_row search_table_row(
+		std::integer_sequence<unsigned, MASKS...>)
+{
+	return {{search_diagonals_fixed<COUNT, DP, MASKS>...}};
+}
+
+// Every metric mask, for search_table_row.
+typedef std::make_integer_sequence<unsigned, METRIC_ALL + 1> every_mask;
+
+// search_diagonals_fixed indexed by whether the sample size needs more than
+// 32 bits, by decimal places, with the runtime scale row last, then by the
+// checked metric mask.
+const diagonal_search_row
+	DIAGONAL_SEARCHES[2][SPECIALISED_DECIMAL_PLACES + 2] = {
+	{
+		search_table_row<int, 0>(every_mask()),
+		search_table_row<int, 1>(every_mask()),
+		search_table_row<int, 2>(every_mask()),
+		search_table_row<int, 3>(every_mask()),
+		search_table_row<int, 4>(every_mask()),
+		search_table_row<int, 5>(every_mask()),
+		search_table_row<int, 6>(every_mask()),
+		search_table_row<int, -1>(every_mask())
+	},
+	{
+		search_table_row<count_int, 0>(every_mask()),
+		search_table_row<count_int, 1>(every_mask()),
+		search_table_row<count_int, 2>(every_mask()),
+		search_table_row<count_int, 3>(every_mask()),
+		search_table_row<count_int, 4>(every_mask()),
+		search_table_row<count_int, 5>(every_mask()),
+		search_table_row<count_int, 6>(every_mask()),
+		search_table_row<count_int, -1>(every_mask())
+	}
+};
+
+/**
+ * search_diagonals_rounded - search_diagonals for ENGINE_ROUNDED, checking
+ * every cell with check_metric_rounded.
+ *
+ * Parameters
+ *   search_context - the class counts, bands and targets of the search
+ *   count_int - the first diagonal to search
+ *   count_int - one past the last diagonal to search
+ *   result_sink - the sink matches are written to
+ */
+void search_diagonals_rounded(
+		const search_context & context,
+		count_int first,
+		count_int last,
+		result_sink & out
+		)
+{
+	count_int class_a_count = context.class_a_count;
+	count_int class_b_count = context.class_b_count;
+	uint64_t found = 0;
+
+	for (count_int i = first; i < last; i++)
+	{
+		count_int correct_preds = context.max_correct - i;
+		count_int min_tp, max_tp;
+		diagonal_tp_range(context, correct_preds, min_tp, max_tp);
+		STATS_ADD(candidates, std::max(0LL, max_tp - min_tp + 1));
+		STATS_ADD(pruned, std::min(class_a_count, correct_preds) -
+				std::max(0LL, correct_preds - class_b_count) + 1 -
+				std::max(0LL, max_tp - min_tp + 1));
+
+		for (count_int TP = max_tp; TP >= min_tp; TP--)
+		{
+			count_int FN = class_a_count - TP;
+			count_int TN = correct_preds - TP;
+			count_int FP = class_b_count - TN;
+
+			if (check_metric_rounded((double)TP, (double)FN, (double)FP,
+						(double)TN, context.target_sensitivity,
+						context.target_specificity, context.target_f1,
+						context.target_precision, context.decimal_places))
+			{
+				out.write_match(TP, FN, FP, TN);
+				STATS_ADD(matches, 1);
+				if (++found == context.match_limit)
+					return;
+			}
+		}
+	}
+}
+
+/**
+ * search_diagonals_gpu - search_diagonals for ENGINE_GPU.
+ *
+ * The diagonals are cut down by diagonal_tp_range on the host and handed to
+ * gpu_check_block in blocks of at most gpu_block_cells cells, splitting a
+ * diagonal across blocks where it does not fit. The device returns the cells
+ * that match in no particular order, so they are sorted back into search
+ * order before the registry metrics left to check are tested and the matches
+ * are written.
+ *
+ * Parameters
+ *   search_context - the class counts, bands and targets of the search
+ *   count_int - the first diagonal to search
+ *   count_int - one past the last diagonal to search
+ *   result_sink - the sink matches are written to
+ */
+void search_diagonals_gpu(
+		const search_context & context,
+		count_int first,
+		count_int last,
+		result_sink & out
+		)
+{
+	count_int class_a_count = context.class_a_count;
+	count_int class_b_count = context.class_b_count;
+	std::vector<gpu_run> runs;
+	std::vector<uint32_t> hits;
+	uint64_t found = 0;
+
+	// The diagonal being handed out, from TP down to min_tp.
+	count_int i = first, correct_preds = 0, min_tp = 0, TP = -1;
+	while (true)
+	{
+		runs.clear();
+		uint32_t cells = 0;
+		while (cells < context.gpu_block_cells)
+		{
+			if (TP < min_tp)
+			{
+				if (i == last)
+					break;
+				correct_preds = context.max_correct - i++;
+				diagonal_tp_range(context, correct_preds, min_tp, TP);
+				STATS_ADD(candidates, std::max(0LL, TP - min_tp + 1));
+				STATS_ADD(pruned, std::min(class_a_count, correct_preds) -
+						std::max(0LL, correct_preds - class_b_count) + 1 -
+						std::max(0LL, TP - min_tp + 1));
+				continue;
+			}
+			count_int length = std::min(TP - min_tp + 1,
+					(count_int)(context.gpu_block_cells - cells));
+			gpu_run run = {correct_preds, TP, cells};
+			runs.push_back(run);
+			cells += (uint32_t)length;
+			TP -= length;
+		}
+		if (cells == 0)
+			return;
+
+		gpu_check_block(context.targets, context.check_mask, class_a_count,
+				class_b_count, runs, cells, hits);
+		std::sort(hits.begin(), hits.end());
+
+		size_t r = 0;
+		for (size_t h = 0; h < hits.size(); h++)
+		{
+			while (r + 1 < runs.size() && runs[r + 1].first_cell <= hits[h])
+				r++;
+			count_int match_tp = runs[r].max_tp - (hits[h] - runs[r].first_cell);
+			count_int FN = class_a_count - match_tp;
+			count_int TN = runs[r].correct_preds - match_tp;
+			count_int FP = class_b_count - TN;
+			if (context.extra_check_mask != 0 && !check_extra_metrics(match_tp,
+					FN, FP, TN, context.targets, context.extra_check_mask))
+			{
+				STATS_ADD(rejected[4], 1);
+				continue;
+			}
+			out.write_match(match_tp, FN, FP, TN);
+			STATS_ADD(matches, 1);
+			if (++found == context.match_limit)
+				return;
+		}
+	}
+}
+
+#ifndef GPU_BACKEND
+/**
+ * gpu_available - whether the GPU engine can run.
+ *
+ * Returns
+ *   bool - false, as the library was built without GPU=1
+ */
+bool gpu_available()
+{
+	return false;
+}
+
+/**
+ * gpu_check_block - check a block of cells for search_diagonals_gpu.
+ *
+ * Without GPU=1 the block is checked on the host with check_metric, cell by
+ * cell. Searches never get here, as make_search_context runs ENGINE_GPU as
+ * ENGINE_SIMD when gpu_available is false, but bench --verify sets the
+ * engine of a context back to ENGINE_GPU, so that the packing of the runs
+ * and the decoding of the hits in search_diagonals_gpu are checked on any
+ * build.
+ *
+ * Parameters
+ *   metric_targets - the integer bands of the targets
+ *   unsigned - the metric mask to check
+ *   count_int - count of items in class A
+ *   count_int - count of items in class B
+ *   std::vector - the runs of the block, in search order
+ *   uint32_t - the number of cells in the block
+ *   std::vector - set to the index within the block of every match
+ */
+void gpu_check_block(
+		const metric_targets & targets,
+		unsigned check_mask,
+		count_int class_a_count,
+		count_int class_b_count,
+		const std::vector<gpu_run> & runs,
+		uint32_t cells,
+		std::vector<uint32_t> & hits
+		)
+{
+	metric_targets checked = targets;
+	checked.mask = check_mask;
+	hits.clear();
+	for (size_t r = 0; r < runs.size(); r++)
+	{
+		uint32_t end = r + 1 < runs.size() ? runs[r + 1].first_cell : cells;
+		for (uint32_t cell = runs[r].first_cell; cell < end; cell++)
+		{
+			count_int TP = runs[r].max_tp - (cell - runs[r].first_cell);
+			count_int TN = runs[r].correct_preds - TP;
+			if (check_metric(TP, class_a_count - TP, class_b_count - TN, TN,
+					checked))
+				hits.push_back(cell);
+		}
+	}
+}
+#endif
+
+/**
+ * diagonal_tp_range - the range of TP to check on one accuracy diagonal.
+ *
+ * TN = correct - TP on the diagonal, so the TP and TN bands of the search
+ * both bound TP, as do the registry metrics of extra_prune_mask.
+ *
+ * Parameters
+ *   search_context - the class counts and bands of the search
+ *   COUNT - the number of correct predictions on the diagonal
+ *   COUNT & - set to the smallest TP to check
+ *   COUNT & - set to the largest TP to check
+ */
+template <typename COUNT>
+inline void diagonal_tp_range(
+		const search_context & context,
+		COUNT correct_preds,
+		COUNT & min_tp,
+		COUNT & max_tp
+		)
+{
+	count_int correct = correct_preds;
+	max_tp = (COUNT)std::min(std::min(context.class_a_count, correct),
+			std::min(context.tp_band.max_count, correct - context.tn_band.min_count));
+	min_tp = (COUNT)std::max(std::max(0LL, correct - context.class_b_count),
+			std::max(context.tp_band.min_count, correct - context.tn_band.max_count));
+	if (context.extra_prune_mask != 0)
+	{
+		count_int low = min_tp, high = max_tp;
+		narrow_extra_metrics(context, correct, low, high);
+		min_tp = (COUNT)low;
+		max_tp = (COUNT)std::max(high, low - 1);
+	}
+}
+
+/**
+ * estimate_matches - an upper bound on the matches of a search, the number
+ * of cells left on its diagonals by the TP and TN bands.
+ *
+ * With the pruned engines and only sensitivity and specificity targets it
+ * is exact. Walking the diagonals costs far less than searching them.
+ *
+ * Parameters
+ *   search_context - the class counts and bands of the search
+ *   count_int - the number of diagonals to search
+ *
+ * Returns
+ *   uint64_t - the number of cells to check
+ */
+uint64_t estimate_matches(const search_context & context,
+		count_int combinations)
+{
+	uint64_t cells = 0;
+	for (count_int i = 0; i < combinations; i++)
+	{
+		count_int min_tp, max_tp;
+		diagonal_tp_range(context, context.max_correct - i, min_tp, max_tp);
+		if (max_tp >= min_tp)
+			cells += (uint64_t)(max_tp - min_tp + 1);
+	}
+	return cells;
+}
+
+/**
+ * ~result_sink - nothing to release.
+ */
+result_sink::~result_sink()
+{
+}
+
+/**
+ * write_run - write a run of matches along one accuracy diagonal, one at a
+ * time.
+ *
+ * Parameters
+ *   count_int - TP of the first match
+ *   count_int - FN of the first match
+ *   count_int - FP of the first match
+ *   count_int - TN of the first match
+ *   count_int - the number of matches, each with one fewer TP and FP and one
+ *               more FN and TN than the one before
+ */
+void result_sink::write_run(count_int TP, count_int FN, count_int FP,
+		count_int TN, count_int length)
+{
+	for (count_int k = 0; k < length; k++)
+		write_match(TP - k, FN + k, FP - k, TN + k);
+}
+
+/**
+ * make_buffer - make an in-memory sink for one chunk of a threaded search.
+ *
+ * Parameters
+ *   search_context - the class counts and targets of the search
+ *
+ * Returns
+ *   result_sink - an empty vector_sink
+ */
+std::unique_ptr<result_sink> result_sink::make_buffer(
+		const search_context &) const
+{
+	return std::unique_ptr<result_sink>(new vector_sink());
+}
+
+/**
+ * append - write the matches of a chunk buffer through write_match.
+ *
+ * Parameters
+ *   result_sink - the vector_sink made by make_buffer
+ */
+void result_sink::append(result_sink & buffered)
+{
+	const std::vector<confusion_matrix> & matches =
+		static_cast<const vector_sink &>(buffered).results();
+	for (size_t m = 0; m < matches.size(); m++)
+		write_match(matches[m].tp, matches[m].fn, matches[m].fp, matches[m].tn);
+}
+
+/**
+ * write_match - keep a matching matrix.
+ *
+ * Parameters
+ *   count_int - TP
+ *   count_int - FN
+ *   count_int - FP
+ *   count_int - TN
+ */
+void vector_sink::write_match(count_int TP, count_int FN, count_int FP,
+		count_int TN)
+{
+	confusion_matrix match = {TP, FN, FP, TN};
+	matches.push_back(match);
+}
+
+/**
+ * append - keep the matches of a chunk buffer.
+ *
+ * Parameters
+ *   result_sink - the vector_sink made by make_buffer
+ */
+void vector_sink::append(result_sink & buffered)
+{
+	const std::vector<confusion_matrix> & other =
+		static_cast<const vector_sink &>(buffered).results();
+	matches.insert(matches.end(), other.begin(), other.end());
+}
+
+/**
+ * results - the matches kept so far.
+ *
+ * Returns
+ *   std::vector - the matches, in search order
+ */
+const std::vector<confusion_matrix> & vector_sink::results() const
+{
+	return matches;
+}
+
+/**
+ * counter_sink - make a sink with no matches counted.
+ */
+counter_sink::counter_sink()
+	: match_count(0)
+{
+}
+
+/**
+ * write_match - count a matching matrix.
+ *
+ * Parameters
+ *   count_int - TP
+ *   count_int - FN
+ *   count_int - FP
+ *   count_int - TN
+ */
+void counter_sink::write_match(count_int, count_int, count_int, count_int)
+{
+	match_count++;
+}
+
+/**
+ * write_run - count a run of matches without visiting them.
+ *
+ * Parameters
+ *   count_int - TP of the first match
+ *   count_int - FN of the first match
+ *   count_int - FP of the first match
+ *   count_int - TN of the first match
+ *   count_int - the number of matches
+ */
+void counter_sink::write_run(count_int, count_int, count_int, count_int,
+		count_int length)
+{
+	match_count += (uint64_t)length;
+}
+
+/**
+ * make_buffer - make a counter for one chunk of a threaded search.
+ *
+ * Returns
+ *   result_sink - an empty counter_sink
+ */
+std::unique_ptr<result_sink> counter_sink::make_buffer(
+		const search_context &) const
+{
+	return std::unique_ptr<result_sink>(new counter_sink());
+}
+
+/**
+ * append - add the count of a chunk buffer.
+ *
+ * Parameters
+ *   result_sink - the counter_sink made by make_buffer
+ */
+void counter_sink::append(result_sink & buffered)
+{
+	match_count += static_cast<const counter_sink &>(buffered).count();
+}
+
+/**
+ * count - the number of matches counted so far.
+ *
+ * Returns
+ *   uint64_t - the match count
+ */
+uint64_t counter_sink::count() const
+{
+	return match_count;
+}
+
+/**
+ * match_arena - make an empty arena.
+ */
+match_arena::match_arena()
+	: match_count(0)
+{
+}
+
+/**
+ * match_arena - take the blocks of another arena, leaving it empty.
+ *
+ * Parameters
+ *   match_arena - the arena to move from
+ */
+match_arena::match_arena(match_arena && other)
+	: chunks(std::move(other.chunks)), match_count(other.match_count)
+{
+	other.chunks.clear();
+	other.match_count = 0;
+}
+
+/**
+ * operator= - drop this arena's blocks and take another's, leaving it empty.
+ *
+ * Parameters
+ *   match_arena - the arena to move from
+ *
+ * Returns
+ *   match_arena - this arena
+ */
+match_arena & match_arena::operator=(match_arena && other)
+{
+	if (this != &other)
+	{
+		chunks = std::move(other.chunks);
+		match_count = other.match_count;
+		other.chunks.clear();
+		other.match_count = 0;
+	}
+	return *this;
+}
+
+/**
+ * reserve - make room for a number of further matches in one block.
+ *
+ * Parameters
+ *   size_t - the number of matches to make room for
+ */
+void match_arena::reserve(size_t count)
+{
+	size_t room = chunks.empty() ? 0 :
+		chunks.back().capacity - chunks.back().used;
+	if (count <= room)
+		return;
+	arena_chunk chunk = {std::unique_ptr<confusion_matrix[]>(
+			new confusion_matrix[count]), 0, count};
+	chunks.push_back(std::move(chunk));
+}
+
+/**
+ * push_back - add a match, starting a new block when the last one is full.
+ *
+ * Parameters
+ *   confusion_matrix - the match
+ */
+void match_arena::push_back(const confusion_matrix & match)
+{
+	if (chunks.empty() || chunks.back().used == chunks.back().capacity)
+		reserve(ARENA_CHUNK_MATCHES);
+	arena_chunk & chunk = chunks.back();
+	chunk.matches[chunk.used++] = match;
+	match_count++;
+}
+
+/**
+ * splice - add the matches of another arena to the end of this one,
+ * leaving it empty.
+ *
+ * When they fit in the room left in the last block, such as a reservation,
+ * they are copied there so the arena stays in as few blocks as possible.
+ * Otherwise the other arena's blocks are moved over as they are.
+ *
+ * Parameters
+ *   match_arena - the arena whose matches follow this one's
+ */
+void match_arena::splice(match_arena & other)
+{
+	size_t room = chunks.empty() ? 0 :
+		chunks.back().capacity - chunks.back().used;
+	if (other.match_count != 0 && other.match_count <= room)
+	{
+		arena_chunk & last = chunks.back();
+		for (size_t c = 0; c < other.chunks.size(); c++)
+		{
+			std::copy(other.chunks[c].matches.get(),
+					other.chunks[c].matches.get() + other.chunks[c].used,
+					last.matches.get() + last.used);
+			last.used += other.chunks[c].used;
+		}
+	}
+	else
+		for (size_t c = 0; c < other.chunks.size(); c++)
+			if (other.chunks[c].used != 0)
+				chunks.push_back(std::move(other.chunks[c]));
+	match_count += other.match_count;
+	other.chunks.clear();
+	other.match_count = 0;
+}
+
+/**
+ * size - the number of matches held.
+ *
+ * Returns
+ *   size_t - the match count
+ */
+size_t match_arena::size() const
+{
+	return match_count;
+}
+
+/**
+ * empty - whether the arena holds no matches.
+ *
+ * Returns
+ *   bool - if the match count is 0
+ */
+bool match_arena::empty() const
+{
+	return match_count == 0;
+}
+
+/**
+ * chunk_count - the number of blocks, some of which may be empty.
+ *
+ * Returns
+ *   size_t - the block count
+ */
+size_t match_arena::chunk_count() const
+{
+	return chunks.size();
+}
+
+/**
+ * chunk_data - the matches of one block.
+ *
+ * Parameters
+ *   size_t - the block
+ *
+ * Returns
+ *   const confusion_matrix * - the first match of the block
+ */
+const confusion_matrix * match_arena::chunk_data(size_t chunk) const
+{
+	return chunks[chunk].matches.get();
+}
+
+/**
+ * chunk_size - the number of matches in one block.
+ *
+ * Parameters
+ *   size_t - the block
+ *
+ * Returns
+ *   size_t - the matches used in the block
+ */
+size_t match_arena::chunk_size(size_t chunk) const
+{
+	return chunks[chunk].used;
+}
+
+/**
+ * begin - iterate from the first match.
+ *
+ * Returns
+ *   const_iterator - at the first match, or end() if there is none
+ */
+match_arena::const_iterator match_arena::begin() const
+{
+	return const_iterator(&chunks, 0, 0);
+}
+
+/**
+ * end - the iterator past the last match.
+ *
+ * Returns
+ *   const_iterator - past the last block
+ */
+match_arena::const_iterator match_arena::end() const
+{
+	return const_iterator(&chunks, chunks.size(), 0);
+}
+
+/**
+ * const_iterator - point at a match of an arena's blocks, moving on past
+ * empty blocks.
+ *
+ * Parameters
+ *   std::vector - the blocks of the arena
+ *   size_t - the block
+ *   size_t - the match within the block
+ */
+match_arena::const_iterator::const_iterator(
+		const std::vector<arena_chunk> * chunks, size_t chunk, size_t offset)
+	: chunks(chunks), chunk(chunk), offset(offset)
+{
+	skip_empty();
+}
+
+/**
+ * operator* - the current match.
+ *
+ * Returns
+ *   confusion_matrix - the match
+ */
+match_arena::const_iterator::reference
+match_arena::const_iterator::operator*() const
+{
+	return (*chunks)[chunk].matches[offset];
+}
+
+/**
+ * operator-> - the current match.
+ *
+ * Returns
+ *   const confusion_matrix * - the match
+ */
+match_arena::const_iterator::pointer
+match_arena::const_iterator::operator->() const
+{
+	return &(*chunks)[chunk].matches[offset];
+}
+
+/**
+ * operator++ - move to the next match.
+ *
+ * Returns
+ *   const_iterator - this iterator
+ */
+match_arena::const_iterator & match_arena::const_iterator::operator++()
+{
+	offset++;
+	skip_empty();
+	return *this;
+}
+
+/**
+ * operator== - whether two iterators are at the same match.
+ *
+ * Returns
+ *   bool - if both point at the same block and match
+ */
+bool match_arena::const_iterator::operator==(
+		const const_iterator & other) const
+{
+	return chunk == other.chunk && offset == other.offset;
+}
+
+/**
+ * operator!= - whether two iterators are at different matches.
+ *
+ * Returns
+ *   bool - if they point at different blocks or matches
+ */
+bool match_arena::const_iterator::operator!=(
+		const const_iterator & other) const
+{
+	return !(*this == other);
+}
+
+/**
+ * skip_empty - move past the end of used blocks to the next match.
+ */
+void match_arena::const_iterator::skip_empty()
+{
+	while (chunk < chunks->size() && offset >= (*chunks)[chunk].used)
+	{
+		chunk++;
+		offset = 0;
+	}
+}
+
+/**
+ * arena_sink - make a sink with room reserved for some matches.
+ *
+ * Parameters
+ *   size_t - the matches to reserve room for, such as an estimate_matches
+ *            result, capped at ARENA_RESERVE_LIMIT
+ */
+arena_sink::arena_sink(size_t expected)
+{
+	if (expected != 0)
+		arena.reserve(std::min(expected, ARENA_RESERVE_LIMIT));
+}
+
+/**
+ * write_match - keep a matching matrix.
+ *
+ * Parameters
+ *   count_int - TP
+ *   count_int - FN
+ *   count_int - FP
+ *   count_int - TN
+ */
+void arena_sink::write_match(count_int TP, count_int FN, count_int FP,
+		count_int TN)
+{
+	confusion_matrix match = {TP, FN, FP, TN};
+	arena.push_back(match);
+}
+
+/**
+ * make_buffer - make an empty arena_sink for one chunk of a threaded search.
+ *
+ * Returns
+ *   result_sink - an empty arena_sink
+ */
+std::unique_ptr<result_sink> arena_sink::make_buffer(
+		const search_context &) const
+{
+	return std::unique_ptr<result_sink>(new arena_sink());
+}
+
+/**
+ * append - add the matches of a chunk buffer to this sink, see splice.
+ *
+ * Parameters
+ *   result_sink - the arena_sink made by make_buffer, left empty
+ */
+void arena_sink::append(result_sink & buffered)
+{
+	arena.splice(static_cast<arena_sink &>(buffered).arena);
+}
+
+/**
+ * results - the matches kept so far.
+ *
+ * Returns
+ *   match_arena - the matches, in search order
+ */
+const match_arena & arena_sink::results() const
+{
+	return arena;
+}
+
+/**
+ * take - hand the matches over, leaving the sink empty.
+ *
+ * Returns
+ *   match_arena - the matches, in search order
+ */
+match_arena arena_sink::take()
+{
+	return std::move(arena);
+}
+
+/**
+ * callback_sink - make a sink calling a function for every match.
+ *
+ * Parameters
+ *   std::function - called with each match, in search order
+ */
+callback_sink::callback_sink(
+		const std::function<void(const confusion_matrix &)> & callback)
+	: callback(callback)
+{
+}
+
+/**
+ * write_match - pass a matching matrix to the callback.
+ *
+ * Parameters
+ *   count_int - TP
+ *   count_int - FN
+ *   count_int - FP
+ *   count_int - TN
+ */
+void callback_sink::write_match(count_int TP, count_int FN, count_int FP,
+		count_int TN)
+{
+	confusion_matrix match = {TP, FN, FP, TN};
+	callback(match);
+}
+
+// Bytes a file-backed match_sink buffers before writing them out.
+const size_t SINK_FLUSH_BYTES = 1 << 20;
+
+// Starting buffer size of an in-memory match_sink, which grows as needed.
+const size_t SINK_MEMORY_BYTES = 1 << 12;
+
+// Longest match match_sink::write_match can encode, excluding the suffix.
+const size_t SINK_ROW_BYTES = 4 * 21;
+
+/**
+ * match_sink - make a sink, formatting the target columns of every row.
+ *
+ * The targets are formatted as an ostream would, with six significant
+ * digits, and a target range as its two ends joined by a colon. Each
+ * targeted registry metric adds a column.
+ *
+ * Parameters
+ *   search_context - the class counts and targets of the search
+ *   output_format - the layout to write
+ *   int - the file descriptor to write to, or -1 to keep matches in memory
+ *   const char * - the query id that starts every csv row or JSON object,
+ *                  or NULL for none
+ */
+match_sink::match_sink(const search_context & context, output_format format,
+		int fd, const char * tag)
+	: fd(fd), format(format), tagged(tag != NULL),
+	buffer(fd == -1 ? SINK_MEMORY_BYTES : SINK_FLUSH_BYTES), used(0),
+	match_count(0), previous_tp(0), previous_fp(0), run_tp(0), run_fp(0),
+	run_step_tp(0), run_step_fp(0), run_length(0)
+{
+	// A target searched as a range is written as its low:high ends.
+	const double targets[5] = {context.target_accuracy,
+		context.target_sensitivity, context.target_specificity,
+		context.target_f1, context.target_precision};
+	const target_range * ranges[5] = {&context.ranges.accuracy,
+		&context.ranges.sensitivity, &context.ranges.specificity,
+		&context.ranges.f1, &context.ranges.precision};
+	char text[64];
+	for (int v = 0; v < 5; v++)
+	{
+		if (ranges[v]->low != ranges[v]->high)
+			snprintf(text, sizeof(text), "%g:%g,", ranges[v]->low,
+					ranges[v]->high);
+		else
+			snprintf(text, sizeof(text), "%g,", targets[v]);
+		suffix += text;
+	}
+
+	// Targeted registry metrics follow, each with its own column.
+	for (int k = 0; k < EXTRA_METRIC_COUNT; k++)
+	{
+		if (!((context.ranges.extra_mask >> k) & 1))
+			continue;
+		const target_range & range = context.ranges.extra[k];
+		if (range.low != range.high)
+			snprintf(text, sizeof(text), "%g:%g,", range.low, range.high);
+		else
+			snprintf(text, sizeof(text), "%g,", range.low);
+		suffix += text;
+		columns += EXTRA_METRICS[k].column;
+		columns += ",";
+	}
+	suffix += "\n";
+	columns += "\n";
+	if (tagged)
+	{
+		this->tag = tag;
+		prefix = this->tag + ",";
+	}
+	if (format == FORMAT_JSON)
+	{
+		prefix = std::string("{\"id\":") + (tagged ? tag : "null") +
+			",\"match\":[";
+		suffix = "]}\n";
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, BINARY_MAGIC, sizeof(header.magic));
+	header.version = BINARY_VERSION;
+	header.format = (uint32_t)format;
+	header.class_a_count = context.class_a_count;
+	header.class_b_count = context.class_b_count;
+	header.decimal_places = context.decimal_places;
+	header.targets[0] = context.target_accuracy;
+	header.targets[1] = context.target_sensitivity;
+	header.targets[2] = context.target_specificity;
+	header.targets[3] = context.target_f1;
+	header.targets[4] = context.target_precision;
+}
+
+/**
+ * ~match_sink - write out anything still buffered.
+ */
+match_sink::~match_sink()
+{
+	flush();
+}
+
+/**
+ * begin - write the csv header line or the binary header. JSON has no
+ * header.
+ */
+void match_sink::begin()
+{
+	if (format == FORMAT_JSON)
+		return;
+	if (format == FORMAT_CSV)
+	{
+		const char * HEADER =
+			"TP,FN,FP,TN,Accuracy,Sensitivity,Specificity,F1,Precision,";
+		if (tagged)
+			write_text("Query,", 6);
+		write_text(HEADER, strlen(HEADER));
+		write_text(columns.data(), columns.size());
+	}
+	else
+	{
+		write_text((const char *)&header, sizeof(header));
+	}
+}
+
+/**
+ * write_match - write a matching matrix, as one csv row with the targets or
+ * as its (TP, FP) pair.
+ *
+ * Parameters
+ *   count_int - TP
+ *   count_int - FN
+ *   count_int - FP
+ *   count_int - TN
+ */
+void match_sink::write_match(count_int TP, count_int FN, count_int FP,
+		count_int TN)
+{
+	match_count++;
+	if (format == FORMAT_RUNS)
+	{
+		add_run(TP, FP, 0, 0, 1);
+		return;
+	}
+	if (format == FORMAT_BINARY)
+	{
+		reserve(2 * sizeof(int32_t));
+		int32_t pair[2] = {(int32_t)TP, (int32_t)FP};
+		memcpy(&buffer[used], pair, sizeof(pair));
+		used += sizeof(pair);
+		return;
+	}
+	if (format == FORMAT_VARINT)
+	{
+		reserve(SINK_ROW_BYTES);
+		write_varint(TP - previous_tp);
+		write_varint(FP - previous_fp);
+		previous_tp = TP;
+		previous_fp = FP;
+		return;
+	}
+
+	reserve(SINK_ROW_BYTES + prefix.size() + suffix.size());
+
+	count_int values[4] = {TP, FN, FP, TN};
+	char * row = &buffer[used];
+	memcpy(row, prefix.data(), prefix.size());
+	row += prefix.size();
+	for (int v = 0; v < 4; v++)
+	{
+		// Counts are never negative, so only digits and a comma are written.
+		char digits[20];
+		int length = 0;
+		unsigned long long value = (unsigned long long)values[v];
+		do
+		{
+			digits[length++] = (char)('0' + value % 10);
+			value /= 10;
+		} while (value != 0);
+		while (length > 0)
+			*row++ = digits[--length];
+		*row++ = ',';
+	}
+	// The JSON array has no trailing comma.
+	if (format == FORMAT_JSON)
+		row--;
+	memcpy(row, suffix.data(), suffix.size());
+	used = (size_t)(row - &buffer[0]) + suffix.size();
+}
+
+/**
+ * write_varint - append a signed value as a zigzag LEB128 varint.
+ *
+ * Parameters
+ *   long long - the value to append, the buffer must have room for 10 bytes
+ */
+void match_sink::write_varint(long long value)
+{
+	uint64_t zigzag = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+	while (zigzag >= 0x80)
+	{
+		buffer[used++] = (char)(zigzag | 0x80);
+		zigzag >>= 7;
+	}
+	buffer[used++] = (char)zigzag;
+}
+
+/**
+ * write_run - write a run of matches along one accuracy diagonal. For
+ * FORMAT_RUNS it extends the runs in one step, otherwise it writes the
+ * matches one at a time.
+ *
+ * Parameters
+ *   count_int - TP of the first match
+ *   count_int - FN of the first match
+ *   count_int - FP of the first match
+ *   count_int - TN of the first match
+ *   count_int - the number of matches, each with one fewer TP and FP and one
+ *               more FN and TN than the one before
+ */
+void match_sink::write_run(count_int TP, count_int FN, count_int FP,
+		count_int TN, count_int length)
+{
+	if (format != FORMAT_RUNS)
+	{
+		result_sink::write_run(TP, FN, FP, TN, length);
+		return;
+	}
+	match_count += (uint64_t)length;
+	add_run(TP, FP, -1, -1, length);
+}
+
+/**
+ * add_run - extend the runs of FORMAT_RUNS with a run of (TP, FP) pairs,
+ * exactly as if its pairs were added one at a time.
+ *
+ * A pair after a single pair sets the step of their run, and a pair that
+ * does not continue a run's step ends it and starts the next.
+ *
+ * Parameters
+ *   count_int - TP of the first pair
+ *   count_int - FP of the first pair
+ *   count_int - the step of TP from one pair to the next
+ *   count_int - the step of FP from one pair to the next
+ *   count_int - the number of pairs, at least 1
+ */
+void match_sink::add_run(count_int TP, count_int FP, count_int step_tp,
+		count_int step_fp, count_int length)
+{
+	// The first pair.
+	if (run_length == 1)
+	{
+		run_step_tp = TP - run_tp;
+		run_step_fp = FP - run_fp;
+		run_length = 2;
+	}
+	else if (run_length != 0 && TP == run_tp + run_length * run_step_tp &&
+			FP == run_fp + run_length * run_step_fp)
+		run_length++;
+	else
+	{
+		write_pending_run();
+		run_tp = TP;
+		run_fp = FP;
+		run_length = 1;
+	}
+	if (length == 1)
+		return;
+
+	// The rest continue the run when it has their step, or just began.
+	if (run_length == 1 || (run_step_tp == step_tp && run_step_fp == step_fp))
+	{
+		run_step_tp = step_tp;
+		run_step_fp = step_fp;
+		run_length += length - 1;
+		return;
+	}
+	write_pending_run();
+	run_tp = TP + step_tp;
+	run_fp = FP + step_fp;
+	run_step_tp = step_tp;
+	run_step_fp = step_fp;
+	run_length = length - 1;
+}
+
+/**
+ * write_pending_run - encode the last run of FORMAT_RUNS, if there is one,
+ * as its length, the zigzag varint deltas of its first pair from the first
+ * pair of the run before and, for more than one pair, its steps.
+ */
+void match_sink::write_pending_run()
+{
+	if (run_length == 0)
+		return;
+	reserve(SINK_ROW_BYTES);
+	write_varint(run_length);
+	write_varint(run_tp - previous_tp);
+	write_varint(run_fp - previous_fp);
+	if (run_length > 1)
+	{
+		write_varint(run_step_tp);
+		write_varint(run_step_fp);
+	}
+	previous_tp = run_tp;
+	previous_fp = run_fp;
+	run_length = 0;
+}
+
+/**
+ * make_buffer - make an in-memory sink for one chunk of a threaded search.
+ *
+ * Parameters
+ *   search_context - the class counts and targets of the search
+ *
+ * Returns
+ *   result_sink - an in-memory match_sink with the same format and tag
+ */
+std::unique_ptr<result_sink> match_sink::make_buffer(
+		const search_context & context) const
+{
+	return std::unique_ptr<result_sink>(new match_sink(context, format, -1,
+				tagged ? tag.c_str() : NULL));
+}
+
+/**
+ * append - write the matches collected by an in-memory sink.
+ *
+ * Parameters
+ *   result_sink - the in-memory match_sink to take the matches from
+ */
+void match_sink::append(result_sink & buffered)
+{
+	const match_sink & other = static_cast<const match_sink &>(buffered);
+	if (format == FORMAT_RUNS)
+	{
+		// The chunk's runs are added in turn, so a run crossing into it is
+		// joined just as if its matches had been written here.
+		const unsigned char * chunk = (const unsigned char *)&other.buffer[0];
+		size_t offset = 0;
+		long long TP = 0, FP = 0;
+		while (offset < other.used)
+		{
+			long long length = 0, tp_delta = 0, fp_delta = 0;
+			long long step_tp = 0, step_fp = 0;
+			// The chunk was encoded by add_run, so a short read is a bug and
+			// the rest of the chunk is dropped rather than misread.
+			bool complete = read_varint(chunk, other.used, offset, length) &&
+				read_varint(chunk, other.used, offset, tp_delta) &&
+				read_varint(chunk, other.used, offset, fp_delta) &&
+				length >= 1 && (length == 1 ||
+					(read_varint(chunk, other.used, offset, step_tp) &&
+					read_varint(chunk, other.used, offset, step_fp)));
+			assert(complete);
+			if (!complete)
+				break;
+			TP += tp_delta;
+			FP += fp_delta;
+			add_run(TP, FP, step_tp, step_fp, length);
+		}
+		if (other.run_length != 0)
+			add_run(other.run_tp, other.run_fp, other.run_step_tp,
+					other.run_step_fp, other.run_length);
+		match_count += other.match_count;
+		return;
+	}
+	if (format == FORMAT_VARINT)
+	{
+		// A chunk is delta encoded from (0, 0), so only its first pair is
+		// re-encoded against this sink's previous pair.
+		if (other.match_count == 0)
+			return;
+		size_t offset = 0;
+		long long TP = 0, FP = 0;
+		const unsigned char * chunk = (const unsigned char *)&other.buffer[0];
+		read_varint(chunk, other.used, offset, TP);
+		read_varint(chunk, other.used, offset, FP);
+		write_match(TP, 0, FP, 0);
+		write_text(&other.buffer[offset], other.used - offset);
+		match_count += other.match_count - 1;
+		previous_tp = other.previous_tp;
+		previous_fp = other.previous_fp;
+		return;
+	}
+
+	match_count += other.match_count;
+	if (fd != -1 && other.used >= SINK_FLUSH_BYTES)
+	{
+		flush();
+		write_out(&other.buffer[0], other.used);
+		return;
+	}
+	write_text(&other.buffer[0], other.used);
+}
+
+/**
+ * finish - write out everything buffered and, for the binary formats,
+ * rewrite the header with the final match count.
+ */
+void match_sink::finish()
+{
+	if (format == FORMAT_RUNS)
+		write_pending_run();
+	flush();
+	if (fd == -1 || format == FORMAT_CSV)
+		return;
+
+	header.match_count = match_count;
+	if (pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header))
+	{
+		std::cerr << "Failed to write the output file." << std::endl;
+		exit(1);
+	}
+}
+
+/**
+ * flush - write the buffered matches to the file descriptor, if there is
+ * one.
+ */
+void match_sink::flush()
+{
+	if (fd == -1 || used == 0)
+		return;
+	write_out(&buffer[0], used);
+	used = 0;
+}
+
+/**
+ * data - the bytes an in-memory sink holds.
+ *
+ * Returns
+ *   const char * - the start of the buffered bytes
+ */
+const char * match_sink::data() const
+{
+	return &buffer[0];
+}
+
+/**
+ * size - the number of bytes buffered.
+ *
+ * Returns
+ *   size_t - the length of data()
+ */
+size_t match_sink::size() const
+{
+	return used;
+}
+
+/**
+ * matches - the number of matches written to the sink.
+ *
+ * Returns
+ *   uint64_t - the match count
+ */
+uint64_t match_sink::matches() const
+{
+	return match_count;
+}
+
+/**
+ * write_text - append raw bytes, such as a header.
+ *
+ * Parameters
+ *   const char * - the bytes to append
+ *   size_t - the number of bytes
+ */
+void match_sink::write_text(const char * text, size_t length)
+{
+	reserve(length);
+	memcpy(&buffer[used], text, length);
+	used += length;
+}
+
+/**
+ * reserve - make room in the buffer for a further number of bytes, by
+ * flushing a file-backed sink or growing an in-memory one.
+ *
+ * Parameters
+ *   size_t - the number of bytes about to be written
+ */
+void match_sink::reserve(size_t length)
+{
+	if (used + length <= buffer.size())
+		return;
+	if (fd != -1)
+		flush();
+	if (used + length > buffer.size())
+		buffer.resize(std::max(buffer.size() * 2, used + length));
+}
+
+/**
+ * write_out - write a block of bytes to the file descriptor, retrying short
+ * writes.
+ *
+ * Parameters
+ *   const char * - the bytes to write
+ *   size_t - the number of bytes
+ */
+void match_sink::write_out(const char * data, size_t length)
+{
+	STATS_TIMER(start);
+	STATS_TOTAL(bytes_written, length);
+	while (length > 0)
+	{
+		ssize_t written = ::write(fd, data, length);
+		if (written < 0)
+		{
+			std::cerr << "Failed to write the output file." << std::endl;
+			exit(1);
+		}
+		data += written;
+		length -= (size_t)written;
+	}
+	STATS_ELAPSED(output_ns, start);
+}
+
+/**
+ * binary_result_reader - make a reader with no file open.
+ */
+binary_result_reader::binary_result_reader()
+	: data(NULL), size(0), offset(0), remaining(0), previous_tp(0),
+	previous_fp(0), run_tp(0), run_fp(0), run_step_tp(0), run_step_fp(0),
+	run_left(0)
+{
+}
+
+/**
+ * ~binary_result_reader - unmap the file, if one is open.
+ */
+binary_result_reader::~binary_result_reader()
+{
+	if (data != NULL)
+		munmap((void *)data, size);
+}
+
+/**
+ * open - map a binary output file and check its header.
+ *
+ * Parameters
+ *   const char * - the path of the file
+ *
+ * Returns
+ *   bool - if the file is a readable binary output file
+ */
+bool binary_result_reader::open(const char * path)
+{
+	int fd = ::open(path, O_RDONLY);
+	if (fd == -1)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(binary_header))
+	{
+		close(fd);
+		return false;
+	}
+	void * mapped = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE,
+			fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED)
+		return false;
+
+	data = (const unsigned char *)mapped;
+	size = (size_t)info.st_size;
+	offset = sizeof(binary_header);
+
+	const binary_header & file_header = header();
+	remaining = file_header.match_count;
+	bool packed_fits = file_header.format != FORMAT_BINARY ||
+		(size - offset) / (2 * sizeof(int32_t)) >= remaining;
+	return memcmp(file_header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) == 0 &&
+		file_header.version == BINARY_VERSION &&
+		(file_header.format == FORMAT_BINARY ||
+		 file_header.format == FORMAT_VARINT ||
+		 file_header.format == FORMAT_RUNS) && packed_fits;
+}
+
+/**
+ * header - the run parameters of the open file.
+ *
+ * Returns
+ *   binary_header - the header at the start of the mapped file
+ */
+const binary_header & binary_result_reader::header() const
+{
+	return *(const binary_header *)data;
+}
+
+/**
+ * pairs - the packed (TP, FP) pairs of a FORMAT_BINARY file, read in place.
+ *
+ * Returns
+ *   const int32_t * - header().match_count pairs, or NULL for other formats
+ */
+const int32_t * binary_result_reader::pairs() const
+{
+	if (header().format != FORMAT_BINARY)
+		return NULL;
+	return (const int32_t *)(data + sizeof(binary_header));
+}
+
+/**
+ * next - read the next match of the file.
+ *
+ * Parameters
+ *   count_int & - set to the TP of the match
+ *   count_int & - set to the FP of the match
+ *
+ * Returns
+ *   bool - false once every match has been read, or the file is truncated
+ */
+bool binary_result_reader::next(count_int & TP, count_int & FP)
+{
+	if (header().format == FORMAT_RUNS)
+	{
+		if (run_left == 0 && !next_run(run_tp, run_fp, run_step_tp,
+					run_step_fp, run_left))
+			return false;
+		TP = run_tp;
+		FP = run_fp;
+		run_tp += run_step_tp;
+		run_fp += run_step_fp;
+		run_left--;
+		return true;
+	}
+	if (remaining == 0)
+		return false;
+
+	if (header().format == FORMAT_BINARY)
+	{
+		int32_t pair[2];
+		memcpy(pair, data + offset, sizeof(pair));
+		offset += sizeof(pair);
+		TP = pair[0];
+		FP = pair[1];
+		remaining--;
+		return true;
+	}
+
+	long long tp_delta, fp_delta;
+	if (!read_varint(data, size, offset, tp_delta) ||
+			!read_varint(data, size, offset, fp_delta))
+		return false;
+	previous_tp += tp_delta;
+	previous_fp += fp_delta;
+	TP = previous_tp;
+	FP = previous_fp;
+	remaining--;
+	return true;
+}
+
+/**
+ * next_run - read the next run of matches of the file. Other formats are
+ * read as runs of one match.
+ *
+ * Parameters
+ *   count_int & - set to the TP of the first match of the run
+ *   count_int & - set to the FP of the first match of the run
+ *   count_int & - set to the step of TP from one match to the next
+ *   count_int & - set to the step of FP from one match to the next
+ *   count_int & - set to the number of matches in the run
+ *
+ * Returns
+ *   bool - false once every match has been read, or the file is truncated
+ */
+bool binary_result_reader::next_run(
+		count_int & TP,
+		count_int & FP,
+		count_int & step_tp,
+		count_int & step_fp,
+		count_int & length
+		)
+{
+	if (header().format != FORMAT_RUNS)
+	{
+		step_tp = 0;
+		step_fp = 0;
+		length = 1;
+		return next(TP, FP);
+	}
+
+	// What next has not yet expanded of the current run comes first.
+	if (run_left != 0)
+	{
+		TP = run_tp;
+		FP = run_fp;
+		step_tp = run_step_tp;
+		step_fp = run_step_fp;
+		length = run_left;
+		run_left = 0;
+		return true;
+	}
+	if (remaining == 0)
+		return false;
+
+	long long tp_delta, fp_delta;
+	step_tp = 0;
+	step_fp = 0;
+	if (!read_varint(data, size, offset, length) ||
+			!read_varint(data, size, offset, tp_delta) ||
+			!read_varint(data, size, offset, fp_delta) ||
+			length < 1 || (uint64_t)length > remaining ||
+			(length > 1 && (!read_varint(data, size, offset, step_tp) ||
+				!read_varint(data, size, offset, step_fp))))
+		return false;
+	previous_tp += tp_delta;
+	previous_fp += fp_delta;
+	TP = previous_tp;
+	FP = previous_fp;
+	remaining -= (uint64_t)length;
+	return true;
+}
+
+/**
+ * read_varint - read a zigzag LEB128 varint, as match_sink writes them.
+ *
+ * Parameters
+ *   const unsigned char * - the encoded bytes
+ *   size_t - the number of bytes
+ *   size_t & - the offset of the varint, moved past it
+ *   long long & - set to the value
+ *
+ * Returns
+ *   bool - false if the bytes end first or the varint is over 64 bits
+ */
+bool read_varint(const unsigned char * data, size_t size, size_t & offset,
+		long long & value)
+{
+	uint64_t zigzag = 0;
+	int shift = 0;
+	while (true)
+	{
+		if (offset >= size || shift > 63)
+			return false;
+		unsigned char byte = data[offset++];
+		zigzag |= (uint64_t)(byte & 0x7f) << shift;
+		shift += 7;
+		if (!(byte & 0x80))
+			break;
+	}
+	value = (long long)(zigzag >> 1) ^ -(long long)(zigzag & 1);
+	return true;
+}
+
+/**
+ * decode_binary_output - print a binary output file to stdout as csv.
+ *
+ * Parameters
+ *   const char * - the path of the binary file
+ *
+ * Returns
+ *   int - the process exit code
+ */
+int decode_binary_output(const char * path)
+{
+	binary_result_reader reader;
+	if (!reader.open(path))
+	{
+		std::cerr << "Not a readable binary output file: " << path << std::endl;
+		return(1);
+	}
+
+	const binary_header & header = reader.header();
+	search_context context = search_context();
+	context.class_a_count = header.class_a_count;
+	context.class_b_count = header.class_b_count;
+	context.decimal_places = header.decimal_places;
+	context.target_accuracy = header.targets[0];
+	context.target_sensitivity = header.targets[1];
+	context.target_specificity = header.targets[2];
+	context.target_f1 = header.targets[3];
+	context.target_precision = header.targets[4];
+
+	match_sink out(context, FORMAT_CSV, STDOUT_FILENO);
+	out.begin();
+	count_int TP, FP;
+	while (reader.next(TP, FP))
+		out.write_match(TP, header.class_a_count - TP, FP,
+				header.class_b_count - FP);
+	out.finish();
+	return(0);
+}
+
+/**
+ * index_entry - a matrix and its rounded metrics, while an index is built.
+ */
+struct index_entry
+{
+	int32_t values[5];
+	int32_t tp;
+	int32_t fp;
+	int32_t correct;
+};
+
+/**
+ * index_entry_before - the order of an index: by rounded metrics, then in
+ * search order, most correct predictions first and then largest TP first.
+ *
+ * Parameters
+ *   index_entry - the left entry
+ *   index_entry - the right entry
+ *
+ * Returns
+ *   bool - if the left entry sorts before the right one
+ */
+static bool index_entry_before(const index_entry & left,
+		const index_entry & right)
+{
+	for (int v = 0; v < 5; v++)
+		if (left.values[v] != right.values[v])
+			return left.values[v] < right.values[v];
+	if (left.correct != right.correct)
+		return left.correct > right.correct;
+	return left.tp > right.tp;
+}
+
+/**
+ * build_index - write an index of every matrix of the given class counts,
+ * keyed by its rounded metrics.
+ *
+ * Parameters
+ *   count_int - count of items in class A
+ *   count_int - count of items in class B
+ *   int - the number of decimal places to round to
+ *   int - the number of worker threads
+ *   const char * - the path of the index file
+ *
+ * Returns
+ *   int - the process exit code
+ */
+int build_index(
+		count_int class_a_count,
+		count_int class_b_count,
+		int decimal_places,
+		int thread_count,
+		const char * path
+		)
+{
+	if (decimal_places > INDEX_MAX_DECIMAL_PLACES)
+	{
+		std::cerr << "An index holds at most " << INDEX_MAX_DECIMAL_PLACES <<
+			" decimal places." << std::endl;
+		return(1);
+	}
+	// With at most 2^32 matrices every count of the index fits an int32.
+	uint64_t matrix_count = (uint64_t)(class_a_count + 1) * (class_b_count + 1);
+	if (class_a_count >= UINT32_MAX || class_b_count >= UINT32_MAX ||
+			matrix_count > UINT32_MAX)
+	{
+		std::cerr << "Too many matrices for an index." << std::endl;
+		return(1);
+	}
+
+	// Each thread fills whole rows of one TP. The matrix with no correct
+	// predictions (TP 0, FP class_b_count) is never searched, so it is
+	// dropped before sorting.
+	std::vector<index_entry> entries((size_t)matrix_count);
+	long long scale = power_of_ten(decimal_places);
+	std::atomic<int> next_row(0);
+	std::vector<std::thread> workers;
+	for (int t = 0; t < std::max(1, thread_count); t++)
+	{
+		workers.emplace_back([&]() {
+			int TP;
+			while ((TP = next_row++) <= class_a_count)
+			{
+				int FN = (int)(class_a_count - TP);
+				for (int FP = 0; FP <= class_b_count; FP++)
+				{
+					int TN = (int)(class_b_count - FP);
+					index_entry & entry =
+						entries[(size_t)TP * (class_b_count + 1) + FP];
+					entry.values[0] = rounded_ratio(TP + TN,
+							class_a_count + class_b_count, scale);
+					entry.values[1] = rounded_ratio(TP, class_a_count, scale);
+					entry.values[2] = rounded_ratio(TN, class_b_count, scale);
+					entry.values[3] = rounded_ratio(2 * (long long)TP,
+							2 * (long long)TP + FP + FN, scale);
+					entry.values[4] = rounded_ratio(TP, TP + FP, scale);
+					entry.tp = TP;
+					entry.fp = FP;
+					entry.correct = TP + TN;
+				}
+			}
+		});
+	}
+	for (size_t t = 0; t < workers.size(); t++)
+		workers[t].join();
+
+	entries.erase(entries.begin() + class_b_count);
+	std::sort(entries.begin(), entries.end(), index_entry_before);
+
+	std::vector<index_key> keys;
+	std::vector<int32_t> pairs(entries.size() * 2);
+	for (size_t e = 0; e < entries.size(); e++)
+	{
+		if (keys.empty() || memcmp(keys.back().values, entries[e].values,
+					sizeof(entries[e].values)) != 0)
+		{
+			index_key key;
+			memcpy(key.values, entries[e].values, sizeof(key.values));
+			key.first = (uint32_t)e;
+			key.count = 0;
+			keys.push_back(key);
+		}
+		keys.back().count++;
+		pairs[2 * e] = entries[e].tp;
+		pairs[2 * e + 1] = entries[e].fp;
+	}
+
+	index_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+	header.version = INDEX_VERSION;
+	header.class_a_count = (int32_t)class_a_count;
+	header.class_b_count = (int32_t)class_b_count;
+	header.decimal_places = decimal_places;
+	header.key_count = keys.size();
+	header.matrix_count = entries.size();
+
+	FILE * file = fopen(path, "wb");
+	if (file == NULL)
+	{
+		std::cerr << "Failed to open the index file." << std::endl;
+		return(1);
+	}
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(keys.data(), sizeof(index_key), keys.size(), file) == keys.size() &&
+		fwrite(pairs.data(), sizeof(int32_t), pairs.size(), file) == pairs.size();
+	if (fclose(file) != 0 || !written)
+	{
+		std::cerr << "Failed to write the index file." << std::endl;
+		return(1);
+	}
+	return(0);
+}
+
+/**
+ * rounded_ratio - a ratio scaled by 10^dp and rounded half up, as the exact
+ * band tests round it.
+ *
+ * Parameters
+ *   long long - the numerator
+ *   long long - the denominator
+ *   long long - the decimal scale, 10^dp
+ *
+ * Returns
+ *   int - the rounded ratio, or -1 if the denominator is 0
+ */
+int rounded_ratio(long long numerator, long long denominator, long long scale)
+{
+	if (denominator == 0)
+		return -1;
+	return (int)(((wide_int)2 * numerator * scale + denominator) /
+			(2 * (wide_int)denominator));
+}
+
+/**
+ * lookup_index - write the matrices meeting the targets, read from an index
+ * rather than searched for.
+ *
+ * The output is the same as find_matrices writes with an exact engine.
+ *
+ * Parameters
+ *   const char * - the path of the index file
+ *   count_int - count of items in class A
+ *   count_int - count of items in class B
+ *   int - the number of decimal places to round to
+ *   double - the target accuracy
+ *   double - the target sensitivity
+ *   double - the target specificity
+ *   double - the target f1 score
+ *   double - the target precision
+ *   output_format - the layout of the output file
+ *   const char * - the path of the output file
+ *
+ * Returns
+ *   int - the process exit code
+ */
+int lookup_index(
+		const char * index_path,
+		count_int class_a_count,
+		count_int class_b_count,
+		int decimal_places,
+		double target_accuracy,
+		double target_sensitivity,
+		double target_specificity,
+		double target_f1,
+		double target_precision,
+		output_format format,
+		const char * output_path
+		)
+{
+	matrix_index index;
+	if (!index.open(index_path))
+	{
+		std::cerr << "Not a readable index file: " << index_path << std::endl;
+		return(1);
+	}
+	const index_header & header = index.header();
+	if (header.class_a_count != class_a_count ||
+			header.class_b_count != class_b_count ||
+			header.decimal_places != decimal_places)
+	{
+		std::cerr << "The index was built for " << header.class_a_count << "/" <<
+			header.class_b_count << " samples at " << header.decimal_places <<
+			" decimal places." << std::endl;
+		return(1);
+	}
+
+	if (!find_positives_vs_negatives(class_a_count + class_b_count,
+				target_accuracy, decimal_places).feasible)
+	{
+		std::cout << "There are no combinations that can achieve this accuracy." <<
+			std::endl;
+		return(0);
+	}
+
+	std::vector<std::pair<int, int> > matches;
+	index.lookup(target_accuracy, target_sensitivity, target_specificity,
+			target_f1, target_precision, matches);
+
+	int fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1)
+	{
+		std::cerr << "Failed to open the output file." << std::endl;
+		return(1);
+	}
+	search_context context = search_context();
+	context.class_a_count = class_a_count;
+	context.class_b_count = class_b_count;
+	context.decimal_places = decimal_places;
+	context.target_accuracy = target_accuracy;
+	context.target_sensitivity = target_sensitivity;
+	context.target_specificity = target_specificity;
+	context.target_f1 = target_f1;
+	context.target_precision = target_precision;
+
+	match_sink file(context, format, fd);
+	file.begin();
+	for (size_t m = 0; m < matches.size(); m++)
+		file.write_match(matches[m].first, class_a_count - matches[m].first,
+				matches[m].second, class_b_count - matches[m].second);
+	file.finish();
+	close(fd);
+	return(0);
+}
+
+/**
+ * matrix_index - make an index reader with no file open.
+ */
+matrix_index::matrix_index()
+	: data(NULL), size(0), keys(NULL), pairs(NULL)
+{
+}
+
+/**
+ * ~matrix_index - unmap the file, if one is open.
+ */
+matrix_index::~matrix_index()
+{
+	if (data != NULL)
+		munmap((void *)data, size);
+}
+
+/**
+ * open - map an index file and check its header.
+ *
+ * Parameters
+ *   const char * - the path of the file
+ *
+ * Returns
+ *   bool - if the file is a readable index file
+ */
+bool matrix_index::open(const char * path)
+{
+	int fd = ::open(path, O_RDONLY);
+	if (fd == -1)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(index_header))
+	{
+		close(fd);
+		return false;
+	}
+	void * mapped = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE,
+			fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED)
+		return false;
+
+	data = (const unsigned char *)mapped;
+	size = (size_t)info.st_size;
+	keys = (const index_key *)(data + sizeof(index_header));
+	pairs = (const int32_t *)(keys + header().key_count);
+
+	const index_header & file_header = header();
+	uint64_t expected = sizeof(index_header) +
+		file_header.key_count * sizeof(index_key) +
+		file_header.matrix_count * 2 * sizeof(int32_t);
+	return memcmp(file_header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0 &&
+		file_header.version == INDEX_VERSION && expected == size;
+}
+
+/**
+ * header - the parameters of the open index.
+ *
+ * Returns
+ *   index_header - the header at the start of the mapped file
+ */
+const index_header & matrix_index::header() const
+{
+	return *(const index_header *)data;
+}
+
+/**
+ * lookup - collect the matrices whose rounded metrics meet the targets.
+ *
+ * Keys are sorted on accuracy first, so the keys sharing every leading
+ * enabled target are found by binary search and the remaining targets are
+ * checked one key at a time.
+ *
+ * Parameters
+ *   double - the target accuracy
+ *   double - the target sensitivity
+ *   double - the target specificity
+ *   double - the target f1 score
+ *   double - the target precision
+ *   std::vector - set to the (TP, FP) pair of every match, in search order
+ */
+void matrix_index::lookup(
+		double target_accuracy,
+		double target_sensitivity,
+		double target_specificity,
+		double target_f1,
+		double target_precision,
+		std::vector<std::pair<int, int> > & matches
+		) const
+{
+	matches.clear();
+	const double targets[5] = {target_accuracy, target_sensitivity,
+		target_specificity, target_f1, target_precision};
+
+	// The rounded value each enabled target needs, -1 for disabled ones.
+	int32_t wanted[5];
+	for (int v = 0; v < 5; v++)
+	{
+		metric_band band = make_metric_band(targets[v], header().decimal_places);
+		if (band.enabled && band.lower == band.upper)
+			return;
+		wanted[v] = band.enabled ? (int32_t)((band.lower + 1) / 2) : -1;
+	}
+
+	int prefix = 0;
+	while (prefix < 5 && wanted[prefix] != -1)
+		prefix++;
+	std::pair<const index_key *, const index_key *> range;
+	range.first = std::lower_bound(keys, keys + header().key_count, wanted,
+			[prefix](const index_key & key, const int32_t * values) {
+				return std::lexicographical_compare(key.values, key.values + prefix,
+						values, values + prefix);
+			});
+	range.second = std::upper_bound(range.first, keys + header().key_count,
+			wanted, [prefix](const int32_t * values, const index_key & key) {
+				return std::lexicographical_compare(values, values + prefix,
+						key.values, key.values + prefix);
+			});
+
+	size_t runs = 0;
+	for (const index_key * key = range.first; key != range.second; key++)
+	{
+		bool match = true;
+		for (int v = prefix; v < 5 && match; v++)
+			match = wanted[v] == -1 || key->values[v] == wanted[v];
+		if (!match)
+			continue;
+		for (uint32_t m = 0; m < key->count; m++)
+			matches.push_back(std::make_pair(pairs[2 * (key->first + m)],
+						pairs[2 * (key->first + m) + 1]));
+		runs++;
+	}
+
+	// Runs from several keys interleave in the search order.
+	if (runs > 1)
+	{
+		int class_b_count = header().class_b_count;
+		std::sort(matches.begin(), matches.end(),
+				[class_b_count](const std::pair<int, int> & left,
+					const std::pair<int, int> & right) {
+					int left_correct = left.first + class_b_count - left.second;
+					int right_correct = right.first + class_b_count - right.second;
+					if (left_correct != right_correct)
+						return left_correct > right_correct;
+					return left.first > right.first;
+				});
+	}
+}
+
+// Most search contexts a query_server keeps before it starts afresh.
+const size_t SERVER_CONTEXT_CACHE = 4096;
+
+// Longest request line a query_server accepts.
+const size_t SERVER_MAX_LINE = 4096;
+
+/**
+ * work_pool - start the threads of a pool.
+ *
+ * Parameters
+ *   int - the number of threads
+ */
+work_pool::work_pool(int thread_count)
+	: stopping(false)
+{
+	for (int t = 0; t < std::max(1, thread_count); t++)
+		threads.emplace_back([this]() { run(); });
+}
+
+/**
+ * ~work_pool - finish the queued tasks and stop the threads.
+ */
+work_pool::~work_pool()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	queued.notify_all();
+	for (size_t t = 0; t < threads.size(); t++)
+		threads[t].join();
+}
+
+/**
+ * submit - queue a task for the next free thread.
+ *
+ * Parameters
+ *   std::function - the task to run
+ */
+void work_pool::submit(const std::function<void()> & task)
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		tasks.push_back(task);
+	}
+	queued.notify_one();
+}
+
+/**
+ * run - the loop of each pool thread.
+ */
+void work_pool::run()
+{
+	while (true)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			queued.wait(guard, [this]() { return stopping || !tasks.empty(); });
+			if (tasks.empty())
+				return;
+			task = tasks.front();
+			tasks.pop_front();
+		}
+		task();
+	}
+}
+
+/**
+ * query_server - make a server and start its worker threads.
+ *
+ * Parameters
+ *   search_engine - the strategy used to search the diagonals
+ *   int - the number of worker threads
+ */
+query_server::query_server(search_engine engine, int thread_count)
+	: engine(engine), thread_count(thread_count), pool(thread_count)
+{
+}
+
+/**
+ * serve - accept connections on an address until the process is killed.
+ *
+ * Parameters
+ *   const char * - unix:PATH for a Unix socket, else PORT or HOST:PORT for
+ *                  TCP, where HOST defaults to 127.0.0.1
+ *
+ * Returns
+ *   int - the process exit code, only returned on failure
+ */
+int query_server::serve(const char * address)
+{
+	// A client hanging up mid-stream must not end the process.
+	signal(SIGPIPE, SIG_IGN);
+
+	int listener = open_socket(address, true);
+	if (listener == -1)
+		return(1);
+	if (listen(listener, SOMAXCONN) != 0)
+	{
+		std::cerr << "Failed to listen on " << address << "." << std::endl;
+		return(1);
+	}
+
+	while (true)
+	{
+		int client = accept(listener, NULL, NULL);
+		if (client == -1)
+		{
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			std::cerr << "Failed to accept a connection." << std::endl;
+			return(1);
+		}
+		std::thread(&query_server::handle_connection, this, client).detach();
+	}
+}
+
+/**
+ * open_socket - make a socket bound to, or connected to, an address.
+ *
+ * Parameters
+ *   const char * - unix:PATH for a Unix socket, else PORT or HOST:PORT for
+ *                  TCP, where HOST defaults to 127.0.0.1
+ *   bool - bind the address to listen on, replacing a stale Unix socket,
+ *          rather than connect to it
+ *
+ * Returns
+ *   int - the socket, or -1 after printing why it failed
+ */
+int open_socket(const char * address, bool bind_address)
+{
+	struct sockaddr_storage storage;
+	memset(&storage, 0, sizeof(storage));
+	socklen_t length;
+	if (strncmp(address, "unix:", 5) == 0)
+	{
+		struct sockaddr_un * local = (struct sockaddr_un *)&storage;
+		local->sun_family = AF_UNIX;
+		if (strlen(address + 5) >= sizeof(local->sun_path))
+		{
+			std::cerr << "Socket path is too long." << std::endl;
+			return -1;
+		}
+		strcpy(local->sun_path, address + 5);
+		if (bind_address)
+			unlink(local->sun_path);
+		length = sizeof(struct sockaddr_un);
+	}
+	else
+	{
+		std::string host = "127.0.0.1";
+		const char * port = address;
+		const char * colon = strrchr(address, ':');
+		if (colon != NULL)
+		{
+			host.assign(address, colon);
+			port = colon + 1;
+		}
+		struct sockaddr_in * inet = (struct sockaddr_in *)&storage;
+		inet->sin_family = AF_INET;
+		inet->sin_port = htons((uint16_t)atoi(port));
+		if (inet_pton(AF_INET, host.c_str(), &inet->sin_addr) != 1)
+		{
+			std::cerr << "Invalid address: " << address << std::endl;
+			return -1;
+		}
+		length = sizeof(struct sockaddr_in);
+	}
+
+	int connection = socket(storage.ss_family, SOCK_STREAM, 0);
+	if (connection != -1 && bind_address && storage.ss_family == AF_INET)
+	{
+		int reuse = 1;
+		setsockopt(connection, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+	}
+	if (connection == -1 || (bind_address ?
+				bind(connection, (struct sockaddr *)&storage, length) :
+				connect(connection, (struct sockaddr *)&storage, length)) != 0)
+	{
+		std::cerr << "Failed to " << (bind_address ? "bind " : "connect to ")
+			<< address << "." << std::endl;
+		if (connection != -1)
+			close(connection);
+		return -1;
+	}
+	return connection;
+}
+
+/**
+ * handle_connection - answer every request line of a connection in turn,
+ * then close it.
+ *
+ * Parameters
+ *   int - the connected socket
+ */
+void query_server::handle_connection(int client)
+{
+	std::string pending;
+	char block[4096];
+	while (true)
+	{
+		size_t newline;
+		while ((newline = pending.find('\n')) != std::string::npos)
+		{
+			std::string line = pending.substr(0, newline);
+			pending.erase(0, newline + 1);
+			if (line.find_first_not_of(" \t\r") != std::string::npos)
+				answer(client, line);
+		}
+		if (pending.size() > SERVER_MAX_LINE)
+		{
+			const char * TOO_LONG = "{\"id\":null,\"error\":\"request too long\"}\n";
+			send_all(client, TOO_LONG, strlen(TOO_LONG));
+			break;
+		}
+
+		ssize_t received = recv(client, block, sizeof(block), 0);
+		if (received < 0 && errno == EINTR)
+			continue;
+		if (received <= 0)
+			break;
+		pending.append(block, (size_t)received);
+	}
+	close(client);
+}
+
+/**
+ * answer - run one request and stream its response lines.
+ *
+ * Every match is sent as {"id":ID,"match":[TP,FN,FP,TN]}, and the response
+ * ends with {"id":ID,"done":true,"matches":COUNT}, or is a single
+ * {"id":ID,"error":MESSAGE} if the request is invalid. A shard is answered
+ * with one {"id":ID,"shard":true,"matches":COUNT,"bytes":SIZE} line once it
+ * is searched, followed by SIZE bytes of its (TP, FP) pairs as varint
+ * deltas from (0, 0), as in a varint output file.
+ *
+ * Parameters
+ *   int - the connected socket
+ *   std::string - the request line
+ */
+void query_server::answer(int client, const std::string & line)
+{
+	batch_query query;
+	std::string id;
+	count_int first, last;
+	if (!read_json_query(line, query, id, first, last) ||
+			!valid_batch_query(query))
+	{
+		std::string error = "{\"id\":" + id + ",\"error\":\"invalid query\"}\n";
+		send_all(client, error.data(), error.size());
+		return;
+	}
+
+	search_context context;
+	count_int combinations = find_context(query, context);
+	bool sharded = last != -1;
+	if (sharded)
+	{
+		last = std::min(last, combinations);
+		first = std::min(first, last);
+	}
+	else
+		last = combinations;
+	count_int diagonals = last - first;
+	output_format format = sharded ? FORMAT_VARINT : FORMAT_JSON;
+	match_sink shard(context, FORMAT_VARINT);
+
+	// The chunks are searched on the pool and sent as soon as each one and
+	// every chunk before it are done, or gathered into one reply for a
+	// shard. If the client goes away the remaining chunks are skipped, but
+	// still waited for.
+	int chunk_count = (int)std::min(diagonals,
+			(count_int)thread_count * CHUNKS_PER_THREAD);
+	std::vector<std::unique_ptr<match_sink> > buffers(chunk_count);
+	std::vector<char> finished(chunk_count, 0);
+	std::atomic<bool> cancelled(false);
+	std::mutex progress;
+	std::condition_variable chunk_finished;
+	for (int chunk = 0; chunk < chunk_count; chunk++)
+	{
+		pool.submit([&, chunk]() {
+			std::unique_ptr<match_sink> buffer(
+					new match_sink(context, format, -1, id.c_str()));
+			if (!cancelled)
+				search_diagonals(context, first + diagonals * chunk / chunk_count,
+						first + diagonals * (chunk + 1) / chunk_count, *buffer);
+			{
+				std::lock_guard<std::mutex> guard(progress);
+				buffers[chunk].swap(buffer);
+				finished[chunk] = 1;
+			}
+			chunk_finished.notify_all();
+		});
+	}
+
+	uint64_t match_count = 0;
+	for (int chunk = 0; chunk < chunk_count; chunk++)
+	{
+		std::unique_ptr<match_sink> buffer;
+		{
+			std::unique_lock<std::mutex> guard(progress);
+			chunk_finished.wait(guard, [&]() { return finished[chunk] != 0; });
+			buffer.swap(buffers[chunk]);
+		}
+		match_count += buffer->matches();
+		if (sharded)
+			shard.append(*buffer);
+		else if (!cancelled && !send_all(client, buffer->data(), buffer->size()))
+			cancelled = true;
+	}
+
+	if (sharded)
+	{
+		std::string reply = "{\"id\":" + id + ",\"shard\":true,\"matches\":" +
+			std::to_string(match_count) + ",\"bytes\":" +
+			std::to_string(shard.size()) + "}\n";
+		if (send_all(client, reply.data(), reply.size()))
+			send_all(client, shard.data(), shard.size());
+		return;
+	}
+
+	std::string done = "{\"id\":" + id + ",\"done\":true,\"matches\":" +
+		std::to_string(match_count) + "}\n";
+	send_all(client, done.data(), done.size());
+}
+
+/**
+ * find_context - the search context of a query, built once and then reused
+ * for repeats of the same query.
+ *
+ * Parameters
+ *   batch_query - the query
+ *   search_context - set to the context of the search
+ *
+ * Returns
+ *   count_int - the number of diagonals to search, 0 if nothing can match
+ */
+count_int query_server::find_context(const batch_query & query,
+		search_context & context)
+{
+	std::vector<double> key = {(double)query.class_a_count,
+		(double)query.class_b_count, (double)query.decimal_places,
+		query.target_accuracy, query.target_sensitivity,
+		query.target_specificity, query.target_f1, query.target_precision};
+	{
+		std::lock_guard<std::mutex> guard(cache_lock);
+		std::map<std::vector<double>,
+			std::pair<search_context, count_int> >::iterator cached =
+				contexts.find(key);
+		if (cached != contexts.end())
+		{
+			context = cached->second.first;
+			return cached->second.second;
+		}
+	}
+
+	count_int combinations = 0;
+	accuracy_band band = find_positives_vs_negatives(
+			query.class_a_count + query.class_b_count, query.target_accuracy,
+			query.decimal_places);
+	if (band.feasible)
+		combinations = make_search_context(query.class_a_count,
+				query.class_b_count, band, query.target_accuracy,
+				query.target_sensitivity, query.target_specificity,
+				query.target_f1, query.target_precision, query.decimal_places,
+				engine, context);
+	else
+		context = search_context();
+
+	std::lock_guard<std::mutex> guard(cache_lock);
+	if (contexts.size() >= SERVER_CONTEXT_CACHE)
+		contexts.clear();
+	contexts[key] = std::make_pair(context, combinations);
+	return combinations;
+}
+
+/**
+ * read_json_query - parse a request line, a flat JSON object.
+ *
+ * class_a, class_b, decimal_places and accuracy are required. sensitivity,
+ * specificity, f1 and precision default to -1, and id, a number or string,
+ * is echoed back on every response line. first and last, given together,
+ * make the request a shard of the diagonals from first to before last.
+ *
+ * Parameters
+ *   std::string - the request line
+ *   batch_query - set to the query
+ *   std::string - set to the id as JSON text, null if there is none
+ *   count_int - set to the first diagonal of a shard, 0 otherwise
+ *   count_int - set to one past the last diagonal of a shard, -1 otherwise
+ *
+ * Returns
+ *   bool - if the line is a well formed query
+ */
+bool read_json_query(const std::string & line, batch_query & query,
+		std::string & id, count_int & first, count_int & last)
+{
+	id = "null";
+	first = 0;
+	last = -1;
+	query.line = 0;
+	query.target_sensitivity = -1;
+	query.target_specificity = -1;
+	query.target_f1 = -1;
+	query.target_precision = -1;
+
+	const char * FIELDS[10] = {"class_a", "class_b", "decimal_places",
+		"accuracy", "sensitivity", "specificity", "f1", "precision", "first",
+		"last"};
+	double values[10];
+	bool seen[10] = {false};
+
+	size_t at = line.find_first_not_of(" \t\r");
+	if (at == std::string::npos || line[at] != '{')
+		return false;
+	at++;
+	while (true)
+	{
+		at = line.find_first_not_of(" \t\r", at);
+		if (at == std::string::npos)
+			return false;
+		// Keys and string values may not contain escapes.
+		if (line[at] != '"')
+			return false;
+		size_t close_quote = line.find('"', at + 1);
+		if (close_quote == std::string::npos)
+			return false;
+		std::string key = line.substr(at + 1, close_quote - at - 1);
+		at = line.find_first_not_of(" \t\r", close_quote + 1);
+		if (at == std::string::npos || line[at] != ':')
+			return false;
+		at = line.find_first_not_of(" \t\r", at + 1);
+		if (at == std::string::npos)
+			return false;
+
+		size_t end;
+		if (line[at] == '"')
+		{
+			end = line.find('"', at + 1);
+			if (end == std::string::npos ||
+					line.find('\\', at + 1) < end || key != "id")
+				return false;
+			end++;
+			id = line.substr(at, end - at);
+		}
+		else
+		{
+			char * number_end;
+			double value = strtod(line.c_str() + at, &number_end);
+			end = (size_t)(number_end - line.c_str());
+			if (end == at)
+				return false;
+			if (key == "id")
+				id = line.substr(at, end - at);
+			for (int f = 0; f < 10; f++)
+				if (key == FIELDS[f])
+				{
+					values[f] = value;
+					seen[f] = true;
+				}
+		}
+
+		at = line.find_first_not_of(" \t\r", end);
+		if (at == std::string::npos)
+			return false;
+		if (line[at] == '}')
+			break;
+		if (line[at] != ',')
+			return false;
+		at++;
+	}
+	if (line.find_first_not_of(" \t\r", at + 1) != std::string::npos)
+		return false;
+
+	for (int f = 0; f < 4; f++)
+		if (!seen[f])
+			return false;
+	if (seen[8] != seen[9])
+		return false;
+	// Class counts and diagonals must stay exact as doubles.
+	for (int f = 0; f < 10; f++)
+		if ((f < 3 || (f >= 8 && seen[f])) && (values[f] != floor(values[f]) ||
+				fabs(values[f]) > (f != 2 ? 1e15 : 1e9)))
+			return false;
+	if (seen[8])
+	{
+		if (values[8] < 0 || values[9] < values[8])
+			return false;
+		first = (count_int)values[8];
+		last = (count_int)values[9];
+	}
+	query.class_a_count = (count_int)values[0];
+	query.class_b_count = (count_int)values[1];
+	query.decimal_places = (int)values[2];
+	query.target_accuracy = values[3];
+	if (seen[4])
+		query.target_sensitivity = values[4];
+	if (seen[5])
+		query.target_specificity = values[5];
+	if (seen[6])
+		query.target_f1 = values[6];
+	if (seen[7])
+		query.target_precision = values[7];
+	return true;
+}
+
+/**
+ * send_all - write a block of bytes to a socket, retrying short writes.
+ *
+ * Parameters
+ *   int - the socket
+ *   const char * - the bytes to send
+ *   size_t - the number of bytes
+ *
+ * Returns
+ *   bool - false if the connection failed
+ */
+bool send_all(int client, const char * data, size_t length)
+{
+	while (length > 0)
+	{
+		ssize_t sent = send(client, data, length, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR)
+			continue;
+		if (sent <= 0)
+			return false;
+		data += sent;
+		length -= (size_t)sent;
+	}
+	return true;
+}
+
+#ifdef SEARCH_STATS
+/**
+ * stats_flush - add the counters of the calling thread to the totals and
+ * clear them.
+ */
+void stats_flush()
+{
+	stats.combinations += thread_stats.combinations;
+	stats.candidates += thread_stats.candidates;
+	stats.pruned += thread_stats.pruned;
+	for (int m = 0; m < 5; m++)
+		stats.rejected[m] += thread_stats.rejected[m];
+	stats.matches += thread_stats.matches;
+	thread_stats = stats_counters();
+}
+#endif
+
+/**
+ * search_stats_enabled - if the library collects search_stats.
+ *
+ * Returns
+ *   bool - if it was built with SEARCH_STATS defined
+ */
+bool search_stats_enabled()
+{
+#ifdef SEARCH_STATS
+	return true;
+#else
+	return false;
+#endif
+}
+
+/**
+ * read_search_stats - the counters and timings collected so far.
+ *
+ * Returns
+ *   search_stats - the totals over every thread, all 0 without SEARCH_STATS
+ */
+search_stats read_search_stats()
+{
+	search_stats totals = search_stats();
+#ifdef SEARCH_STATS
+	totals.solve_seconds = stats.solve_ns * 1e-9;
+	totals.search_seconds = stats.search_ns * 1e-9;
+	totals.output_seconds = stats.output_ns * 1e-9;
+	totals.combinations = stats.combinations;
+	totals.candidates = stats.candidates;
+	totals.pruned = stats.pruned;
+	for (int m = 0; m < 5; m++)
+		totals.rejected[m] = stats.rejected[m];
+	totals.matches = stats.matches;
+	totals.bytes_written = stats.bytes_written;
+#endif
+	return totals;
+}
+
+/**
+ * reset_search_stats - set every counter and timing back to 0.
+ */
+void reset_search_stats()
+{
+#ifdef SEARCH_STATS
+	stats.solve_ns = 0;
+	stats.search_ns = 0;
+	stats.output_ns = 0;
+	stats.combinations = 0;
+	stats.candidates = 0;
+	stats.pruned = 0;
+	for (int m = 0; m < 5; m++)
+		stats.rejected[m] = 0;
+	stats.matches = 0;
+	stats.bytes_written = 0;
+#endif
+}
+
+/**
+ * print_search_stats - print the counters and timings as a summary or as
+ * one JSON object.
+ *
+ * Parameters
+ *   search_stats - the counters and timings to print
+ *   bool - print JSON instead of a summary
+ *   FILE * - the stream to print to
+ */
+void print_search_stats(const search_stats & totals, bool json, FILE * out)
+{
+	unsigned long long rejected[5];
+	for (int m = 0; m < 5; m++)
+		rejected[m] = (unsigned long long)totals.rejected[m];
+
+	if (json)
+	{
+		fprintf(out, "{\"solve_seconds\":%.9f,\"search_seconds\":%.9f,"
+				"\"output_seconds\":%.9f,\"combinations\":%llu,"
+				"\"candidates\":%llu,\"pruned\":%llu,\"rejected\":{"
+				"\"sensitivity\":%llu,\"specificity\":%llu,\"precision\":%llu,"
+				"\"f1\":%llu,\"extra\":%llu},\"matches\":%llu,"
+				"\"bytes_written\":%llu}\n",
+				totals.solve_seconds, totals.search_seconds, totals.output_seconds,
+				(unsigned long long)totals.combinations,
+				(unsigned long long)totals.candidates,
+				(unsigned long long)totals.pruned, rejected[0], rejected[1],
+				rejected[2], rejected[3], rejected[4],
+				(unsigned long long)totals.matches,
+				(unsigned long long)totals.bytes_written);
+		return;
+	}
+
+	fprintf(out, "Interval solve:      %.6f s\n", totals.solve_seconds);
+	fprintf(out, "Search:              %.6f s\n", totals.search_seconds);
+	fprintf(out, "Output writes:       %.6f s\n", totals.output_seconds);
+	fprintf(out, "Combinations:        %llu\n",
+			(unsigned long long)totals.combinations);
+	fprintf(out, "Candidates checked:  %llu\n",
+			(unsigned long long)totals.candidates);
+	fprintf(out, "Cells pruned:        %llu\n", (unsigned long long)totals.pruned);
+	fprintf(out, "Rejected by sensitivity %llu, specificity %llu, precision %llu, "
+			"f1 %llu, extra %llu\n", rejected[0], rejected[1], rejected[2],
+			rejected[3], rejected[4]);
+	fprintf(out, "Matches:             %llu\n",
+			(unsigned long long)totals.matches);
+	fprintf(out, "Bytes written:       %llu\n",
+			(unsigned long long)totals.bytes_written);
+}
+
+/**
+ * find_positives_vs_negatives - Extract the minima and maxima correct
+ * predictions.
+ *
+ * These values will be used to determine the values to check. Rather than
+ * testing every count, the band is solved directly from the rounding
+ * half-interval around the target: round(c * 10^dp / N) == T holds exactly
+ * when (2T - 1) * N <= 2 * c * 10^dp < (2T + 1) * N.
+ *
+ * Parameters
+ *   int - the total sample size
+ *   double - the target accuracy
+ *   int - the total number of decimal places to round to
+ *
+ * Returns
+ *   accuracy_band - min and max correct predictions, flagged infeasible if
+ *                   no count rounds to the target.
+ */
+accuracy_band find_positives_vs_negatives(
+		count_int total_sample_size,
+		double target_accuracy,
+		int decimal_places
+		)
+{
+	target_range accuracy = {target_accuracy, target_accuracy};
+	return find_accuracy_band(total_sample_size, accuracy, decimal_places,
+			ROUND_HALF_UP);
+}
+
+/**
+ * find_accuracy_band - find_positives_vs_negatives for a range of accuracy
+ * targets under a set of rounding modes.
+ *
+ * Parameters
+ *   count_int - the total sample size
+ *   target_range - the range of the target accuracy
+ *   int - the total number of decimal places to round to
+ *   unsigned - the rounding_mode mask
+ *
+ * Returns
+ *   accuracy_band - min and max correct predictions, flagged infeasible if
+ *                   no count rounds into the range.
+ */
+accuracy_band find_accuracy_band(
+		count_int total_sample_size,
+		const target_range & target_accuracy,
+		int decimal_places,
+		unsigned rounding
+		)
+{
+	accuracy_band band = {false, -1, -1};
+	metric_band accuracy = make_range_band(target_accuracy, decimal_places,
+			rounding);
+	count_band correct = find_ratio_band(total_sample_size, accuracy,
+			2 * power_of_ten(decimal_places));
+	// At least one prediction must be correct, as in the original scan.
+	if (correct.min_count < 1)
+		correct.min_count = 1;
+
+	if (correct.feasible && correct.min_count <= correct.max_count)
+	{
+		band.feasible = true;
+		band.min_correct = correct.min_count;
+		band.max_correct = correct.max_count;
+	}
+	return band;
+}
+
+/**
+ * find_ratio_band - Extract the range of counts k in [0, denominator] for
+ * which k / denominator rounds into the target band.
+ *
+ * The band test lower * n + lower_offset <= k * twice_scale <
+ * upper * n + upper_offset is solved for k directly. A disabled target
+ * places no restriction on the count.
+ *
+ * Parameters
+ *   count_int - the denominator of the ratio
+ *   metric_band - the integer band of the target
+ *   long long - twice the decimal scale, 2 * 10^dp
+ *
+ * Returns
+ *   count_band - min and max counts, flagged infeasible if no count rounds
+ *                to the target.
+ */
+count_band find_ratio_band(
+		count_int denominator,
+		const metric_band & target,
+		long long twice_scale
+		)
+{
+	count_band band = {true, 0, denominator};
+	if (!target.enabled)
+		return band;
+
+	wide_int min_count = ceil_div((wide_int)target.lower * denominator +
+			target.lower_offset, twice_scale);
+	wide_int max_count = ceil_div((wide_int)target.upper * denominator +
+			target.upper_offset, twice_scale) - 1;
+
+	if (min_count < 0)
+		min_count = 0;
+	if (max_count > denominator)
+		max_count = denominator;
+
+	band.feasible = min_count <= max_count;
+	if (band.feasible)
+	{
+		band.min_count = (count_int)min_count;
+		band.max_count = (count_int)max_count;
+	}
+	return band;
+}
+
+/**
+ * make_metric_band - convert a target value into its exact integer band.
+ *
+ * Parameters
+ *   double - the target value, or -1 if disabled
+ *   int - the number of decimal places the target is rounded to
+ *
+ * Returns
+ *   metric_band - the band of scaled ratios that round half up to the target
+ */
+metric_band make_metric_band(double target_value, int decimal_places)
+{
+	target_range target = {target_value, target_value};
+	return make_range_band(target, decimal_places, ROUND_HALF_UP);
+}
+
+/**
+ * make_range_band - convert a range of target values into the integer band
+ * of ratios that any of a set of rounding modes rounds into it.
+ *
+ * In units of half a step of the last decimal place, with the range
+ * [L, H] at 2L and 2H, the modes round into it the ratios in
+ *   half up    [2L - 1, 2H + 1)
+ *   half down  (2L - 1, 2H + 1]
+ *   half even  2L - 1 and 2H + 1 included only if L and H are even
+ *   down       [2L, 2H + 2)
+ *   up         (2L - 2, 2H]
+ * Every one holds [2L, 2H], so their union is the band from the lowest
+ * lower end to the highest upper end.
+ *
+ * Parameters
+ *   target_range - the range of target values, low -1 if disabled
+ *   int - the number of decimal places the targets are rounded to
+ *   unsigned - the rounding_mode mask
+ *
+ * Returns
+ *   metric_band - the band of scaled ratios that round into the range
+ */
+metric_band make_range_band(
+		const target_range & target,
+		int decimal_places,
+		unsigned rounding
+		)
+{
+	metric_band band = {false, 0, 0, 0, 0};
+	if (target.low == -1)
+		return band;
+	return rounding_band(target, decimal_places, rounding);
+}
+
+/**
+ * rounding_band - make_range_band for an enabled range, which may hold
+ * negative values. Negative values round as positive ones do, so half up
+ * rounds towards positive infinity and down is the floor.
+ *
+ * Parameters
+ *   target_range - the range of target values
+ *   int - the number of decimal places the targets are rounded to
+ *   unsigned - the rounding_mode mask
+ *
+ * Returns
+ *   metric_band - the band of scaled ratios that round into the range
+ */
+metric_band rounding_band(
+		const target_range & target,
+		int decimal_places,
+		unsigned rounding
+		)
+{
+	metric_band band = {true, 0, 0, 0, 0};
+
+	// Both ends must themselves be values that rounding can produce.
+	long long scale = power_of_ten(decimal_places);
+	long long low = llround(target.low * (double)scale);
+	long long high = llround(target.high * (double)scale);
+	if ((double)low / (double)scale != target.low ||
+			(double)high / (double)scale != target.high || low > high ||
+			(rounding & ROUND_ALL) == 0)
+		return band;
+
+	// Each mode's ends, as a value and 1 for an open lower or closed upper.
+	const long long lower[5][2] = {{2 * low - 1, 0}, {2 * low - 1, low % 2 != 0},
+		{2 * low - 1, 1}, {2 * low, 0}, {2 * low - 2, 1}};
+	const long long upper[5][2] = {{2 * high + 1, 0}, {2 * high + 1,
+		high % 2 == 0}, {2 * high + 1, 1}, {2 * high + 2, 0}, {2 * high, 1}};
+	bool first = true;
+	for (int mode = 0; mode < 5; mode++)
+	{
+		if (!(rounding & (1u << mode)))
+			continue;
+		if (first || lower[mode][0] < band.lower ||
+				(lower[mode][0] == band.lower && lower[mode][1] < band.lower_offset))
+		{
+			band.lower = lower[mode][0];
+			band.lower_offset = lower[mode][1];
+		}
+		if (first || upper[mode][0] > band.upper ||
+				(upper[mode][0] == band.upper && upper[mode][1] > band.upper_offset))
+		{
+			band.upper = upper[mode][0];
+			band.upper_offset = upper[mode][1];
+		}
+		first = false;
+	}
+	return band;
+}
+
+/**
+ * make_metric_targets - convert every optional target into its integer band.
+ *
+ * Parameters
+ *   double - the target sensitivity
+ *   double - the target specificity
+ *   double - the target f1 score
+ *   double - the target precision
+ *   int - the number of decimal places to round to
+ *
+ * Returns
+ *   metric_targets - the integer bands of the targets
+ */
+metric_targets make_metric_targets(
+		double target_sensitivity,
+		double target_specificity,
+		double target_f1,
+		double target_precision,
+		int decimal_places
+		)
+{
+	return make_range_targets(exact_targets(-1, target_sensitivity,
+			target_specificity, target_f1, target_precision), decimal_places);
+}
+
+/**
+ * make_range_targets - convert every optional target range into its integer
+ * band under the rounding modes of the ranges.
+ *
+ * Parameters
+ *   target_ranges - the target ranges and rounding modes
+ *   int - the number of decimal places to round to
+ *
+ * Returns
+ *   metric_targets - the integer bands of the targets
+ */
+metric_targets make_range_targets(
+		const target_ranges & ranges,
+		int decimal_places
+		)
+{
+	metric_targets targets;
+	targets.mask = 0;
+	targets.twice_scale = 2 * power_of_ten(decimal_places);
+	targets.sensitivity = make_range_band(ranges.sensitivity, decimal_places,
+			ranges.rounding);
+	targets.specificity = make_range_band(ranges.specificity, decimal_places,
+			ranges.rounding);
+	targets.f1 = make_range_band(ranges.f1, decimal_places, ranges.rounding);
+	targets.precision = make_range_band(ranges.precision, decimal_places,
+			ranges.rounding);
+
+	if (targets.sensitivity.enabled)
+		targets.mask |= METRIC_SENSITIVITY;
+	if (targets.specificity.enabled)
+		targets.mask |= METRIC_SPECIFICITY;
+	if (targets.precision.enabled)
+		targets.mask |= METRIC_PRECISION;
+	if (targets.f1.enabled)
+		targets.mask |= METRIC_F1;
+
+	const metric_band disabled = {false, 0, 0, 0, 0};
+	targets.extra_mask = ranges.extra_mask;
+	for (int k = 0; k < EXTRA_METRIC_COUNT; k++)
+		targets.extra[k] = (ranges.extra_mask >> k) & 1 ?
+			rounding_band(ranges.extra[k], decimal_places, ranges.rounding) :
+			disabled;
+	return targets;
+}
+
+/**
+ * exact_targets - the target ranges of single targets rounded half up.
+ *
+ * Parameters
+ *   double - the target accuracy
+ *   double - the target sensitivity
+ *   double - the target specificity
+ *   double - the target f1 score
+ *   double - the target precision
+ *
+ * Returns
+ *   target_ranges - each target as a range of one value
+ */
+target_ranges exact_targets(
+		double target_accuracy,
+		double target_sensitivity,
+		double target_specificity,
+		double target_f1,
+		double target_precision
+		)
+{
+	target_ranges ranges = {{target_accuracy, target_accuracy},
+		{target_sensitivity, target_sensitivity},
+		{target_specificity, target_specificity}, {target_f1, target_f1},
+		{target_precision, target_precision}, ROUND_HALF_UP, 0, {}};
+	return ranges;
+}
+
+/**
+ * exact_ranges - whether target ranges are single targets rounded half up,
+ * without registry metrics.
+ *
+ * Parameters
+ *   target_ranges - the target ranges and rounding modes
+ *
+ * Returns
+ *   bool - true if every range holds one value, only half up is used and no
+ *          registry metric is targeted
+ */
+bool exact_ranges(const target_ranges & ranges)
+{
+	return ranges.accuracy.low == ranges.accuracy.high &&
+		ranges.sensitivity.low == ranges.sensitivity.high &&
+		ranges.specificity.low == ranges.specificity.high &&
+		ranges.f1.low == ranges.f1.high &&
+		ranges.precision.low == ranges.precision.high &&
+		ranges.rounding == ROUND_HALF_UP && ranges.extra_mask == 0;
+}
+
+/**
+ * ceil_div - integer division rounding towards positive infinity.
+ *
+ * Parameters
+ *   wide_int - the numerator
+ *   long long - the denominator, must be positive
+ *
+ * Returns
+ *   wide_int - the ceiling of the quotient
+ */
+wide_int ceil_div(wide_int numerator, long long denominator)
+{
+	if (numerator >= 0)
+		return (numerator + denominator - 1) / denominator;
+	return -((-numerator) / denominator);
 }
 
 /**
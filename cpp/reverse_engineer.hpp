@@ -0,0 +1,907 @@
+/**
+ * Library interface to reverse engineer all possible confusion matrices from
+ * their rounded output metrics.
+ *
+ * search_matrices runs a search into any result_sink. The sinks here write
+ * csv or binary files, keep the matches in memory, count them, or pass them
+ * to a callback.
+ */
+#ifndef REVERSE_ENGINEER_HPP
+#define REVERSE_ENGINEER_HPP
+
+#include <vector>
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <thread>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <iterator>
+
+// Signed integer wide enough for any class count.
+typedef long long count_int;
+
+/**
+ * accuracy_band - the inclusive range of correct prediction counts whose
+ * rounded accuracy equals the target accuracy.
+ */
+struct accuracy_band
+{
+	bool feasible;
+	count_int min_correct;
+	count_int max_correct;
+};
+
+/**
+ * count_band - the inclusive range of numerator counts, out of a fixed
+ * denominator, whose rounded ratio equals a target metric.
+ */
+struct count_band
+{
+	bool feasible;
+	count_int min_count;
+	count_int max_count;
+};
+
+// Signed integer wide enough for the cross-multiplied metric tests.
+typedef __int128 wide_int;
+
+/**
+ * metric_band - a target metric as an exact integer band.
+ *
+ * With T the target scaled by 10^dp, a ratio n / d rounds half up to the
+ * target exactly when lower * d <= n * twice_scale < upper * d, where
+ * lower = 2T - 1, upper = 2T + 1 and twice_scale = 2 * 10^dp. Other rounding
+ * modes and target ranges move the ends, and may open the lower end or close
+ * the upper one, which lower_offset and upper_offset of 1 do:
+ * lower * d + lower_offset <= n * twice_scale < upper * d + upper_offset.
+ * A ratio with d = 0 never matches, whatever the offsets.
+ * A target that no ratio can round to has an empty band (all zero).
+ */
+struct metric_band
+{
+	bool enabled;
+	long long lower;
+	long long upper;
+	long long lower_offset;
+	long long upper_offset;
+};
+
+/**
+ * rounding_mode - bit of each way a reported metric may have been rounded
+ * in a rounding mask. A ratio meets a target if any mode in the mask rounds
+ * it there.
+ */
+enum rounding_mode
+{
+	ROUND_HALF_UP = 1,
+	ROUND_HALF_EVEN = 2,
+	ROUND_HALF_DOWN = 4,
+	ROUND_DOWN = 8,
+	ROUND_UP = 16,
+	ROUND_ALL = 31
+};
+
+/**
+ * target_range - the inclusive range of rounded values a metric may take,
+ * with low = high for a single target and both -1 if disabled.
+ */
+struct target_range
+{
+	double low;
+	double high;
+};
+
+/**
+ * extra_metric - index of each metric of the metric registry, checked
+ * alongside the metrics of check_metric. Bit k of an extra mask stands for
+ * metric k.
+ */
+enum extra_metric
+{
+	EXTRA_NPV,
+	EXTRA_BALANCED_ACCURACY,
+	EXTRA_JACCARD,
+	EXTRA_YOUDEN,
+	EXTRA_MCC,
+	EXTRA_METRIC_COUNT
+};
+
+/**
+ * target_ranges - the range of every metric and the rounding modes they are
+ * tested under.
+ *
+ * The registry metrics are only targeted when their bit of extra_mask is
+ * set, as Youden's J and MCC can be -1.
+ */
+struct target_ranges
+{
+	target_range accuracy;
+	target_range sensitivity;
+	target_range specificity;
+	target_range f1;
+	target_range precision;
+	unsigned rounding;
+	unsigned extra_mask;
+	target_range extra[EXTRA_METRIC_COUNT];
+};
+
+/**
+ * metric_flag - bit of each optional metric in a metric mask.
+ */
+enum metric_flag
+{
+	METRIC_SENSITIVITY = 1,
+	METRIC_SPECIFICITY = 2,
+	METRIC_PRECISION = 4,
+	METRIC_F1 = 8,
+	METRIC_ALL = 15
+};
+
+/**
+ * metric_targets - the integer bands of every optional metric.
+ *
+ * mask has the metric_flag of every enabled metric set, and extra_mask the
+ * bit of every targeted registry metric.
+ */
+struct metric_targets
+{
+	unsigned mask;
+	long long twice_scale;
+	metric_band sensitivity;
+	metric_band specificity;
+	metric_band f1;
+	metric_band precision;
+	unsigned extra_mask;
+	metric_band extra[EXTRA_METRIC_COUNT];
+};
+
+/**
+ * metric_definition - one metric of the metric registry.
+ *
+ * check tests a matrix against a band of the metric exactly. Where the
+ * metric is monotone in TP along an accuracy diagonal, narrow cuts the TP
+ * range of a diagonal down to exactly the cells within the band, so the
+ * pruned engines never visit the others; otherwise it is NULL. minimum is
+ * the lowest value the metric takes.
+ */
+struct metric_definition
+{
+	const char * name;
+	const char * column;
+	double minimum;
+	bool (*check)(count_int, count_int, count_int, count_int,
+			const metric_band &, long long);
+	void (*narrow)(count_int, count_int, count_int, const metric_band &,
+			long long, count_int &, count_int &);
+};
+
+/**
+ * search_engine - the strategy used to walk the accuracy-feasible diagonals.
+ *
+ * ENGINE_ROUNDED checks every cell of every diagonal by comparing round_dp
+ * results, as the Python version does. ENGINE_SCALAR checks every cell with
+ * the exact integer tests of check_metric. ENGINE_PRUNED first
+ * intersects the sensitivity and specificity bands so that only cells which
+ * can still match are checked. ENGINE_SIMD uses the same bands and checks the
+ * remaining cells in batches with check_metric_batch. ENGINE_GPU uses them
+ * too and checks the remaining cells on a CUDA device; it needs a build with
+ * make GPU=1 and a device at runtime, and runs as ENGINE_SIMD otherwise.
+ */
+enum search_engine
+{
+	ENGINE_ROUNDED,
+	ENGINE_SCALAR,
+	ENGINE_PRUNED,
+	ENGINE_SIMD,
+	ENGINE_GPU
+};
+
+// Largest number of candidates check_metric_batch accepts in one call.
+const int METRIC_BATCH = 64;
+
+/**
+ * gpu_run - consecutive cells of one diagonal in a block handed to the GPU.
+ *
+ * The run covers TP from max_tp downwards with correct_preds fixed, and its
+ * first cell is cell first_cell of the block. Runs are in search order and
+ * end where the next one starts.
+ */
+struct gpu_run
+{
+	count_int correct_preds;
+	count_int max_tp;
+	uint32_t first_cell;
+};
+
+/**
+ * search_context - everything a worker needs to search a run of diagonals.
+ *
+ * A search of a run of diagonals returns once it has written match_limit
+ * matches, where 0 means no limit. The registry metrics of
+ * extra_prune_mask narrow every diagonal, and those of extra_check_mask are
+ * checked on every cell. ENGINE_GPU hands gpu_check_block at most
+ * gpu_block_cells cells at a time.
+ */
+struct search_context
+{
+	count_int class_a_count;
+	count_int class_b_count;
+	count_int max_correct;
+	count_band tp_band;
+	count_band tn_band;
+	double target_accuracy;
+	double target_sensitivity;
+	double target_specificity;
+	double target_f1;
+	double target_precision;
+	int decimal_places;
+	metric_targets targets;
+	unsigned check_mask;
+	search_engine engine;
+	uint64_t match_limit;
+	target_ranges ranges;
+	unsigned extra_check_mask;
+	unsigned extra_prune_mask;
+	uint32_t gpu_block_cells;
+};
+
+/**
+ * batch_query - one line of a batch file: the class counts, decimal places
+ * and targets of a search, and the line it was read from.
+ */
+struct batch_query
+{
+	int line;
+	count_int class_a_count;
+	count_int class_b_count;
+	int decimal_places;
+	double target_accuracy;
+	double target_sensitivity;
+	double target_specificity;
+	double target_f1;
+	double target_precision;
+};
+
+/**
+ * multiclass_problem - the class sizes and rounded targets of a search for
+ * K x K confusion matrices.
+ *
+ * The macro targets are unweighted means over the classes of each class's
+ * one-vs-rest precision, recall and F1, where a class that is never
+ * predicted has a precision of 0. Micro precision, recall and F1 all equal
+ * the accuracy for single label predictions. The per-class target vectors
+ * are either empty or hold a target for every class, -1 for none.
+ */
+struct multiclass_problem
+{
+	std::vector<count_int> class_counts;
+	int decimal_places;
+	double target_accuracy;
+	double target_macro_precision;
+	double target_macro_recall;
+	double target_macro_f1;
+	std::vector<double> target_precision;
+	std::vector<double> target_recall;
+	std::vector<double> target_f1;
+};
+
+/**
+ * multiclass_solution - the diagonal and column sums of a K x K matrix.
+ *
+ * Every metric depends only on each class's true positives and predicted
+ * count, so one solution stands for all of the matrices that share them;
+ * multiclass_witness builds one of those.
+ */
+struct multiclass_solution
+{
+	std::vector<count_int> tp;
+	std::vector<count_int> predicted;
+};
+
+/**
+ * output_format - the layout of the output file.
+ *
+ * FORMAT_CSV writes one csv row per match. FORMAT_BINARY writes a
+ * binary_header followed by packed int32 (TP, FP) pairs, FN and TN follow
+ * from the class counts, so it only holds class counts that fit an int32.
+ * FORMAT_VARINT stores each pair as zigzag LEB128 deltas from the previous
+ * pair, which is a byte each along a diagonal, and holds any class count.
+ * FORMAT_JSON writes one JSON object per match, for the query server.
+ * FORMAT_RUNS has the same header and stores arithmetic runs of pairs as
+ * a length, the varint delta of the run's first pair from the one before
+ * and, for runs longer than one, the (TP, FP) step between its pairs.
+ */
+enum output_format
+{
+	FORMAT_CSV,
+	FORMAT_BINARY,
+	FORMAT_VARINT,
+	FORMAT_JSON,
+	FORMAT_RUNS
+};
+
+/**
+ * binary_header - the run parameters at the start of a binary output file.
+ *
+ * Every field is in host byte order. targets holds the accuracy,
+ * sensitivity, specificity, f1 and precision targets.
+ */
+struct binary_header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t format;
+	int64_t class_a_count;
+	int64_t class_b_count;
+	int32_t decimal_places;
+	int32_t reserved;
+	double targets[5];
+	uint64_t match_count;
+};
+
+// Identifies a binary output file, and the layout version it uses.
+const char BINARY_MAGIC[8] = {'R', 'E', 'C', 'M', 'A', 'T', 'X', '\0'};
+const uint32_t BINARY_VERSION = 2;
+
+/**
+ * search_stats - counters and phase timings of the searches run so far.
+ *
+ * They are only collected when the library is built with SEARCH_STATS
+ * defined, otherwise every field stays 0. search_seconds includes any output
+ * written while searching, output_seconds is the time spent in write(2).
+ * candidates are the cells checked and pruned the cells the sensitivity and
+ * specificity bands skipped. rejected counts each check by the first metric
+ * it failed: sensitivity, specificity, precision, f1 and then the registry
+ * metrics checked on every cell.
+ */
+struct search_stats
+{
+	double solve_seconds;
+	double search_seconds;
+	double output_seconds;
+	uint64_t combinations;
+	uint64_t candidates;
+	uint64_t pruned;
+	uint64_t rejected[5];
+	uint64_t matches;
+	uint64_t bytes_written;
+};
+
+/**
+ * confusion_matrix - the four counts of a matching matrix.
+ */
+struct confusion_matrix
+{
+	count_int tp;
+	count_int fn;
+	count_int fp;
+	count_int tn;
+};
+
+/**
+ * result_sink - receives the matches of a search, in search order.
+ *
+ * A threaded search collects each chunk of diagonals in a buffer from
+ * make_buffer, and passes the buffers to append in chunk order, so a sink
+ * sees the same matches in the same order for any thread count. append may
+ * take the contents of the buffer. By default the buffers are vector_sinks
+ * replayed through write_match.
+ *
+ * A search whose targets are all met by bands of a diagonal passes each
+ * diagonal's matches to write_run at once. By default write_run passes them
+ * to write_match one at a time.
+ */
+class result_sink
+{
+public:
+	virtual ~result_sink();
+	virtual void write_match(count_int, count_int, count_int, count_int) = 0;
+	virtual void write_run(count_int, count_int, count_int, count_int,
+			count_int);
+	virtual std::unique_ptr<result_sink> make_buffer(
+			const search_context &) const;
+	virtual void append(result_sink &);
+};
+
+/**
+ * vector_sink - keeps every match in memory.
+ */
+class vector_sink : public result_sink
+{
+public:
+	void write_match(count_int, count_int, count_int, count_int);
+	void append(result_sink &);
+	const std::vector<confusion_matrix> & results() const;
+
+private:
+	std::vector<confusion_matrix> matches;
+};
+
+/**
+ * arena_chunk - one block of a match_arena, holding used of capacity
+ * matches.
+ */
+struct arena_chunk
+{
+	std::unique_ptr<confusion_matrix[]> matches;
+	size_t used;
+	size_t capacity;
+};
+
+/**
+ * match_arena - move-only storage of matches in blocks that are never
+ * reallocated.
+ *
+ * Matches never move once added. splice copies another arena's matches
+ * into the room left in the last block when they fit, and otherwise moves
+ * its blocks rather than the matches. Iterating gives the matches in the
+ * order they were added, as one flat sequence over the blocks; the blocks
+ * themselves are also reachable, for loops over plain arrays.
+ */
+class match_arena
+{
+public:
+	/**
+	 * const_iterator - walks the matches of every block in turn.
+	 */
+	class const_iterator
+	{
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef confusion_matrix value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const confusion_matrix * pointer;
+		typedef const confusion_matrix & reference;
+
+		const_iterator(const std::vector<arena_chunk> *, size_t, size_t);
+		reference operator*() const;
+		pointer operator->() const;
+		const_iterator & operator++();
+		bool operator==(const const_iterator &) const;
+		bool operator!=(const const_iterator &) const;
+
+	private:
+		void skip_empty();
+
+		const std::vector<arena_chunk> * chunks;
+		size_t chunk;
+		size_t offset;
+	};
+
+	match_arena();
+	match_arena(match_arena &&);
+	match_arena & operator=(match_arena &&);
+	void reserve(size_t);
+	void push_back(const confusion_matrix &);
+	void splice(match_arena &);
+	size_t size() const;
+	bool empty() const;
+	size_t chunk_count() const;
+	const confusion_matrix * chunk_data(size_t) const;
+	size_t chunk_size(size_t) const;
+	const_iterator begin() const;
+	const_iterator end() const;
+
+private:
+	match_arena(const match_arena &);
+	match_arena & operator=(const match_arena &);
+
+	std::vector<arena_chunk> chunks;
+	size_t match_count;
+};
+
+/**
+ * arena_sink - keeps every match in a match_arena.
+ *
+ * The buffers of a threaded search are arena_sinks too. Appending one
+ * fills the room reserved here first and only then moves its blocks over,
+ * so a search whose estimate was reserved ends in a single block.
+ */
+class arena_sink : public result_sink
+{
+public:
+	explicit arena_sink(size_t = 0);
+	void write_match(count_int, count_int, count_int, count_int);
+	std::unique_ptr<result_sink> make_buffer(const search_context &) const;
+	void append(result_sink &);
+	const match_arena & results() const;
+	match_arena take();
+
+private:
+	match_arena arena;
+};
+
+/**
+ * counter_sink - counts the matches without keeping them.
+ */
+class counter_sink : public result_sink
+{
+public:
+	counter_sink();
+	void write_match(count_int, count_int, count_int, count_int);
+	void write_run(count_int, count_int, count_int, count_int, count_int);
+	std::unique_ptr<result_sink> make_buffer(const search_context &) const;
+	void append(result_sink &);
+	uint64_t count() const;
+
+private:
+	uint64_t match_count;
+};
+
+/**
+ * callback_sink - hands every match to a function as it reaches the sink.
+ *
+ * With one thread that is as soon as the match is found, with more it is
+ * once the chunk holding it and every chunk before it are done.
+ */
+class callback_sink : public result_sink
+{
+public:
+	explicit callback_sink(const std::function<void(const confusion_matrix &)> &);
+	void write_match(count_int, count_int, count_int, count_int);
+
+private:
+	std::function<void(const confusion_matrix &)> callback;
+};
+
+/**
+ * match_sink - buffered writer for the matches of a search.
+ *
+ * Rows are encoded by hand into a reusable buffer. For csv, the target
+ * columns are the same on every row, so they are formatted once when the
+ * sink is made. A sink on a file descriptor writes the buffer out in large
+ * blocks. A sink without one (fd -1) keeps its matches in memory until
+ * appended to another, as csv rows or, for the binary formats, packed pairs.
+ *
+ * FORMAT_RUNS groups the (TP, FP) pairs into arithmetic runs. Each pair
+ * extends the last run if it continues its step, and otherwise starts a new
+ * run, so the runs only depend on the matches and not on how they were
+ * passed to the sink.
+ */
+class match_sink : public result_sink
+{
+public:
+	match_sink(const search_context &, output_format, int = -1,
+			const char * = NULL);
+	~match_sink();
+	void begin();
+	void write_match(count_int, count_int, count_int, count_int);
+	void write_run(count_int, count_int, count_int, count_int, count_int);
+	std::unique_ptr<result_sink> make_buffer(const search_context &) const;
+	void append(result_sink &);
+	void finish();
+	void flush();
+	const char * data() const;
+	size_t size() const;
+	uint64_t matches() const;
+
+private:
+	match_sink(const match_sink &);
+	match_sink & operator=(const match_sink &);
+	void write_text(const char *, size_t);
+	void reserve(size_t);
+	void write_out(const char *, size_t);
+	void write_varint(long long);
+	void add_run(count_int, count_int, count_int, count_int, count_int);
+	void write_pending_run();
+
+	int fd;
+	output_format format;
+	binary_header header;
+	bool tagged;
+	std::string tag;
+	std::string prefix;
+	std::string suffix;
+	std::string columns;
+	std::vector<char> buffer;
+	size_t used;
+	uint64_t match_count;
+	count_int previous_tp;
+	count_int previous_fp;
+	count_int run_tp;
+	count_int run_fp;
+	count_int run_step_tp;
+	count_int run_step_fp;
+	count_int run_length;
+};
+
+/**
+ * binary_result_reader - memory mapped reader for binary output files.
+ *
+ * FORMAT_BINARY files can also be read in place through pairs(). next
+ * expands the runs of FORMAT_RUNS files into their matches, and next_run
+ * reads them as they are.
+ */
+class binary_result_reader
+{
+public:
+	binary_result_reader();
+	~binary_result_reader();
+	bool open(const char *);
+	const binary_header & header() const;
+	const int32_t * pairs() const;
+	bool next(count_int &, count_int &);
+	bool next_run(count_int &, count_int &, count_int &, count_int &,
+			count_int &);
+
+private:
+	binary_result_reader(const binary_result_reader &);
+	binary_result_reader & operator=(const binary_result_reader &);
+
+	const unsigned char * data;
+	size_t size;
+	size_t offset;
+	uint64_t remaining;
+	count_int previous_tp;
+	count_int previous_fp;
+	count_int run_tp;
+	count_int run_fp;
+	count_int run_step_tp;
+	count_int run_step_fp;
+	count_int run_left;
+};
+
+/**
+ * index_header - the parameters at the start of a matrix index file.
+ *
+ * The header is followed by key_count index_key records, sorted by their
+ * values, and then matrix_count packed int32 (TP, FP) pairs. Every field is
+ * in host byte order.
+ */
+struct index_header
+{
+	char magic[8];
+	uint32_t version;
+	int32_t class_a_count;
+	int32_t class_b_count;
+	int32_t decimal_places;
+	uint64_t key_count;
+	uint64_t matrix_count;
+};
+
+/**
+ * index_key - one rounded metric tuple of a matrix index, and the run of
+ * matrices that round to it.
+ *
+ * values holds the accuracy, sensitivity, specificity, f1 and precision
+ * scaled by 10^dp and rounded half up, or -1 where the metric is undefined.
+ * Within a run the matrices are in the order the search writes them.
+ */
+struct index_key
+{
+	int32_t values[5];
+	uint32_t first;
+	uint32_t count;
+};
+
+// Identifies a matrix index file, and the layout version it uses.
+const char INDEX_MAGIC[8] = {'R', 'E', 'C', 'M', 'I', 'D', 'X', '\0'};
+const uint32_t INDEX_VERSION = 1;
+
+// Most decimal places a rounded metric can have and still fit an int32_t.
+const int INDEX_MAX_DECIMAL_PLACES = 9;
+
+/**
+ * matrix_index - memory mapped reader for matrix index files.
+ */
+class matrix_index
+{
+public:
+	matrix_index();
+	~matrix_index();
+	bool open(const char *);
+	const index_header & header() const;
+	void lookup(double, double, double, double, double,
+			std::vector<std::pair<int, int> > &) const;
+
+private:
+	matrix_index(const matrix_index &);
+	matrix_index & operator=(const matrix_index &);
+
+	const unsigned char * data;
+	size_t size;
+	const index_key * keys;
+	const int32_t * pairs;
+};
+
+/**
+ * work_pool - a fixed set of threads running queued tasks in order.
+ */
+class work_pool
+{
+public:
+	explicit work_pool(int);
+	~work_pool();
+	void submit(const std::function<void()> &);
+
+private:
+	work_pool(const work_pool &);
+	work_pool & operator=(const work_pool &);
+	void run();
+
+	std::vector<std::thread> threads;
+	std::deque<std::function<void()> > tasks;
+	std::mutex lock;
+	std::condition_variable queued;
+	bool stopping;
+};
+
+/**
+ * query_server - answers line-delimited JSON queries on a socket.
+ *
+ * Each connection is read by its own thread, which queues the chunks of
+ * every query on the shared work_pool and streams the matches back in
+ * search order as the chunks finish.
+ */
+class query_server
+{
+public:
+	query_server(search_engine, int);
+	int serve(const char *);
+
+private:
+	query_server(const query_server &);
+	query_server & operator=(const query_server &);
+	void handle_connection(int);
+	void answer(int, const std::string &);
+	count_int find_context(const batch_query &, search_context &);
+
+	search_engine engine;
+	int thread_count;
+	work_pool pool;
+	std::mutex cache_lock;
+	std::map<std::vector<double>, std::pair<search_context, count_int> >
+		contexts;
+};
+
+/**
+ * session_step - how a search_session answered its last query.
+ *
+ * SESSION_SEARCHED ran a full search. SESSION_FILTERED narrowed the matches
+ * of the previous query and SESSION_EXTENDED filtered the kept matches of
+ * every constraint but the one that changed.
+ */
+enum session_step
+{
+	SESSION_SEARCHED,
+	SESSION_FILTERED,
+	SESSION_EXTENDED
+};
+
+/**
+ * session_bands - the accuracy band and integer target bands of one query
+ * of a search_session.
+ */
+struct session_bands
+{
+	int decimal_places;
+	accuracy_band accuracy;
+	metric_targets targets;
+};
+
+/**
+ * search_session - answers a run of queries on one pair of class counts,
+ * reusing the work of the queries before.
+ *
+ * A query whose bands all lie within those of the previous query filters
+ * the previous matches. Otherwise, when one constraint changed, the matches
+ * of every other constraint are searched once and kept, and this query and
+ * later ones that only move that constraint filter them. Either way the
+ * matches are those of a fresh search, in the same order. ENGINE_ROUNDED is
+ * searched as ENGINE_SCALAR, as filtering tests the bands exactly.
+ */
+class search_session
+{
+public:
+	search_session(count_int, count_int, search_engine, int);
+	bool query(int, const target_ranges &);
+	const std::vector<confusion_matrix> & results() const;
+	session_step last_step() const;
+
+private:
+	void search(int, const target_ranges &, std::vector<confusion_matrix> &,
+			uint64_t);
+	bool keep_partial(int, const target_ranges &, int);
+
+	count_int class_a_count;
+	count_int class_b_count;
+	search_engine engine;
+	int thread_count;
+	bool queried;
+	session_bands previous;
+	std::vector<confusion_matrix> matches;
+	int partial_constraint;
+	session_bands partial_bands;
+	std::vector<confusion_matrix> partial;
+	session_step step;
+};
+
+void reverse_engineer_confusion_matrices(count_int, count_int, int,
+		double, double, double, double, double, search_engine, int,
+		output_format, const char *, uint64_t);
+void reverse_engineer_confusion_matrices(count_int, count_int, int,
+		const target_ranges &, search_engine, int, output_format, const char *,
+		uint64_t);
+void reverse_engineer_class_splits(count_int, int, double, double, double,
+		double, double, search_engine, int, const char *);
+accuracy_band find_positives_vs_negatives(count_int, double, int);
+accuracy_band find_accuracy_band(count_int, const target_range &, int,
+		unsigned);
+count_band find_ratio_band(count_int, const metric_band &, long long);
+metric_band make_metric_band(double, int);
+metric_band make_range_band(const target_range &, int, unsigned);
+metric_band rounding_band(const target_range &, int, unsigned);
+metric_targets make_metric_targets(double, double, double, double, int);
+metric_targets make_range_targets(const target_ranges &, int);
+target_ranges exact_targets(double, double, double, double, double);
+bool exact_ranges(const target_ranges &);
+bool check_metric(count_int, count_int, count_int, count_int,
+		const metric_targets &);
+bool search_matrices(count_int, count_int, int, double, double, double,
+		double, double, search_engine, int, result_sink &, uint64_t = 0);
+bool search_matrices(count_int, count_int, int, const target_ranges &,
+		search_engine, int, result_sink &, uint64_t = 0);
+match_arena collect_matrices(count_int, count_int, int,
+		const target_ranges &, search_engine, int);
+uint64_t estimate_matches(const search_context &, count_int);
+bool search_class_splits(count_int, int, double, double, double, double,
+		double, search_engine, int, result_sink &);
+void find_matrices(count_int, count_int, const accuracy_band &, double,
+		double, double, double, double, int, search_engine, int, output_format,
+		const char *, uint64_t);
+void find_matrices(count_int, count_int, const accuracy_band &,
+		const target_ranges &, int, search_engine, int, output_format,
+		const char *, uint64_t);
+count_int make_search_context(count_int, count_int, const accuracy_band &,
+		double, double, double, double, double, int, search_engine,
+		search_context &);
+count_int make_search_context(count_int, count_int, const accuracy_band &,
+		const target_ranges &, int, search_engine, search_context &);
+void search_context_into(const search_context &, count_int, int,
+		result_sink &);
+void search_context_pipelined(const search_context &, count_int, int,
+		result_sink &);
+void search_diagonals(const search_context &, count_int, count_int,
+		result_sink &);
+bool gpu_available();
+void gpu_check_block(const metric_targets &, unsigned, count_int, count_int,
+		const std::vector<gpu_run> &, uint32_t, std::vector<uint32_t> &);
+int run_batch(const char *, search_engine, int, output_format, const char *);
+int run_sharded(const char *, const std::vector<batch_query> &, bool,
+		search_engine, output_format, const char *);
+bool read_batch_file(const char *, std::vector<batch_query> &);
+bool read_batch_query(const std::string &, int, batch_query &);
+bool valid_batch_query(const batch_query &);
+int decode_binary_output(const char *);
+bool read_varint(const unsigned char *, size_t, size_t &, long long &);
+int open_socket(const char *, bool);
+bool send_all(int, const char *, size_t);
+int build_index(count_int, count_int, int, int, const char *);
+bool search_stats_enabled();
+search_stats read_search_stats();
+void reset_search_stats();
+void print_search_stats(const search_stats &, bool, FILE *);
+int lookup_index(const char *, count_int, count_int, int, double, double,
+		double, double, double, output_format, const char *);
+int find_extra_metric(const char *);
+bool check_extra_metrics(count_int, count_int, count_int, count_int,
+		const metric_targets &, unsigned);
+void narrow_extra_metrics(const search_context &, count_int, count_int &,
+		count_int &);
+extern const metric_definition EXTRA_METRICS[EXTRA_METRIC_COUNT];
+void run_chunks_in_order(int, int, int, const std::function<void(int)> &,
+		const std::function<void(int)> &);
+bool valid_multiclass_problem(const multiclass_problem &);
+uint64_t search_multiclass(const multiclass_problem &, int,
+		const std::function<void(const multiclass_solution &)> &);
+bool multiclass_witness(const multiclass_problem &,
+		const multiclass_solution &, std::vector<count_int> &);
+int run_multiclass(const multiclass_problem &, int, bool, const char *);
+
+#endif
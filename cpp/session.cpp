@@ -0,0 +1,384 @@
+/**
+ * CPP file for search sessions, which answer a run of slightly different
+ * queries on the same class counts without searching each from scratch.
+ *
+ * Every constraint of a query is an interval of ratios: its integer band
+ * scaled by 1 / twice_scale, open or closed at each end by the offsets. When
+ * every interval of a query lies within those of an earlier query, its
+ * matches are exactly the earlier matches that meet its own bands, so they
+ * are filtered rather than searched, and stay in search order.
+ */
+#include <vector>
+#include <algorithm>
+#include "reverse_engineer.hpp"
+
+// Constraints of a query: accuracy, sensitivity, specificity, f1,
+// precision, then the registry metrics.
+const int SESSION_CONSTRAINTS = 5 + EXTRA_METRIC_COUNT;
+
+// Most matches kept for the constraints other than the one that changed.
+// Beyond this a query that loosens a constraint is searched in full.
+const size_t SESSION_PARTIAL_LIMIT = 1 << 22;
+
+session_bands make_session_bands(count_int, count_int, int,
+		const target_ranges &);
+const metric_band & constraint_band(const metric_targets &, int);
+bool same_constraint(const session_bands &, const session_bands &, int);
+bool band_within(const metric_band &, long long, const metric_band &,
+		long long);
+bool bands_within(const session_bands &, const session_bands &);
+void filter_matches(const std::vector<confusion_matrix> &,
+		const session_bands &, std::vector<confusion_matrix> &);
+target_ranges drop_constraint(const target_ranges &, int);
+
+/**
+ * search_session - start a session with no queries.
+ *
+ * Parameters
+ *   count_int - count of items in class A
+ *   count_int - count of items in class B
+ *   search_engine - the strategy used to search the diagonals
+ *   int - the number of worker threads
+ */
+search_session::search_session(count_int class_a_count,
+		count_int class_b_count, search_engine engine, int thread_count)
+	: class_a_count(class_a_count), class_b_count(class_b_count),
+	engine(engine == ENGINE_ROUNDED ? ENGINE_SCALAR : engine),
+	thread_count(thread_count), queried(false), previous(),
+	partial_constraint(-1), partial_bands(), step(SESSION_SEARCHED)
+{
+}
+
+/**
+ * query - find the matches of the next query of the session.
+ *
+ * Parameters
+ *   int - the number of decimal places to round to
+ *   target_ranges - the target ranges and rounding modes
+ *
+ * Returns
+ *   bool - false if no combination can achieve the accuracy
+ */
+bool search_session::query(int decimal_places, const target_ranges & ranges)
+{
+	session_bands bands = make_session_bands(class_a_count, class_b_count,
+			decimal_places, ranges);
+	bool feasible = bands.accuracy.feasible;
+	std::vector<confusion_matrix> found;
+
+	// Count the constraints the query changed since the previous one.
+	int changed = -1, changes = 0;
+	for (int c = 0; queried && c < SESSION_CONSTRAINTS; c++)
+		if (!same_constraint(bands, previous, c))
+		{
+			changed = c;
+			changes++;
+		}
+
+	if (!feasible)
+		step = SESSION_SEARCHED;
+	else if (queried && bands_within(bands, previous))
+	{
+		filter_matches(matches, bands, found);
+		step = SESSION_FILTERED;
+	}
+	else if ((partial_constraint != -1 && bands_within(bands, partial_bands)) ||
+			(queried && changes == 1 && keep_partial(decimal_places, ranges,
+				changed)))
+	{
+		filter_matches(partial, bands, found);
+		step = SESSION_EXTENDED;
+	}
+	else
+	{
+		search(decimal_places, ranges, found, 0);
+		step = SESSION_SEARCHED;
+	}
+
+	matches.swap(found);
+	previous = bands;
+	queried = true;
+	return feasible;
+}
+
+/**
+ * results - the matches of the last query, in search order.
+ *
+ * Returns
+ *   std::vector - the matching matrices
+ */
+const std::vector<confusion_matrix> & search_session::results() const
+{
+	return matches;
+}
+
+/**
+ * last_step - how the last query was answered.
+ *
+ * Returns
+ *   session_step - whether it searched, filtered or extended
+ */
+session_step search_session::last_step() const
+{
+	return step;
+}
+
+/**
+ * search - run a full search of the session's class counts.
+ *
+ * Parameters
+ *   int - the number of decimal places to round to
+ *   target_ranges - the target ranges and rounding modes
+ *   std::vector - set to the matches
+ *   uint64_t - the most matches to find, 0 for all of them
+ */
+void search_session::search(
+		int decimal_places,
+		const target_ranges & ranges,
+		std::vector<confusion_matrix> & found,
+		uint64_t match_limit
+		)
+{
+	vector_sink sink;
+	search_matrices(class_a_count, class_b_count, decimal_places, ranges,
+			engine, thread_count, sink, match_limit);
+	found = sink.results();
+}
+
+/**
+ * keep_partial - search and keep the matches of every constraint of a
+ * query but one.
+ *
+ * Parameters
+ *   int - the number of decimal places to round to
+ *   target_ranges - the target ranges and rounding modes
+ *   int - the constraint to leave out
+ *
+ * Returns
+ *   bool - false if there were too many matches to keep
+ */
+bool search_session::keep_partial(
+		int decimal_places,
+		const target_ranges & ranges,
+		int constraint
+		)
+{
+	target_ranges dropped = drop_constraint(ranges, constraint);
+	search(decimal_places, dropped, partial, SESSION_PARTIAL_LIMIT + 1);
+	if (partial.size() > SESSION_PARTIAL_LIMIT)
+	{
+		std::vector<confusion_matrix>().swap(partial);
+		partial_constraint = -1;
+		return false;
+	}
+	partial_constraint = constraint;
+	partial_bands = make_session_bands(class_a_count, class_b_count,
+			decimal_places, dropped);
+	return true;
+}
+
+/**
+ * make_session_bands - the bands of a query.
+ *
+ * Parameters
+ *   count_int - count of items in class A
+ *   count_int - count of items in class B
+ *   int - the number of decimal places to round to
+ *   target_ranges - the target ranges and rounding modes
+ *
+ * Returns
+ *   session_bands - the accuracy band and target bands of the query
+ */
+session_bands make_session_bands(
+		count_int class_a_count,
+		count_int class_b_count,
+		int decimal_places,
+		const target_ranges & ranges
+		)
+{
+	session_bands bands;
+	bands.decimal_places = decimal_places;
+	bands.accuracy = find_accuracy_band(class_a_count + class_b_count,
+			ranges.accuracy, decimal_places, ranges.rounding);
+	bands.targets = make_range_targets(ranges, decimal_places);
+	return bands;
+}
+
+/**
+ * constraint_band - the band of one constraint other than the accuracy.
+ *
+ * Parameters
+ *   metric_targets - the integer bands of the targets
+ *   int - the constraint, from 1
+ *
+ * Returns
+ *   metric_band - the band of the constraint
+ */
+const metric_band & constraint_band(const metric_targets & targets,
+		int constraint)
+{
+	switch (constraint)
+	{
+	case 1:
+		return targets.sensitivity;
+	case 2:
+		return targets.specificity;
+	case 3:
+		return targets.f1;
+	case 4:
+		return targets.precision;
+	default:
+		return targets.extra[constraint - 5];
+	}
+}
+
+/**
+ * same_constraint - whether two queries hold one constraint identically.
+ *
+ * Parameters
+ *   session_bands - the bands of one query
+ *   session_bands - the bands of the other
+ *   int - the constraint
+ *
+ * Returns
+ *   bool - if the constraint matches the same ratios in both
+ */
+bool same_constraint(
+		const session_bands & first,
+		const session_bands & second,
+		int constraint
+		)
+{
+	if (constraint == 0)
+		return first.accuracy.feasible == second.accuracy.feasible &&
+			first.accuracy.min_correct == second.accuracy.min_correct &&
+			first.accuracy.max_correct == second.accuracy.max_correct;
+
+	const metric_band & a = constraint_band(first.targets, constraint);
+	const metric_band & b = constraint_band(second.targets, constraint);
+	if (!a.enabled || !b.enabled)
+		return a.enabled == b.enabled;
+	return first.targets.twice_scale == second.targets.twice_scale &&
+		a.lower == b.lower && a.upper == b.upper &&
+		a.lower_offset == b.lower_offset && a.upper_offset == b.upper_offset;
+}
+
+/**
+ * band_within - whether every ratio one band matches is matched by another.
+ *
+ * The bands are compared as intervals, lower / twice_scale to
+ * upper / twice_scale, so they may have different decimal places.
+ *
+ * Parameters
+ *   metric_band - the inner band
+ *   long long - twice the decimal scale of the inner band
+ *   metric_band - the outer band
+ *   long long - twice the decimal scale of the outer band
+ *
+ * Returns
+ *   bool - if the inner interval lies within the outer one
+ */
+bool band_within(
+		const metric_band & inner,
+		long long inner_scale,
+		const metric_band & outer,
+		long long outer_scale
+		)
+{
+	if (!outer.enabled)
+		return true;
+	if (!inner.enabled)
+		return false;
+
+	// An end that meets the outer one must be open wherever the outer is.
+	wide_int inner_lower = (wide_int)inner.lower * outer_scale;
+	wide_int outer_lower = (wide_int)outer.lower * inner_scale;
+	wide_int inner_upper = (wide_int)inner.upper * outer_scale;
+	wide_int outer_upper = (wide_int)outer.upper * inner_scale;
+	bool lower = inner_lower > outer_lower || (inner_lower == outer_lower &&
+			inner.lower_offset >= outer.lower_offset);
+	bool upper = inner_upper < outer_upper || (inner_upper == outer_upper &&
+			inner.upper_offset <= outer.upper_offset);
+	return lower && upper;
+}
+
+/**
+ * bands_within - whether every match of one query matches another.
+ *
+ * Parameters
+ *   session_bands - the bands of the inner query
+ *   session_bands - the bands of the outer query
+ *
+ * Returns
+ *   bool - if every constraint of the inner query lies within the outer
+ */
+bool bands_within(const session_bands & inner, const session_bands & outer)
+{
+	if (!outer.accuracy.feasible ||
+			inner.accuracy.min_correct < outer.accuracy.min_correct ||
+			inner.accuracy.max_correct > outer.accuracy.max_correct)
+		return false;
+	for (int c = 1; c < SESSION_CONSTRAINTS; c++)
+		if (!band_within(constraint_band(inner.targets, c),
+				inner.targets.twice_scale, constraint_band(outer.targets, c),
+				outer.targets.twice_scale))
+			return false;
+	return true;
+}
+
+/**
+ * filter_matches - keep the matches that meet every band of a query.
+ *
+ * Parameters
+ *   std::vector - the matches to filter, in search order
+ *   session_bands - the bands of the query
+ *   std::vector - set to the matches that meet them, in the same order
+ */
+void filter_matches(
+		const std::vector<confusion_matrix> & candidates,
+		const session_bands & bands,
+		std::vector<confusion_matrix> & found
+		)
+{
+	found.clear();
+	for (size_t m = 0; m < candidates.size(); m++)
+	{
+		const confusion_matrix & matrix = candidates[m];
+		count_int correct = matrix.tp + matrix.tn;
+		if (correct >= bands.accuracy.min_correct &&
+				correct <= bands.accuracy.max_correct &&
+				check_metric(matrix.tp, matrix.fn, matrix.fp, matrix.tn,
+					bands.targets) &&
+				check_extra_metrics(matrix.tp, matrix.fn, matrix.fp, matrix.tn,
+					bands.targets, bands.targets.extra_mask))
+			found.push_back(matrix);
+	}
+}
+
+/**
+ * drop_constraint - the target ranges without one constraint.
+ *
+ * The accuracy cannot be disabled, so it is widened to every value.
+ *
+ * Parameters
+ *   target_ranges - the target ranges and rounding modes
+ *   int - the constraint to leave out
+ *
+ * Returns
+ *   target_ranges - the ranges with the constraint disabled
+ */
+target_ranges drop_constraint(const target_ranges & ranges, int constraint)
+{
+	target_ranges dropped = ranges;
+	target_range * ranges_of[5] = {&dropped.accuracy, &dropped.sensitivity,
+		&dropped.specificity, &dropped.f1, &dropped.precision};
+	const target_range any = {0, 1};
+	const target_range disabled = {-1, -1};
+	if (constraint == 0)
+		dropped.accuracy = any;
+	else if (constraint < 5)
+		*ranges_of[constraint] = disabled;
+	else
+		dropped.extra_mask &= ~(1u << (constraint - 5));
+	return dropped;
+}
@@ -0,0 +1,472 @@
+/**
+ * CPP file for sharded searches, which spread the diagonals of one query,
+ * or of every query of a batch, over query servers on other machines.
+ *
+ * The coordinator cuts each query into shards, runs of its accuracy
+ * diagonals, and keeps one connection to each worker, a
+ * reverse_engineer --serve process, handing it the next shard whenever it
+ * finishes one. A worker answers a shard with its matches as varint (TP, FP)
+ * deltas. Shards are written out in order, so the output is the same as a
+ * local search whichever worker answered each shard. A shard whose worker
+ * fails or sends back a malformed reply is handed out again, and a worker
+ * that keeps failing is dropped.
+ */
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "reverse_engineer.hpp"
+
+// Shards handed out per worker, spread over the queries.
+const int SHARDS_PER_WORKER = 8;
+
+// Times a shard is handed out before the search gives up.
+const int SHARD_ATTEMPTS = 4;
+
+// Failures in a row after which a worker is no longer used.
+const int WORKER_FAILURES = 3;
+
+// Pause after a worker fails, multiplied by its failures in a row.
+const int WORKER_RETRY_MS = 500;
+
+// Longest a worker may go without sending anything, in seconds.
+const int WORKER_TIMEOUT_SECONDS = 600;
+
+// Longest reply line a worker may send.
+const size_t SHARD_MAX_LINE = 256;
+
+/**
+ * shard_task - a run of diagonals of one query, handed to a worker.
+ */
+struct shard_task
+{
+	int query;
+	count_int first;
+	count_int last;
+};
+
+bool run_shard(const std::string &, int &, std::string &,
+		const batch_query &, const shard_task &, int, const search_context &,
+		std::string &, uint64_t &);
+bool receive_line(int, std::string &, std::string &);
+bool receive_bytes(int, std::string &, size_t, std::string &);
+bool read_shard_pairs(const std::string &, uint64_t, count_int, count_int,
+		result_sink *);
+
+/**
+ * run_sharded - search queries on remote workers into one output file.
+ *
+ * A batch is written as run_batch writes it, a tagged csv file. A single
+ * query is written as find_matrices writes it, in any output format.
+ *
+ * Parameters
+ *   const char * - the addresses of the workers, separated by commas
+ *   std::vector - the queries to search
+ *   bool - tag every row with the line of its query, as for a batch
+ *   search_engine - the strategy used to size the searches
+ *   output_format - the layout of the output file
+ *   const char * - the path of the output file
+ *
+ * Returns
+ *   int - the process exit code
+ */
+int run_sharded(
+		const char * worker_list,
+		const std::vector<batch_query> & queries,
+		bool tagged,
+		search_engine engine,
+		output_format format,
+		const char * output_path
+		)
+{
+	std::vector<std::string> workers;
+	std::string list = worker_list;
+	for (size_t start = 0; start <= list.size(); )
+	{
+		size_t comma = std::min(list.find(',', start), list.size());
+		if (comma > start)
+			workers.push_back(list.substr(start, comma - start));
+		start = comma + 1;
+	}
+	if (workers.empty())
+	{
+		std::cerr << "--workers needs at least one address." << std::endl;
+		return(1);
+	}
+	if (tagged && format != FORMAT_CSV)
+	{
+		std::cerr << "--batch only writes csv output." << std::endl;
+		return(1);
+	}
+
+	// Every query gets an equal share of the shards, and at least one.
+	int shards_per_query = (int)std::max((size_t)1,
+			(workers.size() * SHARDS_PER_WORKER + queries.size() - 1) /
+			std::max((size_t)1, queries.size()));
+	std::vector<search_context> contexts(queries.size());
+	std::vector<shard_task> shards;
+	for (size_t q = 0; q < queries.size(); q++)
+	{
+		const batch_query & query = queries[q];
+		if (!tagged && format == FORMAT_BINARY &&
+				(query.class_a_count > INT32_MAX || query.class_b_count > INT32_MAX))
+		{
+			std::cerr << "Binary output holds 32-bit counts, use varint for "
+				"larger classes." << std::endl;
+			return(1);
+		}
+		accuracy_band band = find_positives_vs_negatives(
+				query.class_a_count + query.class_b_count, query.target_accuracy,
+				query.decimal_places);
+		if (!band.feasible)
+		{
+			if (!tagged)
+			{
+				std::cout << "There are no combinations that can achieve this "
+					"accuracy." << std::endl;
+				return(0);
+			}
+			std::cerr << "Line " << query.line << ": there are no combinations "
+				"that can achieve this accuracy." << std::endl;
+			continue;
+		}
+
+		count_int combinations = make_search_context(query.class_a_count,
+				query.class_b_count, band, query.target_accuracy,
+				query.target_sensitivity, query.target_specificity,
+				query.target_f1, query.target_precision, query.decimal_places,
+				engine, contexts[q]);
+		int shard_count = (int)std::min(combinations, (count_int)shards_per_query);
+		for (int shard = 0; shard < shard_count; shard++)
+		{
+			shard_task next = {(int)q, combinations * shard / shard_count,
+				combinations * (shard + 1) / shard_count};
+			shards.push_back(next);
+		}
+	}
+
+	int fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1)
+	{
+		std::cerr << "Failed to open the output file." << std::endl;
+		return(1);
+	}
+	match_sink file(tagged ? search_context() : contexts[0], format, fd,
+			tagged ? "" : NULL);
+	file.begin();
+
+	// Failed shards go back to the front of the queue, so that the writer,
+	// which waits for the shards in order, is held up as little as possible.
+	int shard_count = (int)shards.size();
+	std::deque<int> queued;
+	for (int shard = 0; shard < shard_count; shard++)
+		queued.push_back(shard);
+	std::vector<std::string> replies(shard_count);
+	std::vector<uint64_t> reply_matches(shard_count, 0);
+	std::vector<char> finished(shard_count, 0);
+	std::vector<int> attempts(shard_count, 0);
+	int finished_count = 0;
+	int live_workers = (int)workers.size();
+	bool failed = false;
+	std::mutex progress;
+	std::condition_variable changed;
+
+	std::vector<std::thread> threads;
+	for (size_t w = 0; w < workers.size(); w++)
+	{
+		threads.emplace_back([&, w]() {
+			const std::string & address = workers[w];
+			int connection = -1;
+			std::string unread;
+			int failures = 0;
+			while (true)
+			{
+				int shard;
+				{
+					std::unique_lock<std::mutex> lock(progress);
+					changed.wait(lock, [&]() {
+						return failed || !queued.empty() || finished_count == shard_count;
+					});
+					if (failed || queued.empty())
+						break;
+					shard = queued.front();
+					queued.pop_front();
+				}
+
+				const shard_task & task = shards[shard];
+				std::string reply;
+				uint64_t matches = 0;
+				bool answered = run_shard(address, connection, unread,
+						queries[task.query], task, shard, contexts[task.query], reply,
+						matches);
+
+				std::unique_lock<std::mutex> lock(progress);
+				if (answered)
+				{
+					replies[shard].swap(reply);
+					reply_matches[shard] = matches;
+					finished[shard] = 1;
+					finished_count++;
+					failures = 0;
+					changed.notify_all();
+					continue;
+				}
+
+				failures++;
+				if (++attempts[shard] >= SHARD_ATTEMPTS)
+				{
+					std::cerr << "Shard " << shard << " failed on "
+						<< SHARD_ATTEMPTS << " attempts, giving up." << std::endl;
+					failed = true;
+				}
+				else
+				{
+					std::cerr << "Worker " << address << " failed shard " << shard
+						<< ", retrying it." << std::endl;
+					queued.push_front(shard);
+				}
+				if (failures >= WORKER_FAILURES)
+				{
+					std::cerr << "Dropping worker " << address << " after "
+						<< failures << " failures." << std::endl;
+					if (--live_workers == 0 && !failed)
+					{
+						std::cerr << "No workers are left." << std::endl;
+						failed = true;
+					}
+					changed.notify_all();
+					break;
+				}
+				changed.notify_all();
+				lock.unlock();
+				std::this_thread::sleep_for(
+						std::chrono::milliseconds(WORKER_RETRY_MS * failures));
+			}
+			if (connection != -1)
+				close(connection);
+		});
+	}
+
+	for (int shard = 0; shard < shard_count; shard++)
+	{
+		std::string reply;
+		{
+			std::unique_lock<std::mutex> lock(progress);
+			changed.wait(lock, [&]() { return failed || finished[shard] != 0; });
+			if (!finished[shard])
+				break;
+			reply.swap(replies[shard]);
+		}
+
+		const batch_query & query = queries[shards[shard].query];
+		char tag[16];
+		snprintf(tag, sizeof(tag), "%d", query.line);
+		match_sink buffer(contexts[shards[shard].query], format, -1,
+				tagged ? tag : NULL);
+		read_shard_pairs(reply, reply_matches[shard], query.class_a_count,
+				query.class_b_count, &buffer);
+		file.append(buffer);
+	}
+	for (size_t t = 0; t < threads.size(); t++)
+		threads[t].join();
+
+	file.finish();
+	close(fd);
+	if (failed)
+	{
+		unlink(output_path);
+		return(1);
+	}
+	return(0);
+}
+
+/**
+ * run_shard - have a worker search one shard, connecting to it first if
+ * need be.
+ *
+ * On failure the connection is closed, so the next shard reconnects.
+ *
+ * Parameters
+ *   std::string - the address of the worker
+ *   int - the connection to the worker, -1 to connect
+ *   std::string - bytes received on the connection and not yet read
+ *   batch_query - the query of the shard
+ *   shard_task - the shard
+ *   int - the id of the request, the index of the shard
+ *   search_context - the context of the query
+ *   std::string - set to the varint pairs of the matches
+ *   uint64_t - set to the number of matches
+ *
+ * Returns
+ *   bool - if the worker answered the shard with a well formed reply
+ */
+bool run_shard(
+		const std::string & address,
+		int & connection,
+		std::string & unread,
+		const batch_query & query,
+		const shard_task & task,
+		int id,
+		const search_context & context,
+		std::string & reply,
+		uint64_t & matches
+		)
+{
+	if (connection == -1)
+	{
+		connection = open_socket(address.c_str(), false);
+		if (connection == -1)
+			return false;
+		struct timeval timeout = {WORKER_TIMEOUT_SECONDS, 0};
+		setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+				sizeof(timeout));
+		unread.clear();
+	}
+
+	// Targets are sent with every digit, so the worker builds the same bands.
+	char request[512];
+	snprintf(request, sizeof(request), "{\"id\":%d,\"class_a\":%lld,"
+			"\"class_b\":%lld,\"decimal_places\":%d,\"accuracy\":%.17g,"
+			"\"sensitivity\":%.17g,\"specificity\":%.17g,\"f1\":%.17g,"
+			"\"precision\":%.17g,\"first\":%lld,\"last\":%lld}\n", id,
+			query.class_a_count, query.class_b_count, query.decimal_places,
+			query.target_accuracy, query.target_sensitivity,
+			query.target_specificity, query.target_f1, query.target_precision,
+			task.first, task.last);
+
+	std::string line;
+	int reply_id = -1;
+	unsigned long long match_count = 0, size = 0;
+	int consumed = 0;
+	bool answered = send_all(connection, request, strlen(request)) &&
+		receive_line(connection, unread, line) &&
+		sscanf(line.c_str(), "{\"id\":%d,\"shard\":true,\"matches\":%llu,"
+				"\"bytes\":%llu}%n", &reply_id, &match_count, &size, &consumed) == 3 &&
+		(size_t)consumed == line.size() && reply_id == id &&
+		receive_bytes(connection, unread, (size_t)size, reply) &&
+		read_shard_pairs(reply, match_count, context.class_a_count,
+				context.class_b_count, NULL);
+	if (!answered)
+	{
+		close(connection);
+		connection = -1;
+		return false;
+	}
+	matches = match_count;
+	return true;
+}
+
+/**
+ * receive_line - read the next line from a connection.
+ *
+ * Parameters
+ *   int - the connection
+ *   std::string - bytes received and not yet read, kept between calls
+ *   std::string - set to the line, without its newline
+ *
+ * Returns
+ *   bool - false if the connection failed or the line is too long
+ */
+bool receive_line(int connection, std::string & unread, std::string & line)
+{
+	char block[4096];
+	size_t newline;
+	while ((newline = unread.find('\n')) == std::string::npos)
+	{
+		if (unread.size() > SHARD_MAX_LINE)
+			return false;
+		ssize_t received = recv(connection, block, sizeof(block), 0);
+		if (received < 0 && errno == EINTR)
+			continue;
+		if (received <= 0)
+			return false;
+		unread.append(block, (size_t)received);
+	}
+	line = unread.substr(0, newline);
+	unread.erase(0, newline + 1);
+	return true;
+}
+
+/**
+ * receive_bytes - read a block of bytes from a connection.
+ *
+ * Parameters
+ *   int - the connection
+ *   std::string - bytes received and not yet read, kept between calls
+ *   size_t - the number of bytes to read
+ *   std::string - set to the bytes
+ *
+ * Returns
+ *   bool - false if the connection failed first
+ */
+bool receive_bytes(int connection, std::string & unread, size_t size,
+		std::string & bytes)
+{
+	char block[65536];
+	while (unread.size() < size)
+	{
+		ssize_t received = recv(connection, block, std::min(sizeof(block),
+					size - unread.size()), 0);
+		if (received < 0 && errno == EINTR)
+			continue;
+		if (received <= 0)
+			return false;
+		unread.append(block, (size_t)received);
+	}
+	bytes = unread.substr(0, size);
+	unread.erase(0, size);
+	return true;
+}
+
+/**
+ * read_shard_pairs - decode the varint pairs of a shard reply, checking
+ * that they describe valid matrices.
+ *
+ * Parameters
+ *   std::string - the varint (TP, FP) deltas, from (0, 0)
+ *   uint64_t - the number of matches the reply holds
+ *   count_int - count of items in class A
+ *   count_int - count of items in class B
+ *   result_sink - the sink the matches are written to, or NULL to only
+ *                 check them
+ *
+ * Returns
+ *   bool - if the bytes hold exactly that many valid matches
+ */
+bool read_shard_pairs(
+		const std::string & bytes,
+		uint64_t matches,
+		count_int class_a_count,
+		count_int class_b_count,
+		result_sink * out
+		)
+{
+	const unsigned char * data = (const unsigned char *)bytes.data();
+	size_t offset = 0;
+	long long TP = 0, FP = 0;
+	for (uint64_t m = 0; m < matches; m++)
+	{
+		long long tp_delta, fp_delta;
+		if (!read_varint(data, bytes.size(), offset, tp_delta) ||
+				!read_varint(data, bytes.size(), offset, fp_delta))
+			return false;
+		TP += tp_delta;
+		FP += fp_delta;
+		if (TP < 0 || TP > class_a_count || FP < 0 || FP > class_b_count)
+			return false;
+		if (out != NULL)
+			out->write_match(TP, class_a_count - TP, FP, class_b_count - FP);
+	}
+	return offset == bytes.size();
+}